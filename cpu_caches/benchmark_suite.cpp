@@ -0,0 +1,432 @@
+/*
+ * benchmark_suite.cpp
+ *
+ * One driver for the benchmarks registered with utils/benchmark_registry.h.
+ * It runs every registered benchmark whose full name ("<name>/<parameter>")
+ * matches --filter, measures each one adaptively, and writes the results,
+ * tagged with the machine and the build, as JSON and/or CSV.
+ *
+ * Usage (example):
+ *   ./benchmark_suite [--list] [--filter <regex>] [--repetitions 3]
+ *                     [--warmup 3] [--min-iterations 10]
+ *                     [--max-iterations 1000] [--target-ci 0.01]
+ *                     [--max-seconds 0.5] [--cold]
+ *                     [--pages default|thp|2m|1g] [--prefault]
+ *                     [--align <bytes>]
+ *                     [--format json|csv|both] [--out <basename>]
+ *                     [--baseline <csv>] [--threshold 0.05] [--alpha 0.01]
+ *
+ * The results go to <basename>.json and/or <basename>.csv, by default
+ * suite_<machine>. Times are nanoseconds per operation: per lookup for the
+ * search benchmarks, per element for the counting kernels.
+ *
+ * With --baseline, every run is compared with the same run of a CSV written
+ * earlier (see utils/baseline.h), and the verdicts are printed and written
+ * to <basename>_comparison.csv. The program exits with 2 if any run
+ * regressed by more than --threshold, 1 on errors and 0 otherwise.
+ *
+ * The benchmarks registered here are small, fixed versions of the sweeps of
+ * search_benchmarks and parallel_chunks, built from the same headers. They
+ * are meant to be rerun often and compared between runs; the dedicated
+ * programs remain the place for full sweeps.
+*/
+
+#include "../utils/baseline.h"
+#include "../utils/benchmark_registry.h"
+#include "../utils/cache.h"
+#include "../utils/page_allocator.h"
+#include "../utils/system_info.h"
+#include "count_kernels.h"
+#include "hash_tables.h"
+#include "key_stream.h"
+#include "matrix.h"
+#include "ordered_sets.h"
+#include "search_layouts.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <regex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*----------------------------------------------------------------------------*/
+
+using ElementType = long long;
+// Sorted keys and key streams, on the pages selected with --pages.
+using KeyVector = PageVector< ElementType >;
+
+// Keys stored by the search benchmarks: inside L1, L2 and past L2 of most
+// machines.
+const std::vector< long long > SEARCH_SIZES = { 1024, 65536, 1 << 20 };
+
+// Lookups per timed call.
+constexpr std::size_t SEARCH_BATCH = 1024;
+
+// Rows of COUNT_COLS ints counted per timed call: 64 KB, 1 MB and 16 MB.
+const std::vector< long long > COUNT_ROWS = { 16, 256, 4096 };
+constexpr int COUNT_COLS = 1024;
+constexpr int COUNT_THRESHOLD = 128;
+
+/*----------------------------------------------------------------------------*/
+
+// Every other integer, so that the odd keys are misses.
+KeyVector generateSortedKeys ( long long size )
+{
+    KeyVector keys( size );
+    for ( long long i = 0; i < size; ++i )
+        keys[i] = 2 * i;
+    return keys;
+}
+
+/*
+Lookups of a uniform stream of hits. make( keys ) builds the structure from
+the sorted keys and returns it as a shared_ptr, which the timed body keeps
+alive; lookup( structure, key ) returns something that converts to a number.
+*/
+template < typename _MakeT, typename _LookupT >
+BenchmarkDefinition searchDefinition (
+    std::string method, _MakeT make, _LookupT lookup
+)
+{
+    return {
+        "search/" + method, "Keys", SEARCH_SIZES,
+        [ make, lookup ] ( long long size )
+        {
+            const KeyVector keys = generateSortedKeys( size );
+            auto structure = make( keys );
+            auto stream = std::make_shared< KeyVector >(
+                generateKeyStream( keys, SEARCH_BATCH, KeyStreamOptions{} )
+            );
+            return BenchmarkCase{
+                [ structure, stream, lookup ] () -> double
+                {
+                    volatile double accumulator = 0;
+                    for ( ElementType key : *stream )
+                        accumulator = accumulator + lookup( *structure, key );
+                    return accumulator;
+                },
+                stream->size()
+            };
+        }
+    };
+}
+
+auto makeSorted = [] ( KeyVector const & keys )
+{
+    return std::make_shared< KeyVector >( keys );
+};
+
+template < typename _StructureT >
+auto makeFrom = [] ( KeyVector const & keys )
+{
+    return std::make_shared< _StructureT >( keys );
+};
+
+static BenchmarkRegistrar registerBinarySearch( searchDefinition(
+    "BinarySearch", makeSorted,
+    [] ( KeyVector const & data, ElementType key )
+    {
+        return std::binary_search( data.begin(), data.end(), key );
+    }
+) );
+
+static BenchmarkRegistrar registerBranchless( searchDefinition(
+    "BranchlessBinarySearch", makeSorted,
+    [] ( KeyVector const & data, ElementType key )
+    {
+        return branchlessBinarySearch( data, key );
+    }
+) );
+
+static BenchmarkRegistrar registerEytzinger( searchDefinition(
+    "Eytzinger", makeFrom< EytzingerLayout< ElementType > >,
+    [] ( EytzingerLayout< ElementType > const & layout, ElementType key )
+    {
+        return layout.search( key );
+    }
+) );
+
+static BenchmarkRegistrar registerSTree( searchDefinition(
+    "STree", makeFrom< STree >,
+    [] ( STree const & tree, ElementType key ) { return tree.search( key ); }
+) );
+
+static BenchmarkRegistrar registerSet( searchDefinition(
+    "StdSet",
+    [] ( KeyVector const & keys )
+    {
+        return std::make_shared< std::set< ElementType > >(
+            keys.begin(), keys.end()
+        );
+    },
+    [] ( std::set< ElementType > const & s, ElementType key )
+    {
+        return s.find( key ) != s.end();
+    }
+) );
+
+static BenchmarkRegistrar registerFlatMap( searchDefinition(
+    "FlatMap",
+    [] ( KeyVector const & keys )
+    {
+        std::vector< std::pair< ElementType, ElementType > > pairs;
+        for ( ElementType key : keys )
+            pairs.emplace_back( key, key );
+        return std::make_shared< FlatMap< ElementType, ElementType > >(
+            pairs
+        );
+    },
+    [] ( FlatMap< ElementType, ElementType > const & map, ElementType key )
+    {
+        return map.find( key ) != nullptr;
+    }
+) );
+
+static BenchmarkRegistrar registerLinearProbing( searchDefinition(
+    "LinearProbing", makeFrom< LinearProbingSet< ElementType > >,
+    [] ( LinearProbingSet< ElementType > const & table, ElementType key )
+    {
+        return table.find( key ) != nullptr;
+    }
+) );
+
+static BenchmarkRegistrar registerSwissTable( searchDefinition(
+    "SwissTable", makeFrom< SwissTable< ElementType > >,
+    [] ( SwissTable< ElementType > const & table, ElementType key )
+    {
+        return table.find( key ) != nullptr;
+    }
+) );
+
+/*----------------------------------------------------------------------------*/
+
+// Count over a random FlatMatrix with one kernel of count_kernels.h. A kernel
+// the running CPU lacks is registered without parameters, so it never runs.
+BenchmarkDefinition countDefinition ( std::string kernelName )
+{
+    std::vector< long long > rows;
+    for ( CountKernel const & kernel : availableCountKernels() )
+    {
+        if ( kernelName == kernel.name )
+            rows = COUNT_ROWS;
+    }
+    return {
+        "count/" + kernelName, "Rows", rows,
+        [ kernelName ] ( long long rowCount )
+        {
+            RowCountFunc func = countAboveScalar;
+            for ( CountKernel const & kernel : availableCountKernels() )
+            {
+                if ( kernelName == kernel.name )
+                    func = kernel.func;
+            }
+            const int rows = static_cast< int >( rowCount );
+            auto matrix = std::make_shared< FlatMatrix >(
+                generateRandomMatrix< FlatMatrix >( rows, COUNT_COLS )
+            );
+            return BenchmarkCase{
+                [ matrix, func, rows ] () -> double
+                {
+                    long long count = 0;
+                    for ( int i = 0; i < rows; ++i )
+                    {
+                        count += func(
+                            rowData( *matrix, i ), COUNT_COLS, COUNT_THRESHOLD
+                        );
+                    }
+                    return static_cast< double >( count );
+                },
+                static_cast< std::size_t >( rows ) * COUNT_COLS
+            };
+        }
+    };
+}
+
+static BenchmarkRegistrar registerCountScalar( countDefinition( "Scalar" ) );
+static BenchmarkRegistrar registerCountSse2( countDefinition( "SSE2" ) );
+static BenchmarkRegistrar registerCountAvx2( countDefinition( "AVX2" ) );
+static BenchmarkRegistrar registerCountAvx512( countDefinition( "AVX512" ) );
+static BenchmarkRegistrar registerCountNeon( countDefinition( "NEON" ) );
+
+/*----------------------------------------------------------------------------*/
+
+void printSystemInfo ( std::ostream & out, SuiteOptions const & options )
+{
+    for ( auto const & [ key, value ] : systemInfoFields( options ) )
+        out << key << ": " << value << "\n";
+    out << std::endl;
+}
+
+void listBenchmarks ( std::ostream & out, std::string const & filter )
+{
+    const std::regex pattern( filter );
+    for ( BenchmarkDefinition const & definition :
+          benchmarkRegistry().definitions() )
+    {
+        for ( long long parameter : definition.parameters )
+        {
+            const std::string name = benchmarkRunName( definition, parameter );
+            if ( std::regex_search( name, pattern ) )
+                out << name << "\n";
+        }
+    }
+}
+
+int main ( int argc, char* argv[] )
+{
+    SuiteOptions options;
+    options.runner.maxSeconds = 0.5;
+    std::string format = "both";
+    std::string out = "suite_" + machineName();
+    bool list = false;
+    std::string baselineFile;
+    ComparisonOptions comparisonOptions;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        std::string arg = argv[i];
+        if ( arg == "--filter" && ( i + 1 ) < argc )
+        {
+            options.filter = argv[++i];
+        }
+        else if ( arg == "--list" )
+        {
+            list = true;
+        }
+        else if ( arg == "--repetitions" && ( i + 1 ) < argc )
+        {
+            options.repetitions = std::max( 1, std::stoi( argv[++i] ) );
+        }
+        else if ( arg == "--warmup" && ( i + 1 ) < argc )
+        {
+            options.runner.warmupIterations = std::stoi( argv[++i] );
+        }
+        else if ( arg == "--min-iterations" && ( i + 1 ) < argc )
+        {
+            options.runner.minIterations = std::stoi( argv[++i] );
+        }
+        else if ( arg == "--max-iterations" && ( i + 1 ) < argc )
+        {
+            options.runner.maxIterations = std::stoi( argv[++i] );
+        }
+        else if ( arg == "--target-ci" && ( i + 1 ) < argc )
+        {
+            options.runner.targetRelativeCi = std::stod( argv[++i] );
+        }
+        else if ( arg == "--max-seconds" && ( i + 1 ) < argc )
+        {
+            options.runner.maxSeconds = std::stod( argv[++i] );
+        }
+        else if ( arg == "--cold" )
+        {
+            options.cache = CacheState::Cold;
+        }
+        else if ( arg == "--pages" && ( i + 1 ) < argc )
+        {
+            std::string name = argv[++i];
+            if ( !parsePageMode( name, pageOptions().mode ) )
+            {
+                std::cerr << "Error: unknown page mode " << name
+                          << " (expected default, thp, 2m or 1g)\n";
+                return 1;
+            }
+        }
+        else if ( arg == "--prefault" )
+        {
+            pageOptions().prefault = true;
+        }
+        else if ( arg == "--align" && ( i + 1 ) < argc )
+        {
+            std::string value = argv[++i];
+            if ( !parseAlignment( value, pageOptions().alignment ) )
+            {
+                std::cerr << "Error: invalid alignment " << value
+                          << " (expected a power of two up to 4096)\n";
+                return 1;
+            }
+        }
+        else if ( arg == "--format" && ( i + 1 ) < argc )
+        {
+            format = argv[++i];
+            if ( format != "json" && format != "csv" && format != "both" )
+            {
+                std::cerr << "Error: unknown format " << format
+                          << " (expected json, csv or both)\n";
+                return 1;
+            }
+        }
+        else if ( arg == "--out" && ( i + 1 ) < argc )
+        {
+            out = argv[++i];
+        }
+        else if ( arg == "--baseline" && ( i + 1 ) < argc )
+        {
+            baselineFile = argv[++i];
+        }
+        else if ( arg == "--threshold" && ( i + 1 ) < argc )
+        {
+            comparisonOptions.threshold = std::stod( argv[++i] );
+        }
+        else if ( arg == "--alpha" && ( i + 1 ) < argc )
+        {
+            comparisonOptions.alpha = std::stod( argv[++i] );
+        }
+    }
+
+    try
+    {
+        std::regex( options.filter );
+    }
+    catch ( std::regex_error const & )
+    {
+        std::cerr << "Error: invalid filter " << options.filter << "\n";
+        return 1;
+    }
+
+    if ( list )
+    {
+        listBenchmarks( std::cout, options.filter );
+        return 0;
+    }
+
+    // Load the baseline first, so a bad file fails before the measurements.
+    Baseline baseline;
+    if ( !baselineFile.empty() && !loadBaseline( baselineFile, baseline ) )
+        return 1;
+
+    printSystemInfo( std::cout, options );
+    std::vector< SuiteResult > results =
+        runBenchmarkSuite( options, std::cout );
+    if ( results.empty() )
+    {
+        std::cerr << "Error: no benchmark matches " << options.filter << "\n";
+        return 1;
+    }
+
+    bool written = true;
+    if ( format == "json" || format == "both" )
+        written = writeSuiteJson( out + ".json", results, options ) && written;
+    if ( format == "csv" || format == "both" )
+        written = writeSuiteCsv( out + ".csv", results, options ) && written;
+    if ( !written )
+        return 1;
+    if ( baselineFile.empty() )
+        return 0;
+
+    std::cout << "\nComparison with " << baselineFile << " (threshold "
+              << comparisonOptions.threshold * 100 << "%, alpha "
+              << comparisonOptions.alpha << "):\n";
+    warnOnSystemMismatch( std::cout, baseline, options );
+    std::vector< BenchmarkComparison > comparisons =
+        compareWithBaseline( results, baseline, comparisonOptions );
+    printComparisons( std::cout, comparisons );
+    if ( !writeComparisonCsv(
+             out + "_comparison.csv", comparisons, comparisonOptions ) )
+        return 1;
+    return hasRegression( comparisons ) ? 2 : 0;
+}
+
+/*----------------------------------------------------------------------------*/
@@ -0,0 +1,233 @@
+#ifndef __CPU_CACHES__COUNT_KERNELS_H__
+#define __CPU_CACHES__COUNT_KERNELS_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "../utils/cpu_features.h"
+
+#include <cstddef>
+#include <vector>
+
+#if defined( PERF_ARCH_X86 )
+#include <immintrin.h>
+#elif defined( PERF_ARCH_ARM64 )
+#include <arm_neon.h>
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Threshold counting kernels: count the elements of data[0, count) that are
+greater than threshold.
+
+Each vector kernel compares a full register against the threshold and then
+either subtracts the all-ones lane masks from a lane accumulator (SSE2, AVX2,
+NEON) or popcounts the comparison mask (AVX-512). Per-lane accumulators are
+32-bit, which is plenty for a single matrix row.
+
+Kernels are compiled with per-function target attributes, so the binary does
+not need -mavx2 and the choice is made at runtime from cpuFeatures().
+*/
+using RowCountFunc = long long (*)( const int *, std::size_t, int );
+
+/*----------------------------------------------------------------------------*/
+
+// Scalar reference. Vectorization is disabled so this really is one compare
+// per element; the plain countWithLocalCounter loop shows what the compiler
+// does on its own.
+#if defined( __clang__ )
+inline long long
+countAboveScalar ( const int * data, std::size_t count, int threshold )
+{
+    long long result = 0;
+    _Pragma( "clang loop vectorize(disable) interleave(disable)" )
+    for ( std::size_t i = 0; i < count; ++i )
+    {
+        if ( data[ i ] > threshold )
+            ++result;
+    }
+    return result;
+}
+#else
+__attribute__(( optimize( "no-tree-vectorize" ) ))
+inline long long
+countAboveScalar ( const int * data, std::size_t count, int threshold )
+{
+    long long result = 0;
+    for ( std::size_t i = 0; i < count; ++i )
+    {
+        if ( data[ i ] > threshold )
+            ++result;
+    }
+    return result;
+}
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+#if defined( PERF_ARCH_X86 )
+
+__attribute__(( target( "sse2" ) ))
+inline long long
+countAboveSse2 ( const int * data, std::size_t count, int threshold )
+{
+    const __m128i limit = _mm_set1_epi32( threshold );
+    __m128i acc = _mm_setzero_si128();
+
+    std::size_t i = 0;
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        __m128i v = _mm_loadu_si128(
+            reinterpret_cast< const __m128i * >( data + i )
+        );
+        // Lanes above the threshold are -1, subtracting adds one.
+        acc = _mm_sub_epi32( acc, _mm_cmpgt_epi32( v, limit ) );
+    }
+
+    alignas( 16 ) int lanes[ 4 ];
+    _mm_store_si128( reinterpret_cast< __m128i * >( lanes ), acc );
+    long long result = 0;
+    for ( int lane : lanes )
+        result += static_cast< unsigned >( lane );
+
+    for ( ; i < count; ++i )
+        result += data[ i ] > threshold;
+    return result;
+}
+
+__attribute__(( target( "avx2" ) ))
+inline long long
+countAboveAvx2 ( const int * data, std::size_t count, int threshold )
+{
+    const __m256i limit = _mm256_set1_epi32( threshold );
+    // Two accumulators to hide the latency of the dependent subtraction.
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+
+    std::size_t i = 0;
+    for ( ; i + 16 <= count; i += 16 )
+    {
+        __m256i v0 = _mm256_loadu_si256(
+            reinterpret_cast< const __m256i * >( data + i )
+        );
+        __m256i v1 = _mm256_loadu_si256(
+            reinterpret_cast< const __m256i * >( data + i + 8 )
+        );
+        acc0 = _mm256_sub_epi32( acc0, _mm256_cmpgt_epi32( v0, limit ) );
+        acc1 = _mm256_sub_epi32( acc1, _mm256_cmpgt_epi32( v1, limit ) );
+    }
+    for ( ; i + 8 <= count; i += 8 )
+    {
+        __m256i v = _mm256_loadu_si256(
+            reinterpret_cast< const __m256i * >( data + i )
+        );
+        acc0 = _mm256_sub_epi32( acc0, _mm256_cmpgt_epi32( v, limit ) );
+    }
+
+    alignas( 32 ) int lanes[ 8 ];
+    _mm256_store_si256(
+        reinterpret_cast< __m256i * >( lanes ), _mm256_add_epi32( acc0, acc1 )
+    );
+    long long result = 0;
+    for ( int lane : lanes )
+        result += static_cast< unsigned >( lane );
+
+    for ( ; i < count; ++i )
+        result += data[ i ] > threshold;
+    return result;
+}
+
+__attribute__(( target( "avx512f,popcnt" ) ))
+inline long long
+countAboveAvx512 ( const int * data, std::size_t count, int threshold )
+{
+    const __m512i limit = _mm512_set1_epi32( threshold );
+    long long result = 0;
+
+    std::size_t i = 0;
+    for ( ; i + 16 <= count; i += 16 )
+    {
+        __m512i v = _mm512_loadu_si512( data + i );
+        __mmask16 mask = _mm512_cmpgt_epi32_mask( v, limit );
+        result += _mm_popcnt_u32( mask );
+    }
+    if ( i < count )
+    {
+        // The tail is handled with a masked load instead of a scalar loop.
+        __mmask16 tail =
+            static_cast< __mmask16 >( ( 1u << ( count - i ) ) - 1 );
+        __m512i v = _mm512_maskz_loadu_epi32( tail, data + i );
+        __mmask16 mask = _mm512_mask_cmpgt_epi32_mask( tail, v, limit );
+        result += _mm_popcnt_u32( mask );
+    }
+    return result;
+}
+
+#endif // PERF_ARCH_X86
+
+/*----------------------------------------------------------------------------*/
+
+#if defined( PERF_ARCH_ARM64 )
+
+inline long long
+countAboveNeon ( const int * data, std::size_t count, int threshold )
+{
+    const int32x4_t limit = vdupq_n_s32( threshold );
+    uint32x4_t acc0 = vdupq_n_u32( 0 );
+    uint32x4_t acc1 = vdupq_n_u32( 0 );
+
+    std::size_t i = 0;
+    for ( ; i + 8 <= count; i += 8 )
+    {
+        int32x4_t v0 = vld1q_s32( data + i );
+        int32x4_t v1 = vld1q_s32( data + i + 4 );
+        // Lanes above the threshold are all ones, subtracting adds one.
+        acc0 = vsubq_u32( acc0, vcgtq_s32( v0, limit ) );
+        acc1 = vsubq_u32( acc1, vcgtq_s32( v1, limit ) );
+    }
+
+    long long result = vaddlvq_u32( vaddq_u32( acc0, acc1 ) );
+    for ( ; i < count; ++i )
+        result += data[ i ] > threshold;
+    return result;
+}
+
+#endif // PERF_ARCH_ARM64
+
+/*----------------------------------------------------------------------------*/
+
+struct CountKernel
+{
+    const char * name;
+    RowCountFunc func;
+};
+
+// All kernels the running CPU can execute, from the narrowest to the widest.
+inline std::vector< CountKernel > availableCountKernels ()
+{
+    CpuFeatures const & features = cpuFeatures();
+    std::vector< CountKernel > kernels{ { "Scalar", countAboveScalar } };
+#if defined( PERF_ARCH_X86 )
+    if ( features.sse2 )
+        kernels.push_back( { "SSE2", countAboveSse2 } );
+    if ( features.avx2 )
+        kernels.push_back( { "AVX2", countAboveAvx2 } );
+    if ( features.avx512f && features.popcnt )
+        kernels.push_back( { "AVX512", countAboveAvx512 } );
+#elif defined( PERF_ARCH_ARM64 )
+    if ( features.neon )
+        kernels.push_back( { "NEON", countAboveNeon } );
+#endif
+    (void)features;
+    return kernels;
+}
+
+// The widest kernel the running CPU supports.
+inline CountKernel bestCountKernel ()
+{
+    return availableCountKernels().back();
+}
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __CPU_CACHES__COUNT_KERNELS_H__
@@ -0,0 +1,312 @@
+#ifndef __CPU_CACHES__HASH_TABLES_H__
+#define __CPU_CACHES__HASH_TABLES_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "../utils/cache.h"
+#include "../utils/cpu_features.h"
+#include "../utils/page_allocator.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#if defined( PERF_ARCH_X86 ) && defined( __SSE2__ )
+#include <emmintrin.h>
+#elif defined( PERF_ARCH_ARM64 )
+#include <arm_neon.h>
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Hash sets of integer keys for the point-lookup benchmarks, built once from a
+vector of distinct keys. Like FlatMap in ordered_sets.h, find( key ) returns
+a pointer to the stored key, nullptr if it is absent, and memoryBytes() the
+heap footprint of the table.
+
+- LinearProbingSet: open addressing in one array of keys, load factor at
+  most 1/2; a lookup walks consecutive slots until the key or an empty one.
+- SwissTable:       keys in groups of 16 slots with one control byte each,
+  7 hash bits per used slot; a lookup compares all 16 control bytes of a
+  group at once and only touches the slots whose bits match. Load factor at
+  most 7/8.
+
+Both hash with mixHash, which scatters consecutive keys over the table.
+*/
+
+// Finalizer of MurmurHash3: every input bit affects every output bit.
+inline std::uint64_t mixHash ( std::uint64_t x )
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+namespace hash_detail
+{
+
+inline std::size_t nextPowerOfTwo ( std::size_t n )
+{
+    std::size_t p = 1;
+    while ( p < n )
+        p *= 2;
+    return p;
+}
+
+// Cache-line-aligned, uninitialized array, on the pages selected for the run
+// (see utils/page_allocator.h).
+template < typename _T >
+using AlignedArray = PageArray< _T >;
+
+} // namespace hash_detail
+
+/*----------------------------------------------------------------------------*/
+
+// Keys must differ from std::numeric_limits< _KeyT >::max(), which marks the
+// empty slots.
+template < typename _KeyT >
+class LinearProbingSet
+{
+    static_assert( std::is_integral_v< _KeyT >, "integer keys only" );
+
+public:
+
+    static constexpr _KeyT EMPTY = std::numeric_limits< _KeyT >::max();
+
+    template < typename _AllocT >
+    explicit LinearProbingSet ( std::vector< _KeyT, _AllocT > const & keys )
+        :   m_capacity(
+                hash_detail::nextPowerOfTwo( std::max< std::size_t >(
+                    2 * keys.size(), 16
+                ) )
+            )
+        ,   m_slots( m_capacity )
+    {
+        std::fill( m_slots.data(), m_slots.data() + m_capacity, EMPTY );
+        for ( _KeyT key : keys )
+        {
+            std::size_t i = slotOf( key );
+            while ( m_slots[ i ] != EMPTY && m_slots[ i ] != key )
+                i = ( i + 1 ) & ( m_capacity - 1 );
+            m_size += m_slots[ i ] == EMPTY;
+            m_slots[ i ] = key;
+        }
+    }
+
+    const _KeyT * find ( _KeyT key ) const
+    {
+        std::size_t i = slotOf( key );
+        while ( true )
+        {
+            const _KeyT slot = m_slots[ i ];
+            if ( slot == key )
+                return &m_slots[ i ];
+            if ( slot == EMPTY )
+                return nullptr;
+            i = ( i + 1 ) & ( m_capacity - 1 );
+        }
+    }
+
+    std::size_t size () const { return m_size; }
+
+    std::size_t memoryBytes () const { return m_capacity * sizeof( _KeyT ); }
+
+private:
+
+    std::size_t slotOf ( _KeyT key ) const
+    {
+        return mixHash( static_cast< std::uint64_t >( key ) )
+            & ( m_capacity - 1 );
+    }
+
+    std::size_t m_capacity;
+    std::size_t m_size = 0;
+    hash_detail::AlignedArray< _KeyT > m_slots;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Group probing. A control byte is EMPTY (0x80) or the low 7 bits of the hash
+of the key in its slot (top bit clear). match() returns a mask of the bytes
+of a 16-byte group equal to a value, with MASK_STRIDE bits per byte, lowest
+first.
+
+SSE2 and NEON are part of the x86-64 and AArch64 baselines, so unlike the
+STree kernels the group match is chosen at compile time. SwissGroupScalar is
+the fallback elsewhere, and can be selected explicitly for comparison.
+*/
+constexpr std::size_t SWISS_GROUP_SIZE = 16;
+
+namespace hash_detail
+{
+
+constexpr std::uint8_t CONTROL_EMPTY = 0x80;
+
+struct SwissGroupScalar
+{
+    static constexpr int MASK_STRIDE = 1;
+
+    static std::uint64_t match ( const std::uint8_t * group, std::uint8_t v )
+    {
+        std::uint64_t mask = 0;
+        for ( std::size_t j = 0; j < SWISS_GROUP_SIZE; ++j )
+            mask |= std::uint64_t{ group[ j ] == v } << j;
+        return mask;
+    }
+};
+
+#if defined( PERF_ARCH_X86 ) && defined( __SSE2__ )
+
+struct SwissGroupSse2
+{
+    static constexpr int MASK_STRIDE = 1;
+
+    static std::uint64_t match ( const std::uint8_t * group, std::uint8_t v )
+    {
+        __m128i controls =
+            _mm_load_si128( reinterpret_cast< const __m128i * >( group ) );
+        __m128i hits = _mm_cmpeq_epi8(
+            controls, _mm_set1_epi8( static_cast< char >( v ) )
+        );
+        return static_cast< std::uint32_t >( _mm_movemask_epi8( hits ) );
+    }
+};
+
+using SwissGroupBest = SwissGroupSse2;
+
+#elif defined( PERF_ARCH_ARM64 )
+
+struct SwissGroupNeon
+{
+    // NEON has no movemask: narrowing the 16 compare bytes by 4 bits leaves
+    // one nibble per byte in a 64-bit lane.
+    static constexpr int MASK_STRIDE = 4;
+
+    static std::uint64_t match ( const std::uint8_t * group, std::uint8_t v )
+    {
+        uint8x16_t hits = vceqq_u8( vld1q_u8( group ), vdupq_n_u8( v ) );
+        uint8x8_t nibbles = vshrn_n_u16( vreinterpretq_u16_u8( hits ), 4 );
+        return vget_lane_u64( vreinterpret_u64_u8( nibbles ), 0 )
+            & 0x1111111111111111ULL;
+    }
+};
+
+using SwissGroupBest = SwissGroupNeon;
+
+#else
+
+using SwissGroupBest = SwissGroupScalar;
+
+#endif
+
+} // namespace hash_detail
+
+// Keys may take any value.
+template < typename _KeyT, typename _GroupT = hash_detail::SwissGroupBest >
+class SwissTable
+{
+    static_assert( std::is_integral_v< _KeyT >, "integer keys only" );
+
+public:
+
+    template < typename _AllocT >
+    explicit SwissTable ( std::vector< _KeyT, _AllocT > const & keys )
+        :   m_groups( hash_detail::nextPowerOfTwo( std::max< std::size_t >(
+                ( keys.size() * 8 / 7 + SWISS_GROUP_SIZE ) / SWISS_GROUP_SIZE,
+                1
+            ) ) )
+        ,   m_controls( m_groups * SWISS_GROUP_SIZE )
+        ,   m_slots( m_groups * SWISS_GROUP_SIZE )
+    {
+        std::memset(
+            m_controls.data(), hash_detail::CONTROL_EMPTY,
+            m_groups * SWISS_GROUP_SIZE
+        );
+        for ( _KeyT key : keys )
+        {
+            if ( !find( key ) )
+                insertNew( key );
+        }
+    }
+
+    const _KeyT * find ( _KeyT key ) const
+    {
+        const std::uint64_t hash = hashOf( key );
+        const std::uint8_t tag = hash & 0x7f;
+        std::size_t g = ( hash >> 7 ) & ( m_groups - 1 );
+        // Triangular probing visits every group once for a power-of-two
+        // group count.
+        for ( std::size_t step = 1; ; ++step )
+        {
+            const std::uint8_t * group =
+                m_controls.data() + g * SWISS_GROUP_SIZE;
+            const _KeyT * slots = m_slots.data() + g * SWISS_GROUP_SIZE;
+            for ( std::uint64_t mask = _GroupT::match( group, tag ); mask;
+                  mask &= mask - 1 )
+            {
+                std::size_t j = __builtin_ctzll( mask ) / _GroupT::MASK_STRIDE;
+                if ( slots[ j ] == key )
+                    return slots + j;
+            }
+            if ( _GroupT::match( group, hash_detail::CONTROL_EMPTY ) )
+                return nullptr;
+            g = ( g + step ) & ( m_groups - 1 );
+        }
+    }
+
+    std::size_t size () const { return m_size; }
+
+    std::size_t memoryBytes () const
+    {
+        return m_groups * SWISS_GROUP_SIZE * ( 1 + sizeof( _KeyT ) );
+    }
+
+private:
+
+    static std::uint64_t hashOf ( _KeyT key )
+    {
+        return mixHash( static_cast< std::uint64_t >( key ) );
+    }
+
+    void insertNew ( _KeyT key )
+    {
+        const std::uint64_t hash = hashOf( key );
+        std::size_t g = ( hash >> 7 ) & ( m_groups - 1 );
+        for ( std::size_t step = 1; ; ++step )
+        {
+            std::uint8_t * group = m_controls.data() + g * SWISS_GROUP_SIZE;
+            std::uint64_t empty =
+                _GroupT::match( group, hash_detail::CONTROL_EMPTY );
+            if ( empty )
+            {
+                std::size_t j =
+                    __builtin_ctzll( empty ) / _GroupT::MASK_STRIDE;
+                group[ j ] = hash & 0x7f;
+                m_slots[ g * SWISS_GROUP_SIZE + j ] = key;
+                ++m_size;
+                return;
+            }
+            g = ( g + step ) & ( m_groups - 1 );
+        }
+    }
+
+    std::size_t m_groups;
+    std::size_t m_size = 0;
+    hash_detail::AlignedArray< std::uint8_t > m_controls;
+    hash_detail::AlignedArray< _KeyT > m_slots;
+};
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __CPU_CACHES__HASH_TABLES_H__
@@ -0,0 +1,176 @@
+#ifndef __CPU_CACHES__INCREMENTAL_COUNTER_H__
+#define __CPU_CACHES__INCREMENTAL_COUNTER_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "../utils/work_stealing.h"
+#include "count_kernels.h"
+#include "matrix.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Incremental threshold count of a matrix that changes in small regions.
+
+The matrix is cut into tiles of tileRows x tileCols elements, and the count
+of every tile is kept next to the total. After a change the caller marks the
+touched rectangle with markDirty; update() then recounts only the tiles
+marked since the last update and corrects the total by the difference of
+their old and new counts. The cost of an update is proportional to the
+dirty area, rounded up to whole tiles, instead of to the matrix.
+
+The counter does not watch the matrix: a change that is not marked is not
+seen. markAllDirty() (the state after construction) makes the next update a
+full count. The dirty tiles are dealt in contiguous blocks to numThreads
+executor tasks; every tile is recounted by exactly one task, so the tile
+counts need no synchronization, only the per-task differences are summed
+atomically. Tile rows are counted with a kernel from count_kernels.h.
+*/
+class IncrementalCounter
+{
+
+public:
+
+    IncrementalCounter (
+            int rows
+        ,   int cols
+        ,   int tileRows
+        ,   int tileCols
+        ,   int threshold
+        ,   RowCountFunc kernel = countAboveScalar
+    )
+        :   m_rows( rows )
+        ,   m_cols( cols )
+        ,   m_tileRows( std::max( 1, tileRows ) )
+        ,   m_tileCols( std::max( 1, tileCols ) )
+        ,   m_tilesDown( ( rows + m_tileRows - 1 ) / m_tileRows )
+        ,   m_tilesAcross( ( cols + m_tileCols - 1 ) / m_tileCols )
+        ,   m_threshold( threshold )
+        ,   m_kernel( kernel )
+        ,   m_tileCounts( static_cast< std::size_t >( numTiles() ), 0 )
+        ,   m_dirty( static_cast< std::size_t >( numTiles() ), 0 )
+    {
+        markAllDirty();
+    }
+
+    int numTiles () const { return m_tilesDown * m_tilesAcross; }
+    int tileRows () const { return m_tileRows; }
+    int tileCols () const { return m_tileCols; }
+    int tilesAcross () const { return m_tilesAcross; }
+    int dirtyTiles () const { return static_cast< int >( m_dirtyList.size() ); }
+
+    // Total as of the last update.
+    long long count () const { return m_total; }
+
+    // Mark the tiles overlapping rows x cols, clipped to the matrix.
+    void markDirty ( IndexRange rows, IndexRange cols )
+    {
+        const int firstRow = std::max( rows.begin, 0 );
+        const int lastRow = std::min( rows.end, m_rows );
+        const int firstCol = std::max( cols.begin, 0 );
+        const int lastCol = std::min( cols.end, m_cols );
+        if ( firstRow >= lastRow || firstCol >= lastCol )
+            return;
+        for ( int ty = firstRow / m_tileRows;
+              ty <= ( lastRow - 1 ) / m_tileRows; ++ty )
+        {
+            for ( int tx = firstCol / m_tileCols;
+                  tx <= ( lastCol - 1 ) / m_tileCols; ++tx )
+                markTile( ty * m_tilesAcross + tx );
+        }
+    }
+
+    void markAllDirty ()
+    {
+        for ( int tile = 0; tile < numTiles(); ++tile )
+            markTile( tile );
+    }
+
+    // Recount the dirty tiles and return the corrected total.
+    template < typename _MatrixT, typename _ExecutorT >
+    long long update (
+        const _MatrixT & matrix, int numThreads, _ExecutorT & executor
+    )
+    {
+        const int dirty = dirtyTiles();
+        if ( dirty == 0 )
+            return m_total;
+
+        // Do not wake more tasks than there are tiles.
+        const int tasks = std::max( 1, std::min( numThreads, dirty ) );
+        const int chunkSize = ( dirty + tasks - 1 ) / tasks;
+        std::atomic< long long > delta( 0 );
+        executor.run( tasks, [ & ] ( int t )
+        {
+            const int first = t * chunkSize;
+            const int last = std::min( first + chunkSize, dirty );
+            long long localDelta = 0;
+            for ( int k = first; k < last; ++k )
+            {
+                const int tile = m_dirtyList[ k ];
+                const long long tileCount = countTile( matrix, tile );
+                localDelta += tileCount - m_tileCounts[ tile ];
+                m_tileCounts[ tile ] = tileCount;
+            }
+            delta.fetch_add( localDelta, std::memory_order_relaxed );
+        } );
+
+        m_total += delta.load();
+        for ( int tile : m_dirtyList )
+            m_dirty[ tile ] = 0;
+        m_dirtyList.clear();
+        return m_total;
+    }
+
+private:
+
+    void markTile ( int tile )
+    {
+        if ( m_dirty[ tile ] )
+            return;
+        m_dirty[ tile ] = 1;
+        m_dirtyList.push_back( tile );
+    }
+
+    template < typename _MatrixT >
+    long long countTile ( const _MatrixT & matrix, int tile ) const
+    {
+        const int firstRow = tile / m_tilesAcross * m_tileRows;
+        const int firstCol = tile % m_tilesAcross * m_tileCols;
+        const int lastRow = std::min( firstRow + m_tileRows, m_rows );
+        const std::size_t width = static_cast< std::size_t >(
+            std::min( firstCol + m_tileCols, m_cols ) - firstCol
+        );
+        long long tileCount = 0;
+        for ( int i = firstRow; i < lastRow; ++i )
+        {
+            tileCount += m_kernel(
+                rowData( matrix, i ) + firstCol, width, m_threshold
+            );
+        }
+        return tileCount;
+    }
+
+    int m_rows;
+    int m_cols;
+    int m_tileRows;
+    int m_tileCols;
+    int m_tilesDown;
+    int m_tilesAcross;
+    int m_threshold;
+    RowCountFunc m_kernel;
+    long long m_total = 0;
+    std::vector< long long > m_tileCounts;
+    std::vector< std::uint8_t > m_dirty;
+    std::vector< int > m_dirtyList;
+};
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __CPU_CACHES__INCREMENTAL_COUNTER_H__
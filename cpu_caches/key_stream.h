@@ -0,0 +1,244 @@
+#ifndef __CPU_CACHES__KEY_STREAM_H__
+#define __CPU_CACHES__KEY_STREAM_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Precomputed streams of lookup keys for the search benchmarks.
+
+A stream is drawn from the sorted keys of the searched structure before the
+timed region, so generating it costs nothing during measurement:
+- Uniform:    every key equally likely, all hits.
+- Zipf:       key ranks follow a Zipf law (skew `zipfSkew`, 0.99 by default);
+              the ranks are scattered over the key range by a fixed random
+              permutation, so the hot keys are not all at the front.
+- Sequential: evenly spaced keys in ascending order, covering the whole range
+              (wrapping around if the stream is longer than the keys).
+- HitRatio:   a uniform hit with probability `hitRatio`, otherwise a key that
+              is not stored (drawn past the largest key).
+- Position:   always the key at relative position `position` of the sorted
+              keys: 0 is the smallest, 1 (the default) the largest.
+- Miss:       only keys that are not stored, drawn past the largest key.
+- HotSet:     a hit in a hot set of `hotFraction` of the keys, scattered like
+              the Zipf ranks, with probability `hotProbability`, otherwise a
+              uniform hit among all keys.
+*/
+enum class KeyDistribution
+{
+        Uniform
+    ,   Zipf
+    ,   Sequential
+    ,   HitRatio
+    ,   Position
+    ,   Miss
+    ,   HotSet
+};
+
+inline const char * keyDistributionName ( KeyDistribution distribution )
+{
+    switch ( distribution )
+    {
+        case KeyDistribution::Uniform:      return "Uniform";
+        case KeyDistribution::Zipf:         return "Zipf";
+        case KeyDistribution::Sequential:   return "Sequential";
+        case KeyDistribution::HitRatio:     return "HitRatio";
+        case KeyDistribution::Position:     return "Position";
+        case KeyDistribution::Miss:         return "Miss";
+        case KeyDistribution::HotSet:       return "HotSet";
+    }
+    return "";
+}
+
+// Parse "uniform", "zipf", "sequential", "hits", "position", "miss" or
+// "hotset"; false if unknown.
+inline bool parseKeyDistribution (
+    std::string const & name, KeyDistribution & distribution
+)
+{
+    if ( name == "uniform" )
+        distribution = KeyDistribution::Uniform;
+    else if ( name == "zipf" )
+        distribution = KeyDistribution::Zipf;
+    else if ( name == "sequential" )
+        distribution = KeyDistribution::Sequential;
+    else if ( name == "hits" )
+        distribution = KeyDistribution::HitRatio;
+    else if ( name == "position" )
+        distribution = KeyDistribution::Position;
+    else if ( name == "miss" )
+        distribution = KeyDistribution::Miss;
+    else if ( name == "hotset" )
+        distribution = KeyDistribution::HotSet;
+    else
+        return false;
+    return true;
+}
+
+struct KeyStreamOptions
+{
+    KeyDistribution distribution = KeyDistribution::Uniform;
+    double hitRatio = 0.5;
+    double zipfSkew = 0.99;
+    double position = 1.0;
+    double hotFraction = 0.01;
+    double hotProbability = 0.9;
+    std::uint64_t seed = 12345;
+};
+
+// Name of the distribution with the parameters it uses, e.g. "Zipf(0.99)" or
+// "HotSet(0.01:0.9)"; written to the CSVs, so it contains no commas.
+inline std::string keyStreamDescription ( KeyStreamOptions const & options )
+{
+    std::ostringstream description;
+    description << keyDistributionName( options.distribution );
+    switch ( options.distribution )
+    {
+        case KeyDistribution::Zipf:
+            description << "(" << options.zipfSkew << ")";
+            break;
+        case KeyDistribution::HitRatio:
+            description << "(" << options.hitRatio << ")";
+            break;
+        case KeyDistribution::Position:
+            description << "(" << options.position << ")";
+            break;
+        case KeyDistribution::HotSet:
+            description << "(" << options.hotFraction << ":"
+                        << options.hotProbability << ")";
+            break;
+        default:
+            break;
+    }
+    return description.str();
+}
+
+/*----------------------------------------------------------------------------*/
+
+// `count` keys drawn from the sorted, non-empty `keys`, in a vector with the
+// same allocator.
+template < typename _KeyT, typename _AllocT >
+std::vector< _KeyT, _AllocT > generateKeyStream (
+    std::vector< _KeyT, _AllocT > const & keys,
+    std::size_t count,
+    KeyStreamOptions const & options
+)
+{
+    const std::size_t n = keys.size();
+    std::mt19937_64 rng( options.seed );
+    std::uniform_int_distribution< std::size_t > anyIndex( 0, n - 1 );
+    // A key that is not stored.
+    auto miss = [ & ] ()
+    {
+        return keys.back() + 1 + static_cast< _KeyT >( anyIndex( rng ) );
+    };
+
+    std::vector< _KeyT, _AllocT > stream( keys.get_allocator() );
+    stream.reserve( count );
+    switch ( options.distribution )
+    {
+        case KeyDistribution::Uniform:
+            for ( std::size_t i = 0; i < count; ++i )
+                stream.push_back( keys[ anyIndex( rng ) ] );
+            break;
+
+        case KeyDistribution::Zipf:
+        {
+            // Cumulative weights of ranks 1..n, sampled by binary search.
+            std::vector< double > cdf( n );
+            double total = 0.0;
+            for ( std::size_t r = 0; r < n; ++r )
+            {
+                total += 1.0 / std::pow( r + 1.0, options.zipfSkew );
+                cdf[ r ] = total;
+            }
+            std::vector< std::size_t > position( n );
+            std::iota( position.begin(), position.end(), std::size_t{ 0 } );
+            std::shuffle( position.begin(), position.end(), rng );
+
+            std::uniform_real_distribution< double > uniform( 0.0, total );
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                auto it =
+                    std::lower_bound( cdf.begin(), cdf.end(), uniform( rng ) );
+                std::size_t rank =
+                    std::min< std::size_t >( it - cdf.begin(), n - 1 );
+                stream.push_back( keys[ position[ rank ] ] );
+            }
+            break;
+        }
+
+        case KeyDistribution::Sequential:
+        {
+            const std::size_t stride = std::max< std::size_t >( n / count, 1 );
+            for ( std::size_t i = 0; i < count; ++i )
+                stream.push_back( keys[ i * stride % n ] );
+            break;
+        }
+
+        case KeyDistribution::HitRatio:
+        {
+            std::bernoulli_distribution hit( options.hitRatio );
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                stream.push_back(
+                    hit( rng ) ? keys[ anyIndex( rng ) ] : miss()
+                );
+            }
+            break;
+        }
+
+        case KeyDistribution::Position:
+        {
+            const double position = std::clamp( options.position, 0.0, 1.0 );
+            const std::size_t index = static_cast< std::size_t >(
+                std::llround( position * ( n - 1 ) )
+            );
+            stream.assign( count, keys[ index ] );
+            break;
+        }
+
+        case KeyDistribution::Miss:
+            for ( std::size_t i = 0; i < count; ++i )
+                stream.push_back( miss() );
+            break;
+
+        case KeyDistribution::HotSet:
+        {
+            std::vector< std::size_t > position( n );
+            std::iota( position.begin(), position.end(), std::size_t{ 0 } );
+            std::shuffle( position.begin(), position.end(), rng );
+            const std::size_t hotCount = std::clamp< std::size_t >(
+                static_cast< std::size_t >( options.hotFraction * n ), 1, n
+            );
+            std::uniform_int_distribution< std::size_t > hotIndex(
+                0, hotCount - 1
+            );
+            std::bernoulli_distribution hot( options.hotProbability );
+            for ( std::size_t i = 0; i < count; ++i )
+            {
+                stream.push_back( hot( rng )
+                    ? keys[ position[ hotIndex( rng ) ] ]
+                    : keys[ anyIndex( rng ) ]
+                );
+            }
+            break;
+        }
+    }
+    return stream;
+}
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __CPU_CACHES__KEY_STREAM_H__
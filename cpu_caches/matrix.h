@@ -0,0 +1,219 @@
+#ifndef __CPU_CACHES__MATRIX_H__
+#define __CPU_CACHES__MATRIX_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "../utils/cache.h"
+#include "../utils/page_allocator.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <random>
+#include <vector>
+
+/*----------------------------------------------------------------------------*/
+
+// Nested layout: every row is a separate heap allocation.
+using Matrix = std::vector< std::vector< int > >;
+
+/*----------------------------------------------------------------------------*/
+
+enum class RowPadding
+{
+        None        // Rows are packed back to back.
+    ,   CacheLine   // Every row starts on its own cache line.
+};
+
+/*
+Flat layout: a single cache-line-aligned buffer holding all rows.
+
+Row i starts at data() + i * stride(). Without padding stride() == cols(), with
+RowPadding::CacheLine the stride is rounded up to a whole number of cache lines.
+The buffer is left uninitialized, so the pages are first touched by whoever
+fills the matrix (see generateMatrix/generateRandomMatrix). It lives on the
+pages selected for the run (see utils/page_allocator.h).
+*/
+class FlatMatrix
+{
+
+public:
+
+    FlatMatrix ( int rows, int cols, RowPadding padding = RowPadding::None )
+        :   m_rows( rows )
+        ,   m_cols( cols )
+        ,   m_stride( computeStride( cols, padding ) )
+        ,   m_data( static_cast< std::size_t >( rows ) * m_stride )
+    {
+    }
+
+    int rows () const { return m_rows; }
+    int cols () const { return m_cols; }
+    std::size_t stride () const { return m_stride; }
+
+    int * data () { return m_data.data(); }
+    const int * data () const { return m_data.data(); }
+
+    int * row ( int i ) { return m_data.data() + i * m_stride; }
+    const int * row ( int i ) const { return m_data.data() + i * m_stride; }
+
+    int & operator () ( int i, int j ) { return row( i )[ j ]; }
+    int operator () ( int i, int j ) const { return row( i )[ j ]; }
+
+private:
+
+    static std::size_t computeStride ( int cols, RowPadding padding )
+    {
+        std::size_t stride = static_cast< std::size_t >( cols );
+        if ( padding == RowPadding::CacheLine )
+        {
+            constexpr std::size_t perLine = CACHE_LINE_SIZE / sizeof( int );
+            stride = ( stride + perLine - 1 ) / perLine * perLine;
+        }
+        return stride;
+    }
+
+    int m_rows;
+    int m_cols;
+    std::size_t m_stride;
+    PageArray< int > m_data;
+};
+
+/*----------------------------------------------------------------------------*/
+
+// Uniform row access, so the counting kernels work with every layout.
+
+inline int numRows ( const Matrix & matrix )
+{
+    return static_cast< int >( matrix.size() );
+}
+
+inline int numCols ( const Matrix & matrix )
+{
+    return matrix.empty() ? 0 : static_cast< int >( matrix[ 0 ].size() );
+}
+
+inline const int * rowData ( const Matrix & matrix, int i )
+{
+    return matrix[ i ].data();
+}
+
+inline int * rowData ( Matrix & matrix, int i )
+{
+    return matrix[ i ].data();
+}
+
+inline int numRows ( const FlatMatrix & matrix ) { return matrix.rows(); }
+
+inline int numCols ( const FlatMatrix & matrix ) { return matrix.cols(); }
+
+inline const int * rowData ( const FlatMatrix & matrix, int i )
+{
+    return matrix.row( i );
+}
+
+inline int * rowData ( FlatMatrix & matrix, int i )
+{
+    return matrix.row( i );
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Read-only window onto rows stored elsewhere (a FlatMatrix, a tile of a
+// memory-mapped file, ...). Row i starts at data + i * stride.
+struct MatrixView
+{
+    const int * data;
+    int rows;
+    int cols;
+    std::size_t stride;
+};
+
+inline MatrixView makeView ( const FlatMatrix & matrix )
+{
+    return { matrix.data(), matrix.rows(), matrix.cols(), matrix.stride() };
+}
+
+inline int numRows ( const MatrixView & view ) { return view.rows; }
+
+inline int numCols ( const MatrixView & view ) { return view.cols; }
+
+inline const int * rowData ( const MatrixView & view, int i )
+{
+    return view.data + i * view.stride;
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Allocate a rows x cols matrix of the requested layout. Padding only applies
+// to the flat layout.
+template < typename _MatrixT >
+_MatrixT allocateMatrix ( int rows, int cols, RowPadding padding );
+
+template <>
+inline Matrix allocateMatrix< Matrix > ( int rows, int cols, RowPadding )
+{
+    return Matrix( rows, std::vector< int >( cols, 0 ) );
+}
+
+template <>
+inline FlatMatrix
+allocateMatrix< FlatMatrix > ( int rows, int cols, RowPadding padding )
+{
+    return FlatMatrix( rows, cols, padding );
+}
+
+/*----------------------------------------------------------------------------*/
+
+template < typename _MatrixT = Matrix >
+_MatrixT generateMatrix (
+    int rows, int cols, RowPadding padding = RowPadding::None
+)
+{
+    _MatrixT matrix = allocateMatrix< _MatrixT >( rows, cols, padding );
+    for ( int i = 0; i < rows; ++i )
+    {
+        std::fill_n( rowData( matrix, i ), cols, 150 );
+    }
+    return matrix;
+}
+
+inline std::unique_ptr< Matrix > generateMatrixOnHeap ( int rows, int cols )
+{
+    auto pMatrix = std::make_unique<Matrix>(rows, std::vector<int>(cols, 0));
+    for ( int i = 0; i < rows; ++i )
+    {
+        for ( int j = 0; j < cols; ++j )
+        {
+            // matrix[i][j] = ((i + j) * 100) % 256;
+            (*pMatrix)[i][j] = ( i % 2 == 1 && j % 2 == 1 ) ? 150 : 100;
+        }
+    }
+    return pMatrix;
+}
+
+template < typename _MatrixT = Matrix >
+_MatrixT generateRandomMatrix (
+    int rows, int cols, RowPadding padding = RowPadding::None
+)
+{
+    _MatrixT matrix = allocateMatrix< _MatrixT >( rows, cols, padding );
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<> dist(0, 255);
+
+    for (int i = 0; i < rows; ++i)
+    {
+        int * row = rowData( matrix, i );
+        for (int j = 0; j < cols; ++j)
+        {
+            row[j] = dist(gen);
+        }
+    }
+    return matrix;
+}
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __CPU_CACHES__MATRIX_H__
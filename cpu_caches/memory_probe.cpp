@@ -0,0 +1,578 @@
+#include "../utils/benchmark.hpp"
+#include "../utils/cache.h"
+#include "../utils/thread_pool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Memory probe: measures the cache sizes and the memory bandwidth of the
+running machine, to calibrate the other benchmarks.
+
+- Latency: a pointer chase over a random cycle of cache lines, for working
+  sets from 4 KB to --max-mb (default 1 GB). Every load depends on the one
+  before it and the next line cannot be predicted, so the time per load is
+  the load-to-use latency of the level the working set fits in. Written to
+  memory_latency.csv.
+- Bandwidth: the four STREAM kernels (copy, scale, add, triad) over arrays
+  well beyond the last-level cache, for 1 to --threads threads. Written to
+  memory_bandwidth.csv in the parallel_chunks row layout, with a
+  <Kernel>GBps row.
+
+The cache levels are read off the steps of the latency curve and compared
+with the sizes the OS reports (utils/cache.h). The resulting calibration, the
+flushCache eviction buffer size and the search_benchmarks sizes at which the
+keys fill each level, is printed and written to memory_calibration.csv.
+Programs run from the same directory read it back (calibratedCacheSizes()
+in utils/cache.h): flushCache sizes its buffer after the calibrated
+last-level cache and search_benchmarks adds the level sizes to its sizes.
+*/
+
+constexpr std::size_t MIN_WORKING_SET = 4 * 1024;
+constexpr std::size_t DEFAULT_MAX_WORKING_SET_MB = 1024;
+
+// Loads timed per sample, whatever the working set.
+constexpr std::size_t CHASE_LOADS = std::size_t{ 1 } << 22;
+constexpr int CHASE_ITERATIONS = 3;
+
+// A level ends where the latency grows by this factor from one working set
+// to the next, and two levels differ at least this much in capacity.
+constexpr double LEVEL_LATENCY_RATIO = 1.3;
+constexpr double LEVEL_SIZE_RATIO = 4.0;
+constexpr std::size_t MAX_LEVELS = 3;
+
+constexpr int STREAM_ITERATIONS = 10;
+constexpr double STREAM_SCALAR = 3.0;
+// Each STREAM array is at least this many times the last-level cache, and
+// at least the minimum when the cache size is unknown.
+constexpr std::size_t STREAM_LLC_FACTOR = 4;
+constexpr std::size_t STREAM_MIN_ARRAY_BYTES = std::size_t{ 64 } << 20;
+
+// Key type of search_benchmarks, to turn cache sizes into element counts.
+using SearchElementType = long long;
+
+const std::string LATENCY_FILENAME = "memory_latency.csv";
+const std::string BANDWIDTH_FILENAME = "memory_bandwidth.csv";
+// Where flushCache and search_benchmarks look for the calibration.
+const std::string CALIBRATION_FILENAME = cacheCalibrationPath();
+
+/*----------------------------------------------------------------------------*/
+
+// One node per cache line; only the link is used.
+struct alignas( CACHE_LINE_SIZE ) ChaseNode
+{
+    ChaseNode * next;
+};
+
+// Links the nodes into a single random cycle (Sattolo's algorithm), so the
+// chase visits every line of the working set before repeating.
+inline void linkRandomCycle ( std::vector< ChaseNode > & nodes )
+{
+    std::vector< std::size_t > order( nodes.size() );
+    std::iota( order.begin(), order.end(), std::size_t{ 0 } );
+    std::mt19937_64 rng( 12345 );
+    for ( std::size_t i = order.size() - 1; i > 0; --i )
+    {
+        std::uniform_int_distribution< std::size_t > pick( 0, i - 1 );
+        std::swap( order[ i ], order[ pick( rng ) ] );
+    }
+    for ( std::size_t i = 0; i < nodes.size(); ++i )
+        nodes[ i ].next = &nodes[ order[ i ] ];
+}
+
+inline ChaseNode * chase ( ChaseNode * node, std::size_t loads )
+{
+    for ( std::size_t i = 0; i < loads; ++i )
+        node = node->next;
+    return node;
+}
+
+struct LatencyPoint
+{
+    std::size_t bytes;
+    double nsPerLoad;
+};
+
+// Powers of two from MIN_WORKING_SET to maxBytes, and the sizes halfway
+// (in log scale roughly) between them.
+std::vector< std::size_t > workingSetSizes ( std::size_t maxBytes )
+{
+    std::vector< std::size_t > sizes;
+    for ( std::size_t size = MIN_WORKING_SET; size <= maxBytes; size *= 2 )
+    {
+        sizes.push_back( size );
+        if ( size + size / 2 <= maxBytes )
+            sizes.push_back( size + size / 2 );
+    }
+    return sizes;
+}
+
+LatencyPoint measureLatency ( std::size_t bytes )
+{
+    std::vector< ChaseNode > nodes( bytes / sizeof( ChaseNode ) );
+    linkRandomCycle( nodes );
+
+    // One pass to load the working set into the caches and the TLB.
+    ChaseNode * position = chase(
+        &nodes[ 0 ], std::min( nodes.size(), CHASE_LOADS )
+    );
+    auto times = runBenchmarkSingle< std::nano >(
+        CHASE_ITERATIONS,
+        [ &position ] ()
+        {
+            position = chase( position, CHASE_LOADS );
+            return position;
+        }
+    );
+    BenchmarkStats stats = computeBenchmarkStats( times );
+    return LatencyPoint{ bytes, stats.median / CHASE_LOADS };
+}
+
+// Capacities of the cache levels seen in the latency curve: the last working
+// set before each of the largest steps up in latency, smallest first.
+std::vector< std::size_t > measuredLevels (
+    std::vector< LatencyPoint > const & points
+)
+{
+    std::vector< std::size_t > steps;
+    for ( std::size_t i = 1; i < points.size(); ++i )
+    {
+        if ( points[ i ].nsPerLoad
+             > points[ i - 1 ].nsPerLoad * LEVEL_LATENCY_RATIO )
+        {
+            steps.push_back( i );
+        }
+    }
+    std::sort( steps.begin(), steps.end(),
+        [ & ] ( std::size_t i, std::size_t j )
+        {
+            return points[ i ].nsPerLoad / points[ i - 1 ].nsPerLoad
+                > points[ j ].nsPerLoad / points[ j - 1 ].nsPerLoad;
+        }
+    );
+
+    std::vector< std::size_t > levels;
+    for ( std::size_t i : steps )
+    {
+        const std::size_t capacity = points[ i - 1 ].bytes;
+        const bool distinct = std::all_of( levels.begin(), levels.end(),
+            [ capacity ] ( std::size_t level )
+            {
+                return capacity >= level * LEVEL_SIZE_RATIO
+                    || level >= capacity * LEVEL_SIZE_RATIO;
+            }
+        );
+        if ( distinct && levels.size() < MAX_LEVELS )
+            levels.push_back( capacity );
+    }
+    std::sort( levels.begin(), levels.end() );
+    return levels;
+}
+
+/*----------------------------------------------------------------------------*/
+
+enum class StreamKernel
+{
+        Copy    // c = a
+    ,   Scale   // b = s * c
+    ,   Add     // c = a + b
+    ,   Triad   // a = b + s * c
+};
+
+constexpr StreamKernel STREAM_KERNELS[] = {
+    StreamKernel::Copy, StreamKernel::Scale,
+    StreamKernel::Add, StreamKernel::Triad
+};
+
+inline const char * streamKernelName ( StreamKernel kernel )
+{
+    switch ( kernel )
+    {
+        case StreamKernel::Copy:    return "Copy";
+        case StreamKernel::Scale:   return "Scale";
+        case StreamKernel::Add:     return "Add";
+        case StreamKernel::Triad:   return "Triad";
+    }
+    return "Unknown";
+}
+
+// Arrays read or written per element. As in STREAM, the line a store first
+// reads into the cache is not counted.
+inline std::size_t streamArrays ( StreamKernel kernel )
+{
+    return kernel == StreamKernel::Copy || kernel == StreamKernel::Scale
+        ? 2 : 3;
+}
+
+inline void streamChunk (
+    StreamKernel kernel,
+    double * a, double * b, double * c,
+    std::size_t begin, std::size_t end
+)
+{
+    switch ( kernel )
+    {
+        case StreamKernel::Copy:
+            for ( std::size_t i = begin; i < end; ++i )
+                c[ i ] = a[ i ];
+            break;
+        case StreamKernel::Scale:
+            for ( std::size_t i = begin; i < end; ++i )
+                b[ i ] = STREAM_SCALAR * c[ i ];
+            break;
+        case StreamKernel::Add:
+            for ( std::size_t i = begin; i < end; ++i )
+                c[ i ] = a[ i ] + b[ i ];
+            break;
+        case StreamKernel::Triad:
+            for ( std::size_t i = begin; i < end; ++i )
+                a[ i ] = b[ i ] + STREAM_SCALAR * c[ i ];
+            break;
+    }
+}
+
+// Times of every kernel for one thread count, in milliseconds.
+struct StreamResult
+{
+    std::vector< std::vector< double > > times;
+};
+
+// Runs func( begin, end ) on every thread of the pool over its static share
+// of [0, count).
+template < typename _ChunkFuncT >
+void runChunks ( ThreadPool & pool, std::size_t count, _ChunkFuncT func )
+{
+    const int numThreads = pool.size();
+    const std::size_t chunkSize = ( count + numThreads - 1 ) / numThreads;
+    pool.run( numThreads, [ & ] ( int t )
+    {
+        std::size_t begin = std::min( t * chunkSize, count );
+        std::size_t end = std::min( begin + chunkSize, count );
+        func( begin, end );
+    } );
+}
+
+StreamResult measureStream ( int threads, std::size_t count, bool pin )
+{
+    ThreadPool pool( threads, pin );
+    std::unique_ptr< double[] > a( new double[ count ] );
+    std::unique_ptr< double[] > b( new double[ count ] );
+    std::unique_ptr< double[] > c( new double[ count ] );
+
+    // First touch from the threads that later stream the same chunks.
+    runChunks( pool, count, [ & ] ( std::size_t begin, std::size_t end )
+    {
+        for ( std::size_t i = begin; i < end; ++i )
+        {
+            a[ i ] = 1.0;
+            b[ i ] = 2.0;
+            c[ i ] = 0.0;
+        }
+    } );
+
+    StreamResult result;
+    for ( StreamKernel kernel : STREAM_KERNELS )
+    {
+        result.times.push_back( runBenchmarkSingle< std::milli >(
+            STREAM_ITERATIONS,
+            [ & ] ()
+            {
+                runChunks( pool, count,
+                    [ & ] ( std::size_t begin, std::size_t end )
+                    {
+                        streamChunk(
+                            kernel, a.get(), b.get(), c.get(), begin, end
+                        );
+                    }
+                );
+                return a[ count / 2 ] + c[ count / 2 ];
+            }
+        ) );
+    }
+    return result;
+}
+
+// Best-case bandwidth in GB/s, from the fastest iteration as STREAM reports.
+inline double streamGBps (
+    StreamKernel kernel, std::size_t count, std::vector< double > const & ms
+)
+{
+    const double bytes = static_cast< double >(
+        streamArrays( kernel ) * count * sizeof( double )
+    );
+    const double best = *std::min_element( ms.begin(), ms.end() );
+    return bytes / ( best * 1e6 );
+}
+
+/*----------------------------------------------------------------------------*/
+
+void writeLatencyCSV (
+    const std::string & filename,
+    std::vector< LatencyPoint > const & points
+)
+{
+    std::ofstream ofs( filename );
+    if ( !ofs )
+    {
+        std::cerr
+            << "Error: cannot open file " << filename << " for writing.\n"
+        ;
+        return;
+    }
+    ofs << "WorkingSetBytes,NsPerLoad\n";
+    for ( LatencyPoint const & point : points )
+        ofs << point.bytes << "," << point.nsPerLoad << "\n";
+    std::cout << "Latency results written to " << filename << std::endl;
+}
+
+// Rows "ThreadCount", then per kernel "<Kernel>Avg", "<Kernel>Std" (ms) and
+// "<Kernel>GBps".
+void writeBandwidthCSV (
+    const std::string & filename,
+    std::size_t count,
+    std::vector< StreamResult > const & results
+)
+{
+    std::ofstream ofs( filename );
+    if ( !ofs )
+    {
+        std::cerr
+            << "Error: cannot open file " << filename << " for writing.\n"
+        ;
+        return;
+    }
+
+    ofs << "ThreadCount";
+    for ( std::size_t t = 0; t < results.size(); ++t )
+        ofs << "," << t + 1;
+    ofs << "\n";
+    for ( std::size_t k = 0; k < std::size( STREAM_KERNELS ); ++k )
+    {
+        const char * name = streamKernelName( STREAM_KERNELS[ k ] );
+        ofs << name << "Avg";
+        for ( StreamResult const & result : results )
+            ofs << "," << computeBenchmarkStats( result.times[ k ] ).mean;
+        ofs << "\n" << name << "Std";
+        for ( StreamResult const & result : results )
+            ofs << "," << computeBenchmarkStats( result.times[ k ] ).stdDev;
+        ofs << "\n" << name << "GBps";
+        for ( StreamResult const & result : results )
+        {
+            ofs << "," << streamGBps(
+                STREAM_KERNELS[ k ], count, result.times[ k ]
+            );
+        }
+        ofs << "\n";
+    }
+    std::cout << "Bandwidth results written to " << filename << std::endl;
+}
+
+/*----------------------------------------------------------------------------*/
+
+struct CacheLevelCalibration
+{
+    std::string name;
+    std::size_t reportedBytes;
+    std::size_t measuredBytes;
+    // Reported if known, measured otherwise.
+    std::size_t bytes;
+    // Latency of a working set half the capacity, 0 if none was measured.
+    double nsPerLoad;
+};
+
+std::vector< CacheLevelCalibration > calibrate (
+    std::vector< LatencyPoint > const & points
+)
+{
+    const CacheSizes & reported = cacheSizes();
+    const std::size_t reportedLevels[ MAX_LEVELS ] = {
+        reported.l1d, reported.l2, reported.l3
+    };
+    const std::vector< std::size_t > measured = measuredLevels( points );
+
+    std::vector< CacheLevelCalibration > levels;
+    for ( std::size_t i = 0; i < MAX_LEVELS; ++i )
+    {
+        CacheLevelCalibration level;
+        level.name = "L" + std::to_string( i + 1 );
+        level.reportedBytes = reportedLevels[ i ];
+        level.measuredBytes = i < measured.size() ? measured[ i ] : 0;
+        level.bytes = level.reportedBytes
+            ? level.reportedBytes : level.measuredBytes;
+        level.nsPerLoad = 0;
+        for ( LatencyPoint const & point : points )
+        {
+            if ( point.bytes <= level.bytes / 2 )
+                level.nsPerLoad = point.nsPerLoad;
+        }
+        if ( level.bytes )
+            levels.push_back( level );
+    }
+    return levels;
+}
+
+void printCalibration (
+    std::vector< CacheLevelCalibration > const & levels,
+    std::vector< LatencyPoint > const & points
+)
+{
+    std::cout << "\nCache levels (bytes):\n";
+    for ( CacheLevelCalibration const & level : levels )
+    {
+        std::cout
+            << "  " << level.name
+            << ": reported " << level.reportedBytes
+            << ", measured " << level.measuredBytes
+            << ", latency " << level.nsPerLoad << " ns\n"
+        ;
+    }
+    if ( !points.empty() )
+    {
+        std::cout
+            << "  Memory latency at " << points.back().bytes << " bytes: "
+            << points.back().nsPerLoad << " ns\n"
+        ;
+    }
+    if ( levels.empty() )
+        return;
+
+    std::cout
+        << "flushCache eviction buffer before this calibration: "
+        << evictionBytes() << " bytes; the levels above call for "
+        << EVICTION_LLC_FACTOR * levels.back().bytes << " bytes ("
+        << EVICTION_LLC_FACTOR << " x " << levels.back().name << ")\n"
+        << "search_benchmarks SIZES breakpoints ("
+        << sizeof( SearchElementType ) << "-byte keys):"
+    ;
+    for ( CacheLevelCalibration const & level : levels )
+    {
+        std::cout
+            << " " << level.name << " "
+            << level.bytes / sizeof( SearchElementType )
+        ;
+    }
+    std::cout << std::endl;
+}
+
+// One row per cache level. Elements is the number of search_benchmarks keys
+// that fill the level.
+void writeCalibrationCSV (
+    const std::string & filename,
+    std::vector< CacheLevelCalibration > const & levels
+)
+{
+    std::ofstream ofs( filename );
+    if ( !ofs )
+    {
+        std::cerr
+            << "Error: cannot open file " << filename << " for writing.\n"
+        ;
+        return;
+    }
+    ofs << "Level,ReportedBytes,MeasuredBytes,Bytes,NsPerLoad,Elements"
+        << ",FlushBytes\n";
+    for ( CacheLevelCalibration const & level : levels )
+    {
+        ofs << level.name << "," << level.reportedBytes
+            << "," << level.measuredBytes << "," << level.bytes
+            << "," << level.nsPerLoad
+            << "," << level.bytes / sizeof( SearchElementType )
+            << "," << EVICTION_LLC_FACTOR * level.bytes << "\n";
+    }
+    std::cout << "Calibration written to " << filename << std::endl;
+}
+
+/*----------------------------------------------------------------------------*/
+
+int main ( int argc, char* argv[] )
+{
+    std::size_t maxWorkingSetMB = DEFAULT_MAX_WORKING_SET_MB;
+    std::size_t streamArrayMB = 0;
+    int threads = static_cast< int >(
+        std::max( 1u, std::thread::hardware_concurrency() )
+    );
+    bool pin = true;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        std::string arg = argv[i];
+        if ( arg == "--max-mb" && ( i + 1 ) < argc )
+        {
+            maxWorkingSetMB = std::max< std::size_t >(
+                1, std::stoul( argv[++i] )
+            );
+        }
+        else if ( arg == "--stream-mb" && ( i + 1 ) < argc )
+        {
+            streamArrayMB = std::stoul( argv[++i] );
+        }
+        else if ( arg == "--threads" && ( i + 1 ) < argc )
+        {
+            threads = std::max( 1, std::stoi( argv[++i] ) );
+        }
+        else if ( arg == "--no-pin" )
+        {
+            pin = false;
+        }
+    }
+
+    std::cout << ">> Pointer chase latency" << std::endl;
+    std::vector< LatencyPoint > points;
+    for ( std::size_t bytes : workingSetSizes( maxWorkingSetMB << 20 ) )
+    {
+        points.push_back( measureLatency( bytes ) );
+        std::cout
+            << std::setw( 12 ) << bytes << " bytes: "
+            << points.back().nsPerLoad << " ns/load" << std::endl
+        ;
+    }
+    writeLatencyCSV( LATENCY_FILENAME, points );
+
+    const auto levels = calibrate( points );
+    printCalibration( levels, points );
+    writeCalibrationCSV( CALIBRATION_FILENAME, levels );
+
+    const std::size_t llcBytes = levels.empty() ? 0 : levels.back().bytes;
+    const std::size_t arrayBytes = streamArrayMB
+        ? streamArrayMB << 20
+        : std::max( STREAM_LLC_FACTOR * llcBytes, STREAM_MIN_ARRAY_BYTES );
+    const std::size_t count = arrayBytes / sizeof( double );
+
+    std::cout
+        << "\n>> STREAM bandwidth, 3 arrays of " << arrayBytes
+        << " bytes, 1 to " << threads << " threads" << std::endl
+    ;
+    std::vector< StreamResult > results;
+    for ( int t = 1; t <= threads; ++t )
+    {
+        results.push_back( measureStream( t, count, pin ) );
+        std::cout << "  " << t << " threads:";
+        for ( std::size_t k = 0; k < std::size( STREAM_KERNELS ); ++k )
+        {
+            std::cout
+                << " " << streamKernelName( STREAM_KERNELS[ k ] ) << " "
+                << streamGBps(
+                    STREAM_KERNELS[ k ], count, results.back().times[ k ]
+                )
+                << " GB/s"
+            ;
+        }
+        std::cout << std::endl;
+    }
+    writeBandwidthCSV( BANDWIDTH_FILENAME, count, results );
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------------*/
@@ -1,9 +1,22 @@
 #include "../utils/benchmark.hpp"
+#include "../utils/cache.h"
+#include "../utils/cpu_features.h"
+#include "../utils/page_allocator.h"
+#include "../utils/thread_pool.h"
 
+#include <algorithm>
 #include <iostream>
+#include <string>
+#include <thread>
 #include <vector>
 #include <cstdlib>
 
+#if defined( PERF_ARCH_X86 )
+#include <immintrin.h>
+#elif defined( PERF_ARCH_ARM64 )
+#include <arm_neon.h>
+#endif
+
 /*----------------------------------------------------------------------------*/
 
 using TimerType = Timer< std::milli >;
@@ -11,6 +24,10 @@ using DataType = double;
 
 constexpr int DUMMY_SIZE = 16;
 
+// Time step and damping of every update; 0.016f as in the serial loops.
+constexpr DataType UPDATE_DT = 0.016f;
+constexpr DataType UPDATE_DAMPING = 1.000001;
+
 // Object oriented design: each entity encapsulates its data and update method.
 struct Entity
 {
@@ -27,11 +44,15 @@ struct Entity
     }
 };
 
+// Entity and field arrays live on the pages selected with --pages.
+using EntityVector = PageVector< Entity >;
+using DataVector = PageVector< DataType >;
+
 /*----------------------------------------------------------------------------*/
 
 void benchmarkObjectOriented ( size_t count, size_t iterations )
 {
-    std::vector<Entity> entities(count);
+    EntityVector entities(count);
 
     for (size_t i = 0; i < count; ++i) {
         entities[i].x = static_cast<DataType>(rand()) / RAND_MAX;
@@ -51,6 +72,7 @@ void benchmarkObjectOriented ( size_t count, size_t iterations )
         return accumulator;
     };
 
+    PerfRecorder perf;
     auto iterationsTimes = runBenchmark< TimerType::Ratio >(
         0, 0, 1, iterations, benchFunc
     );
@@ -58,16 +80,19 @@ void benchmarkObjectOriented ( size_t count, size_t iterations )
     printBenchmarkStats< TimerType >(
         std::cout, "Object Oriented", iterationsTimes[ 0 ]
     );
+    printPerfCounts(
+        std::cout, "Object Oriented", perf.groupAverages( iterations )[ 0 ]
+    );
 }
 
 /*----------------------------------------------------------------------------*/
 
 void benchmarkDataOriented ( size_t count, size_t iterations )
 {
-    std::vector<DataType> posX(count);
-    std::vector<DataType> posY(count);
-    std::vector<DataType> velX(count);
-    std::vector<DataType> velY(count);
+    DataVector posX(count);
+    DataVector posY(count);
+    DataVector velX(count);
+    DataVector velY(count);
 
     for ( std::size_t i = 0; i < count; ++i )
     {
@@ -91,12 +116,16 @@ void benchmarkDataOriented ( size_t count, size_t iterations )
         return accumulator;
     };
 
+    PerfRecorder perf;
     auto iterationsTimes = runBenchmark< TimerType::Ratio >(
         0, 0, 1, iterations, benchFunc
     );
 
     printBenchmarkStats< TimerType >(
-        std::cout, "Object Oriented", iterationsTimes[ 0 ]
+        std::cout, "Data Oriented", iterationsTimes[ 0 ]
+    );
+    printPerfCounts(
+        std::cout, "Data Oriented", perf.groupAverages( iterations )[ 0 ]
     );
 }
 
@@ -104,15 +133,35 @@ void benchmarkDataOriented ( size_t count, size_t iterations )
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 
+/*
+The growing-size benchmarks update their entities in place. The harness
+(runBenchmarkWithReset) restores them from a pristine copy before every
+iteration, outside the timed region; the restore is reported on its own as
+"<label> Reset Copy", the cost the timed loop used to include.
+*/
+void printGrowingSizeResults (
+    std::ostream & out,
+    std::string const & label,
+    ResetBenchmarkTimes const & measurements,
+    std::vector< PerfCounts > const & counts
+)
+{
+    printBenchmarkStatsList< TimerType >( out, label, measurements.run );
+    printPerfCountsList( out, label, counts );
+    printBenchmarkStatsList< TimerType >(
+        out, label + " Reset Copy", measurements.reset
+    );
+}
+
 void benchmarkObjectOrientedSizes(size_t baseCount, size_t iterations,
     int globalStart, int globalEnd, int globalStep,
     std::ostream & out)
 {
     // preCalc: Create a vector of Entities with a size that grows
     // with globalIndex.
-    auto preCalc = [ baseCount ]( int globalIndex ) -> std::vector<Entity> {
+    auto preCalc = [ baseCount ]( int globalIndex ) -> EntityVector {
         int newSize = static_cast<int>( baseCount ) * ( globalIndex + 1 );
-        std::vector< Entity > entities(newSize);
+        EntityVector entities(newSize);
         for (size_t i = 0; i < entities.size(); ++i)
         {
             entities[i].x = static_cast<DataType>(rand()) / RAND_MAX;
@@ -123,11 +172,11 @@ void benchmarkObjectOrientedSizes(size_t baseCount, size_t iterations,
         return entities;
     };
 
-    // benchFunc: Process the vector of Entities.
-    // Note: We accept the vector by value (a copy) so that each iteration
-    // uses fresh data.
+    // benchFunc: Process the vector of Entities. The harness restores the
+    // vector before every iteration, outside the timed region, so each
+    // iteration still uses fresh data.
     auto benchFunc =
-        [] ( std::vector< Entity > entities, int globalIndex ) -> DataType
+        [] ( EntityVector & entities, int globalIndex ) -> DataType
     {
         volatile DataType accumulator = 0;
         for ( std::size_t i = 0; i < entities.size(); ++i )
@@ -140,14 +189,16 @@ void benchmarkObjectOrientedSizes(size_t baseCount, size_t iterations,
 
     // Run the benchmark for each global iteration (each representing a
     // different array size).
-    auto rawMeasuremenetsList = runBenchmarkWithPreCalc< TimerType::Ratio >(
+    PerfRecorder perf;
+    auto measurements = runBenchmarkWithReset< TimerType::Ratio >(
         globalStart, globalEnd, globalStep, iterations,
-        preCalc, benchFunc
+        preCalc, CopyReset(), benchFunc
     );
 
     // Print the list of averages.
-    printBenchmarkStatsList< TimerType >(
-        out, "Object Oriented (Growing Array Sizes)", rawMeasuremenetsList
+    printGrowingSizeResults(
+        out, "Object Oriented (Growing Array Sizes)", measurements,
+        perf.groupAverages( iterations )
     );
 }
 
@@ -156,10 +207,10 @@ void benchmarkObjectOrientedSizes(size_t baseCount, size_t iterations,
 // Data-oriented structure to hold arrays.
 struct DataArrays
 {
-    std::vector<DataType> posX;
-    std::vector<DataType> posY;
-    std::vector<DataType> velX;
-    std::vector<DataType> velY;
+    DataVector posX;
+    DataVector posY;
+    DataVector velX;
+    DataVector velY;
 };
 
 void benchmarkDataOrientedSizes (
@@ -187,8 +238,8 @@ void benchmarkDataOrientedSizes (
     };
 
     // benchFunc: Process the DataArrays by updating each element and
-    // accumulating a value.
-    auto benchFunc = [] ( DataArrays arrays, int /*globalIndex*/ ) -> DataType
+    // accumulating a value; restored by the harness between iterations.
+    auto benchFunc = [] ( DataArrays & arrays, int /*globalIndex*/ ) -> DataType
     {
         volatile DataType accumulator = 0;
         int size = arrays.posX.size();
@@ -204,24 +255,568 @@ void benchmarkDataOrientedSizes (
     };
 
     // Run the benchmark over a range of global iterations.
-    auto rawMeaduremenetsList = runBenchmarkWithPreCalc< TimerType::Ratio >(
+    PerfRecorder perf;
+    auto measurements = runBenchmarkWithReset< TimerType::Ratio >(
         globalStart, globalEnd, globalStep, iterations,
-        preCalc, benchFunc
+        preCalc, CopyReset(), benchFunc
     );
 
     // Print the list of averages.
-    printBenchmarkStatsList< TimerType >(
-        out, "Data Oriented (Growing Array Sizes)", rawMeaduremenetsList
+    printGrowingSizeResults(
+        out, "Data Oriented (Growing Array Sizes)", measurements,
+        perf.groupAverages( iterations )
     );
 }
 
 /*----------------------------------------------------------------------------*/
 
+/*
+Array of structures of arrays (AoSoA): entities are stored in blocks of
+_BlockN, and every field of a block is an array of _BlockN values, so a block
+holds _BlockN complete entities. Within a block the update streams over
+contiguous x, y, vx and vy runs, as with SoA, while all fields of one entity,
+dummy included, stay within one block. Blocks of 4, 8 or 16 doubles match one
+AVX2 register, one AVX-512 register or one cache line per field.
+*/
+template < std::size_t _BlockN >
+struct EntityBlock
+{
+    DataType x[ _BlockN ];
+    DataType y[ _BlockN ];
+    DataType vx[ _BlockN ];
+    DataType vy[ _BlockN ];
+    DataType dummy[ DUMMY_SIZE ][ _BlockN ];
+};
+
+template < std::size_t _BlockN >
+class AoSoAEntities
+{
+
+public:
+
+    explicit AoSoAEntities ( std::size_t count )
+        :   m_count( count )
+        ,   m_blocks( ( count + _BlockN - 1 ) / _BlockN )
+    {
+    }
+
+    std::size_t size () const { return m_count; }
+
+    // Per-entity access.
+    DataType & x ( std::size_t i ) { return block( i ).x[ i % _BlockN ]; }
+    DataType & y ( std::size_t i ) { return block( i ).y[ i % _BlockN ]; }
+    DataType & vx ( std::size_t i ) { return block( i ).vx[ i % _BlockN ]; }
+    DataType & vy ( std::size_t i ) { return block( i ).vy[ i % _BlockN ]; }
+
+    // The update of Entity::update, block by block; the lane loop has a
+    // known trip count for every full block.
+    DataType update ( DataType dt )
+    {
+        volatile DataType accumulator = 0;
+        for ( std::size_t b = 0; b < m_blocks.size(); ++b )
+        {
+            EntityBlock< _BlockN > & blk = m_blocks[ b ];
+            const std::size_t lanes =
+                std::min( _BlockN, m_count - b * _BlockN );
+            for ( std::size_t l = 0; l < lanes; ++l )
+            {
+                blk.x[ l ] += blk.vx[ l ] * dt;
+                blk.y[ l ] += blk.vy[ l ] * dt;
+                blk.x[ l ] *= 1.000001;
+                blk.y[ l ] *= 1.000001;
+                accumulator = accumulator + blk.x[ l ];
+            }
+        }
+        return accumulator;
+    }
+
+private:
+
+    EntityBlock< _BlockN > & block ( std::size_t i )
+    {
+        return m_blocks[ i / _BlockN ];
+    }
+
+    std::size_t m_count;
+    PageVector< EntityBlock< _BlockN > > m_blocks;
+};
 
-int main ()
+template < std::size_t _BlockN >
+void benchmarkAoSoASizes (
+    size_t baseCount, size_t iterations,
+    int globalStart, int globalEnd, int globalStep,
+    std::ostream & out
+)
 {
-    const size_t count = 1000000;
+    auto preCalc = [ baseCount ] ( int globalIndex )
+    {
+        size_t newSize = baseCount * ( globalIndex + 1 );
+        AoSoAEntities< _BlockN > entities( newSize );
+        for ( size_t i = 0; i < newSize; ++i )
+        {
+            entities.x( i ) = static_cast<DataType>(rand()) / RAND_MAX;
+            entities.y( i ) = static_cast<DataType>(rand()) / RAND_MAX;
+            entities.vx( i ) = static_cast<DataType>(rand()) / RAND_MAX;
+            entities.vy( i ) = static_cast<DataType>(rand()) / RAND_MAX;
+        }
+        return entities;
+    };
+
+    auto benchFunc =
+        [] ( AoSoAEntities< _BlockN > & entities, int ) -> DataType
+    {
+        return entities.update( 0.016f );
+    };
+
+    PerfRecorder perf;
+    auto measurements = runBenchmarkWithReset< TimerType::Ratio >(
+        globalStart, globalEnd, globalStep, iterations,
+        preCalc, CopyReset(), benchFunc
+    );
+
+    const std::string label =
+        "AoSoA<" + std::to_string( _BlockN ) + "> (Growing Array Sizes)";
+    printGrowingSizeResults(
+        out, label, measurements, perf.groupAverages( iterations )
+    );
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Hot/cold split: the fields the update touches stay in an array of small
+HotEntity structs, the dummy data moves to a parallel array indexed the same
+way. Entity i is still hot[ i ] plus cold[ i ], but the update only streams
+32 bytes per entity instead of a whole Entity.
+*/
+struct HotEntity
+{
+    DataType x, y;
+    DataType vx, vy;
+
+    void update(DataType dt)
+    {
+        x += vx * dt;
+        y += vy * dt;
+        x *= 1.000001;
+        y *= 1.000001;
+    }
+};
+
+struct ColdEntity
+{
+    DataType dummy[ DUMMY_SIZE ];
+};
+
+struct SplitEntities
+{
+    PageVector< HotEntity > hot;
+    PageVector< ColdEntity > cold;
+};
+
+void benchmarkHotColdSizes (
+    size_t baseCount, size_t iterations,
+    int globalStart, int globalEnd, int globalStep,
+    std::ostream & out
+)
+{
+    auto preCalc = [ baseCount ] ( int globalIndex ) -> SplitEntities
+    {
+        size_t newSize = baseCount * ( globalIndex + 1 );
+        SplitEntities entities;
+        entities.hot.resize( newSize );
+        entities.cold.resize( newSize );
+        for ( HotEntity & hot : entities.hot )
+        {
+            hot.x = static_cast<DataType>(rand()) / RAND_MAX;
+            hot.y = static_cast<DataType>(rand()) / RAND_MAX;
+            hot.vx = static_cast<DataType>(rand()) / RAND_MAX;
+            hot.vy = static_cast<DataType>(rand()) / RAND_MAX;
+        }
+        return entities;
+    };
+
+    auto benchFunc = [] ( SplitEntities & entities, int ) -> DataType
+    {
+        volatile DataType accumulator = 0;
+        for ( HotEntity & hot : entities.hot )
+        {
+            hot.update( 0.016f );
+            accumulator = accumulator + hot.x;
+        }
+        return accumulator;
+    };
+
+    PerfRecorder perf;
+    auto measurements = runBenchmarkWithReset< TimerType::Ratio >(
+        globalStart, globalEnd, globalStep, iterations,
+        preCalc, CopyReset(), benchFunc
+    );
+
+    const std::string label = "Hot/Cold Split (Growing Array Sizes)";
+    printGrowingSizeResults(
+        out, label, measurements, perf.groupAverages( iterations )
+    );
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
+
+/*
+Parallel and vectorized updates of the single-size benchmarks.
+
+Every variant applies the same per-entity update and returns the sum of the
+new x coordinates. The parallel ones give every pool worker one contiguous,
+rounded-up chunk, the static split of utils/parallel_reduce.hpp, and add up
+the per-chunk sums in chunk order. Their hardware counters are not printed:
+the counters only see the calling thread, not the pool workers.
+*/
+
+template < typename _UpdateChunkT >
+DataType parallelUpdate (
+    ThreadPool & pool, std::size_t count, _UpdateChunkT updateChunk
+)
+{
+    struct alignas( CACHE_LINE_SIZE ) Partial
+    {
+        DataType value;
+    };
+
+    const int numThreads = pool.size();
+    std::vector< Partial > partials( numThreads, Partial{ 0 } );
+    const std::size_t chunkSize = ( count + numThreads - 1 ) / numThreads;
+    pool.run( numThreads, [ & ] ( int t )
+    {
+        std::size_t begin = std::min( t * chunkSize, count );
+        std::size_t end = std::min( begin + chunkSize, count );
+        partials[ t ].value = updateChunk( begin, end );
+    } );
+
+    DataType sum = 0;
+    for ( const Partial & partial : partials )
+        sum += partial.value;
+    return sum;
+}
+
+// The serial loops on [begin, end), volatile accumulator included.
+DataType updateEntitiesScalar (
+    EntityVector & entities, std::size_t begin, std::size_t end
+)
+{
+    volatile DataType accumulator = 0;
+    for ( std::size_t i = begin; i < end; ++i )
+    {
+        entities[i].update( UPDATE_DT );
+        accumulator = accumulator + entities[i].x;
+    }
+    return accumulator;
+}
+
+/*
+SoA update of count entities starting at the given pointers. The scalar
+kernel repeats the serial loop; the vector kernels update 4 (AVX2) or 2 (NEON)
+entities per step and keep the sum in a register, which is what the volatile
+accumulator of the serial loop prevents. As with the search kernels, the
+widest one the CPU supports is picked at runtime.
+*/
+using UpdateArraysFunc = DataType (*)(
+    DataType * posX, DataType * posY,
+    const DataType * velX, const DataType * velY,
+    std::size_t count
+);
+
+inline DataType updateArraysScalar (
+    DataType * posX, DataType * posY,
+    const DataType * velX, const DataType * velY,
+    std::size_t count
+)
+{
+    volatile DataType accumulator = 0;
+    for ( std::size_t i = 0; i < count; ++i )
+    {
+        posX[i] += velX[i] * UPDATE_DT;
+        posY[i] += velY[i] * UPDATE_DT;
+        posX[i] *= UPDATE_DAMPING;
+        posY[i] *= UPDATE_DAMPING;
+        accumulator = accumulator + posX[i];
+    }
+    return accumulator;
+}
+
+#if defined( PERF_ARCH_X86 )
+
+__attribute__(( target( "avx2" ) ))
+inline DataType updateArraysAvx2 (
+    DataType * posX, DataType * posY,
+    const DataType * velX, const DataType * velY,
+    std::size_t count
+)
+{
+    const __m256d dt = _mm256_set1_pd( UPDATE_DT );
+    const __m256d damping = _mm256_set1_pd( UPDATE_DAMPING );
+    __m256d sum = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        __m256d x = _mm256_add_pd(
+            _mm256_loadu_pd( posX + i ),
+            _mm256_mul_pd( _mm256_loadu_pd( velX + i ), dt )
+        );
+        __m256d y = _mm256_add_pd(
+            _mm256_loadu_pd( posY + i ),
+            _mm256_mul_pd( _mm256_loadu_pd( velY + i ), dt )
+        );
+        x = _mm256_mul_pd( x, damping );
+        y = _mm256_mul_pd( y, damping );
+        _mm256_storeu_pd( posX + i, x );
+        _mm256_storeu_pd( posY + i, y );
+        sum = _mm256_add_pd( sum, x );
+    }
+    alignas( 32 ) DataType lanes[ 4 ];
+    _mm256_store_pd( lanes, sum );
+    return lanes[ 0 ] + lanes[ 1 ] + lanes[ 2 ] + lanes[ 3 ]
+        + updateArraysScalar(
+            posX + i, posY + i, velX + i, velY + i, count - i
+        );
+}
+
+#endif // PERF_ARCH_X86
+
+#if defined( PERF_ARCH_ARM64 )
+
+inline DataType updateArraysNeon (
+    DataType * posX, DataType * posY,
+    const DataType * velX, const DataType * velY,
+    std::size_t count
+)
+{
+    const float64x2_t dt = vdupq_n_f64( UPDATE_DT );
+    const float64x2_t damping = vdupq_n_f64( UPDATE_DAMPING );
+    float64x2_t sum = vdupq_n_f64( 0.0 );
+    std::size_t i = 0;
+    for ( ; i + 2 <= count; i += 2 )
+    {
+        float64x2_t x = vaddq_f64(
+            vld1q_f64( posX + i ), vmulq_f64( vld1q_f64( velX + i ), dt )
+        );
+        float64x2_t y = vaddq_f64(
+            vld1q_f64( posY + i ), vmulq_f64( vld1q_f64( velY + i ), dt )
+        );
+        x = vmulq_f64( x, damping );
+        y = vmulq_f64( y, damping );
+        vst1q_f64( posX + i, x );
+        vst1q_f64( posY + i, y );
+        sum = vaddq_f64( sum, x );
+    }
+    return vaddvq_f64( sum )
+        + updateArraysScalar(
+            posX + i, posY + i, velX + i, velY + i, count - i
+        );
+}
+
+#endif // PERF_ARCH_ARM64
+
+inline UpdateArraysFunc bestUpdateArrays ()
+{
+    CpuFeatures const & features = cpuFeatures();
+#if defined( PERF_ARCH_X86 )
+    if ( features.avx2 )
+        return updateArraysAvx2;
+#elif defined( PERF_ARCH_ARM64 )
+    if ( features.neon )
+        return updateArraysNeon;
+#endif
+    (void)features;
+    return updateArraysScalar;
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Time `iterations` calls of update() and print their statistics; returns
+// the filtered mean.
+template < typename _UpdateT >
+double timeUpdate (
+    std::string const & label,
+    size_t iterations,
+    bool printCounters,
+    _UpdateT update
+)
+{
+    PerfRecorder perf;
+    auto iterationsTimes = runBenchmark< TimerType::Ratio >(
+        0, 0, 1, iterations, [ & ] ( int ) { return update(); }
+    );
+    printBenchmarkStats< TimerType >( std::cout, label, iterationsTimes[ 0 ] );
+    if ( printCounters )
+    {
+        printPerfCounts(
+            std::cout, label, perf.groupAverages( iterations )[ 0 ]
+        );
+    }
+    return computeBenchmarkStats( iterationsTimes[ 0 ] ).mean;
+}
+
+EntityVector makeEntities ( size_t count )
+{
+    EntityVector entities( count );
+    for ( Entity & entity : entities )
+    {
+        entity.x = static_cast<DataType>(rand()) / RAND_MAX;
+        entity.y = static_cast<DataType>(rand()) / RAND_MAX;
+        entity.vx = static_cast<DataType>(rand()) / RAND_MAX;
+        entity.vy = static_cast<DataType>(rand()) / RAND_MAX;
+    }
+    return entities;
+}
+
+DataArrays makeArrays ( size_t count )
+{
+    DataArrays arrays;
+    arrays.posX.resize( count );
+    arrays.posY.resize( count );
+    arrays.velX.resize( count );
+    arrays.velY.resize( count );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        arrays.posX[i] = static_cast<DataType>(rand()) / RAND_MAX;
+        arrays.posY[i] = static_cast<DataType>(rand()) / RAND_MAX;
+        arrays.velX[i] = static_cast<DataType>(rand()) / RAND_MAX;
+        arrays.velY[i] = static_cast<DataType>(rand()) / RAND_MAX;
+    }
+    return arrays;
+}
+
+/*
+AoS against SoA once the update runs on every core. The serial runs repeat
+benchmarkObjectOriented and benchmarkDataOriented; the parallel ones split
+the same loops over `pool`. Once all cores stream memory the update is
+bandwidth-bound, and the SoA advantage is roughly the ratio of bytes moved
+per entity: the hot 32 bytes against the whole cache lines of an Entity.
+*/
+void benchmarkParallelUpdates ( size_t count, size_t iterations, int threads )
+{
+    ThreadPool pool( threads );
+    EntityVector entities = makeEntities( count );
+    DataArrays arrays = makeArrays( count );
+    UpdateArraysFunc vectorized = bestUpdateArrays();
+
+    auto updateArrays = [ & ] (
+        UpdateArraysFunc kernel, std::size_t begin, std::size_t end
+    )
+    {
+        return kernel(
+            arrays.posX.data() + begin, arrays.posY.data() + begin,
+            arrays.velX.data() + begin, arrays.velY.data() + begin,
+            end - begin
+        );
+    };
+
+    double objectSerial = timeUpdate( "Object Oriented", iterations, true,
+        [ & ] () { return updateEntitiesScalar( entities, 0, count ); }
+    );
+    double objectParallel = timeUpdate(
+        "Object Oriented Parallel", iterations, false,
+        [ & ] ()
+        {
+            return parallelUpdate( pool, count,
+                [ & ] ( std::size_t begin, std::size_t end )
+                {
+                    return updateEntitiesScalar( entities, begin, end );
+                }
+            );
+        }
+    );
+    double dataSerial = timeUpdate( "Data Oriented", iterations, true,
+        [ & ] () { return updateArrays( updateArraysScalar, 0, count ); }
+    );
+    double dataParallel = timeUpdate(
+        "Data Oriented Parallel", iterations, false,
+        [ & ] ()
+        {
+            return parallelUpdate( pool, count,
+                [ & ] ( std::size_t begin, std::size_t end )
+                {
+                    return updateArrays( updateArraysScalar, begin, end );
+                }
+            );
+        }
+    );
+    double simdSerial = timeUpdate( "Data Oriented SIMD", iterations, true,
+        [ & ] () { return updateArrays( vectorized, 0, count ); }
+    );
+    double simdParallel = timeUpdate(
+        "Data Oriented SIMD Parallel", iterations, false,
+        [ & ] ()
+        {
+            return parallelUpdate( pool, count,
+                [ & ] ( std::size_t begin, std::size_t end )
+                {
+                    return updateArrays( vectorized, begin, end );
+                }
+            );
+        }
+    );
+
+    std::cout
+        << "SoA speedup over AoS, 1 thread: " << objectSerial / dataSerial
+        << " (SIMD " << objectSerial / simdSerial << "), "
+        << threads << " threads: " << objectParallel / dataParallel
+        << " (SIMD " << objectParallel / simdParallel << ")\n"
+        << "Parallel speedup, " << threads << " threads: AoS "
+        << objectSerial / objectParallel << ", SoA "
+        << dataSerial / dataParallel << ", SoA SIMD "
+        << simdSerial / simdParallel << std::endl
+    ;
+}
+
+/*----------------------------------------------------------------------------*/
+
+
+int main ( int argc, char* argv[] )
+{
+    size_t count = 1000000;
     const size_t iterations = 30;
+    int threads = static_cast< int >(
+        std::max( 1u, std::thread::hardware_concurrency() )
+    );
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        std::string arg = argv[i];
+        if ( arg == "--count" && ( i + 1 ) < argc )
+        {
+            count = std::stoul( argv[++i] );
+        }
+        else if ( arg == "--threads" && ( i + 1 ) < argc )
+        {
+            threads = std::max( 1, std::stoi( argv[++i] ) );
+        }
+        else if ( arg == "--pages" && ( i + 1 ) < argc )
+        {
+            std::string name = argv[++i];
+            if ( !parsePageMode( name, pageOptions().mode ) )
+            {
+                std::cerr << "Error: unknown page mode " << name
+                          << " (expected default, thp, 2m or 1g)\n";
+                return 1;
+            }
+        }
+        else if ( arg == "--prefault" )
+        {
+            pageOptions().prefault = true;
+        }
+        else if ( arg == "--align" && ( i + 1 ) < argc )
+        {
+            std::string value = argv[++i];
+            if ( !parseAlignment( value, pageOptions().alignment ) )
+            {
+                std::cerr << "Error: invalid alignment " << value
+                          << " (expected a power of two up to 4096)\n";
+                return 1;
+            }
+        }
+    }
 
     std::cout << "Size of Entity: " << sizeof(Entity) << " bytes" << std::endl;
     std::cout << "========================================" << std::endl;
@@ -229,6 +824,7 @@ int main ()
         << "Benchmarking with " << count << " elements and "
         << iterations << " iterations per test." << std::endl
     ;
+    std::cout << "Pages: " << pageDescription() << std::endl;
     std::cout << "========================================" << std::endl
         << std::endl
     ;
@@ -241,6 +837,13 @@ int main ()
     benchmarkDataOriented(count, iterations);
     std::cout << std::endl;
 
+    std::cout
+        << ">> Running Parallel and SIMD Benchmarks (" << threads
+        << " threads)..." << std::endl
+    ;
+    benchmarkParallelUpdates( count, iterations, threads );
+    std::cout << std::endl;
+
     std::cout << "========================================" << std::endl
         << std::endl
     ;
@@ -269,6 +872,31 @@ int main ()
     );
     std::cout << std::endl;
 
+    std::cout
+        << ">> Running AoSoA Benchmarks with Growing Array Sizes:"
+        << std::endl
+    ;
+    benchmarkAoSoASizes< 4 >(
+        count, iterations, globalStart, globalEnd, globalStep, std::cout
+    );
+    benchmarkAoSoASizes< 8 >(
+        count, iterations, globalStart, globalEnd, globalStep, std::cout
+    );
+    benchmarkAoSoASizes< 16 >(
+        count, iterations, globalStart, globalEnd, globalStep, std::cout
+    );
+    std::cout << std::endl;
+
+    std::cout
+        << ">> Running Hot/Cold Split Benchmark with Growing Array Sizes:"
+        << std::endl
+    ;
+    benchmarkHotColdSizes(
+        count, iterations, globalStart, globalEnd, globalStep, std::cout
+    );
+    std::cout << std::endl;
+
+    printPageStats( std::cout );
     std::cout << "Benchmarking complete." << std::endl;
 
     return 0;
@@ -1,38 +1,139 @@
 #include "../utils/benchmark.hpp"
+#include "../utils/cache.h"
+#include "../utils/page_allocator.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <fstream>
 #include <iostream>
+#include <utility>
 #include <vector>
 #include <cstdlib>
 #include <string>
 
 /*----------------------------------------------------------------------------*/
 
+/*
+Sweep of the entity update over growing entities. Every entity holds the four
+fields the update touches (x, y, vx, vy) and DummySize unused values, so the
+stride between two updated entities grows while the useful data stays the
+same. The sweep is generated at compile time: every dummy size of DummySizes
+is instantiated for every FieldLayout, and each instantiation becomes one row
+of entity_layouts.csv with its sizeof, its stride per useful byte and its
+timings.
+With --cold the entities are flushed from the cache before every iteration,
+so each update streams them from memory; by default the iterations run warm.
+--pages and --prefault place the entities (see utils/page_allocator.h), and
+the Pages column records what they got.
+*/
+
 using DataType = double;
 using TimerType = std::milli;
 
+const std::string FILENAME = "entity_layouts.csv";
+
+using DummySizes = std::index_sequence<
+    1, 2, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256
+>;
+
+// Bytes of one entity the update actually uses.
+constexpr std::size_t USEFUL_BYTES = 4 * sizeof( DataType );
+
+enum class FieldLayout
+{
+        Natural     // Updated fields first, then the dummy data.
+    ,   HotLast     // Dummy data first, then the updated fields.
+    ,   Aligned64   // Natural, every entity starting on a 64-byte line.
+    ,   Padded      // A one-byte flag first, padded up to the alignment.
+    ,   Packed      // The same flag, without padding.
+};
+
+inline const char * fieldLayoutName ( FieldLayout layout )
+{
+    switch ( layout )
+    {
+        case FieldLayout::Natural:      return "Natural";
+        case FieldLayout::HotLast:      return "HotLast";
+        case FieldLayout::Aligned64:    return "Aligned64";
+        case FieldLayout::Padded:       return "Padded";
+        case FieldLayout::Packed:       return "Packed";
+    }
+    return "Unknown";
+}
+
+template < size_t DummySize, FieldLayout _LayoutV = FieldLayout::Natural >
+struct Entity;
+
 template < size_t DummySize >
-struct Entity {
+struct Entity< DummySize, FieldLayout::Natural > {
     DataType x, y;
     DataType vx, vy;
     DataType dummy[DummySize];
+};
 
-    void update ( DataType dt )
-    {
-        x += vx * dt;
-        y += vy * dt;
-        x *= 1.000001;
-        y *= 1.000001;
-    }
+template < size_t DummySize >
+struct Entity< DummySize, FieldLayout::HotLast > {
+    DataType dummy[DummySize];
+    DataType x, y;
+    DataType vx, vy;
 };
 
-/*----------------------------------------------------------------------------*/
+template < size_t DummySize >
+struct alignas( 64 ) Entity< DummySize, FieldLayout::Aligned64 > {
+    DataType x, y;
+    DataType vx, vy;
+    DataType dummy[DummySize];
+};
+
+template < size_t DummySize >
+struct Entity< DummySize, FieldLayout::Padded > {
+    std::uint8_t active;
+    DataType x, y;
+    DataType vx, vy;
+    DataType dummy[DummySize];
+};
 
+// Fields at odd offsets: every access is unaligned and some straddle two
+// cache lines.
 template < size_t DummySize >
-void
-benchmarkEntity ( const std::string & label, size_t count, size_t iterations )
+struct __attribute__(( packed )) Entity< DummySize, FieldLayout::Packed > {
+    std::uint8_t active;
+    DataType x, y;
+    DataType vx, vy;
+    DataType dummy[DummySize];
+};
+
+template < typename _EntityT >
+inline void updateEntity ( _EntityT & entity, DataType dt )
 {
-    std::vector< Entity< DummySize > > entities( count );
+    entity.x += entity.vx * dt;
+    entity.y += entity.vy * dt;
+    entity.x *= 1.000001;
+    entity.y *= 1.000001;
+}
+
+/*----------------------------------------------------------------------------*/
+
+// One instantiation of the sweep.
+struct EntityLayoutResult
+{
+    FieldLayout layout;
+    CacheState cache;
+    std::size_t dummySize;
+    std::size_t sizeofEntity;
+    std::size_t alignofEntity;
+    BenchmarkStats stats;
+    PerfCounts perf;
+};
+
+template < size_t DummySize, FieldLayout _LayoutV >
+EntityLayoutResult benchmarkEntity (
+    size_t count, size_t iterations, CacheState cache
+)
+{
+    using EntityType = Entity< DummySize, _LayoutV >;
+    PageVector< EntityType > entities( count );
 
     for ( std::size_t i = 0; i < count; ++i )
     {
@@ -46,67 +147,206 @@ benchmarkEntity ( const std::string & label, size_t count, size_t iterations )
         volatile DataType accumulator = 0;
         for ( std::size_t i = 0; i < count; ++i )
         {
-            entities[i].update(0.016); // Assume dt ~ 16ms (60fps)
-            accumulator += entities[i].x;
+            updateEntity( entities[i], 0.016 ); // Assume dt ~ 16ms (60fps)
+            accumulator = accumulator + entities[i].x;
         }
         return accumulator;
     };
 
+    CacheScope cacheScope( cache );
+    cacheScope.addRange( entities.data(), count * sizeof( EntityType ) );
+    PerfRecorder perf;
     auto iterationTimes = runBenchmarkSingle< TimerType >(
         iterations, benchFunc
     );
 
-    // Calculate average and standard deviation.
-    double average = calculateAverage( iterationTimes );
-    double stddev = calculateStdDev( iterationTimes, average );
+    EntityLayoutResult result;
+    result.layout = _LayoutV;
+    result.cache = cache;
+    result.dummySize = DummySize;
+    result.sizeofEntity = sizeof( EntityType );
+    result.alignofEntity = alignof( EntityType );
+    result.stats = computeBenchmarkStats( iterationTimes );
+    result.perf = perf.groupAverages( iterations )[ 0 ];
 
-    std::cout << label << " Benchmark: "
-            << "Average time: " << average << " " << Timer< TimerType >::unit()
-            << ", StdDev: " << stddev << " " << Timer< TimerType >::unit()
-            << std::endl
-    ;
+    const std::string label = std::string( fieldLayoutName( _LayoutV ) )
+        + " DummySize " + std::to_string( DummySize )
+        + " (" + std::to_string( sizeof( EntityType ) ) + " bytes, "
+        + cacheStateName( cache ) + ")";
+    printBenchmarkStats< Timer< TimerType > >(
+        std::cout, label, iterationTimes
+    );
+    printPerfCounts( std::cout, label, result.perf );
+    return result;
 }
 
 /*----------------------------------------------------------------------------*/
 
-// Flush the cache by reading/writing a large memory block.
-void flushCache()
+// Benchmark Entity< Size, _LayoutV > for every Size of the sequence, with a
+// cache flush before each.
+template < FieldLayout _LayoutV, size_t... Sizes >
+void sweepLayout (
+    std::index_sequence< Sizes... >,
+    size_t count,
+    size_t iterations,
+    CacheState cache,
+    std::vector< EntityLayoutResult > & results
+)
 {
-    // Allocate a buffer that's much larger than the L1/L2/L3 caches.
-    // Adjust the size as needed (here we use 50 MB).
-    const size_t size = 50 * 1024 * 1024;
-    volatile char* buffer = new volatile char[size];
-
-    // Touch the buffer in steps (cache line size is usually 64 bytes).
-    for (size_t i = 0; i < size; i += 1) {
-        buffer[i] = static_cast<char>(i % 256);
+    (
+        (
+            flushCache(),
+            results.push_back(
+                benchmarkEntity< Sizes, _LayoutV >( count, iterations, cache )
+            )
+        ),
+        ...
+    );
+}
+
+template < FieldLayout... _LayoutsV >
+std::vector< EntityLayoutResult > sweepLayouts (
+    size_t count,
+    size_t iterations,
+    CacheState cache
+)
+{
+    std::vector< EntityLayoutResult > results;
+    ( sweepLayout< _LayoutsV >(
+          DummySizes{}, count, iterations, cache, results
+      ),
+      ... );
+    return results;
+}
+
+/*----------------------------------------------------------------------------*/
+
+// One row per instantiation. StrideBytes is the distance between two
+// consecutive entities, which is sizeof for an array; NsPerEntity is the
+// average update time of one entity, and the counter columns are per entity
+// too.
+void writeResultsToCSV (
+    const std::string & filename,
+    size_t count,
+    const std::vector< EntityLayoutResult > & results,
+    const std::vector< PerfEvent > & events
+)
+{
+    std::ofstream ofs( filename );
+    if ( !ofs )
+    {
+        std::cerr
+            << "Error: cannot open file " << filename << " for writing.\n"
+        ;
+        return;
     }
 
-    // Prevent the compiler from optimizing the loop away.
-    asm volatile("" : : "r"(buffer) : "memory");
+    const std::string pages = pageDescription();
+    ofs << "Layout,Cache,Pages,DummySize,SizeofEntity,AlignofEntity,StrideBytes"
+        << ",UsefulBytes,BytesPerUsefulByte"
+        << ",Avg,Std,Median,P90,P99,Min,NsPerEntity";
+    for ( PerfEvent event : events )
+        ofs << "," << perfEventName( event );
+    ofs << "\n";
+
+    // Milliseconds per iteration to nanoseconds per entity.
+    const double nsScale = 1e6 / static_cast< double >( count );
+    for ( const EntityLayoutResult & r : results )
+    {
+        const BenchmarkStats & st = r.stats;
+        ofs << fieldLayoutName( r.layout ) << "," << cacheStateName( r.cache )
+            << "," << pages << "," << r.dummySize
+            << "," << r.sizeofEntity << "," << r.alignofEntity
+            << "," << r.sizeofEntity << "," << USEFUL_BYTES
+            << "," << static_cast< double >( r.sizeofEntity ) / USEFUL_BYTES
+            << "," << st.mean << "," << st.stdDev << "," << st.median
+            << "," << st.p90 << "," << st.p99 << "," << st.min
+            << "," << st.mean * nsScale;
+        for ( PerfEvent event : events )
+            ofs << "," << r.perf[ event ] / static_cast< double >( count );
+        ofs << "\n";
+    }
 
-    // Clean up.
-    delete[] buffer;
+    ofs.close();
+    std::cout << "Benchmark results written to " << filename << std::endl;
 }
 
 /*----------------------------------------------------------------------------*/
 
-int main ()
+int main ( int argc, char* argv[] )
 {
     size_t count = 100000;
     size_t iterations = 30;
+    CacheState cache = CacheState::Warm;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        std::string arg = argv[i];
+        if ( arg == "--count" && ( i + 1 ) < argc )
+        {
+            count = std::stoul( argv[++i] );
+        }
+        else if ( arg == "--iterations" && ( i + 1 ) < argc )
+        {
+            iterations = std::max< size_t >( 1, std::stoul( argv[++i] ) );
+        }
+        else if ( arg == "--cold" )
+        {
+            cache = CacheState::Cold;
+        }
+        else if ( arg == "--pages" && ( i + 1 ) < argc )
+        {
+            std::string name = argv[++i];
+            if ( !parsePageMode( name, pageOptions().mode ) )
+            {
+                std::cerr << "Error: unknown page mode " << name
+                          << " (expected default, thp, 2m or 1g)\n";
+                return 1;
+            }
+        }
+        else if ( arg == "--prefault" )
+        {
+            pageOptions().prefault = true;
+        }
+        else if ( arg == "--align" && ( i + 1 ) < argc )
+        {
+            std::string value = argv[++i];
+            if ( !parseAlignment( value, pageOptions().alignment ) )
+            {
+                std::cerr << "Error: invalid alignment " << value
+                          << " (expected a power of two up to 4096)\n";
+                return 1;
+            }
+        }
+    }
+
+    std::vector< PerfEvent > perfEvents;
+    {
+        PerfRecorder perfRecorder;
+        for ( int e = 0; e < PERF_EVENT_COUNT; ++e )
+        {
+            if ( perfRecorder.counters().isAvailable( perfEventAt( e ) ) )
+                perfEvents.push_back( perfEventAt( e ) );
+        }
+    }
+
+    std::cout
+        << "Benchmarking " << count << " entities, " << iterations
+        << " iterations per layout and dummy size, "
+        << cacheStateName( cache ) << " cache, "
+        << pageDescription() << " pages." << std::endl
+    ;
+
+    auto results = sweepLayouts<
+        FieldLayout::Natural,
+        FieldLayout::HotLast,
+        FieldLayout::Aligned64,
+        FieldLayout::Padded,
+        FieldLayout::Packed
+    >( count, iterations, cache );
 
-    // Run benchmarks with different dummy sizes.
-    flushCache();
-    benchmarkEntity<16>("DummySize 16", count, iterations);
-    flushCache();
-    benchmarkEntity<32>("DummySize 32", count, iterations);
-    flushCache();
-    benchmarkEntity<64>("DummySize 64", count, iterations);
-    flushCache();
-    benchmarkEntity<128>("DummySize 128", count, iterations);
-    flushCache();
-    benchmarkEntity<256>("DummySize 256", count, iterations);
+    writeResultsToCSV( FILENAME, count, results, perfEvents );
+    printPageStats( std::cout );
 
     return 0;
 }
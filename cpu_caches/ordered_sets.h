@@ -0,0 +1,199 @@
+#ifndef __CPU_CACHES__ORDERED_SETS_H__
+#define __CPU_CACHES__ORDERED_SETS_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "../utils/bump_allocator.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory_resource>
+#include <set>
+#include <vector>
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Ordered containers that differ from std::set only in where the nodes live,
+plus a flat alternative without nodes. All are built by inserting keys one
+at a time, in the order given, and answer find( key ) like std::set.
+
+- PmrArenaSet: std::pmr::set over a monotonic_buffer_resource; nodes are
+  bump-allocated by the standard arena, through a virtual call. The arena
+  draws its buffers from a counting upstream, so its footprint is known.
+- PoolSet:     std::set with BumpAllocator; the same idea, inlined.
+- FlatMap:     keys and values in two sorted vectors, searched with
+               std::lower_bound; no per-element allocation at all.
+*/
+
+// Rough size of a std::set node holding _KeyT (three pointers, color, key),
+// used to size the arenas up front.
+template < typename _KeyT >
+constexpr std::size_t SET_NODE_SIZE_ESTIMATE = 4 * sizeof( void * )
+    + ( sizeof( _KeyT ) + sizeof( void * ) - 1 )
+        / sizeof( void * ) * sizeof( void * );
+
+// Upstream resource that forwards to new/delete and keeps the number of
+// bytes currently handed out.
+class CountingResource : public std::pmr::memory_resource
+{
+
+public:
+
+    std::size_t bytes () const { return m_bytes; }
+
+private:
+
+    void * do_allocate ( std::size_t bytes, std::size_t alignment ) override
+    {
+        void * p =
+            std::pmr::new_delete_resource()->allocate( bytes, alignment );
+        m_bytes += bytes;
+        return p;
+    }
+
+    void do_deallocate (
+        void * p, std::size_t bytes, std::size_t alignment
+    ) override
+    {
+        std::pmr::new_delete_resource()->deallocate( p, bytes, alignment );
+        m_bytes -= bytes;
+    }
+
+    bool do_is_equal (
+        std::pmr::memory_resource const & other
+    ) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::size_t m_bytes = 0;
+};
+
+template < typename _KeyT >
+class PmrArenaSet
+{
+
+public:
+
+    template < typename _AllocT >
+    explicit PmrArenaSet ( std::vector< _KeyT, _AllocT > const & keys )
+        :   m_arena(
+                keys.size() * SET_NODE_SIZE_ESTIMATE< _KeyT > + 1, &m_upstream
+            )
+        ,   m_set( &m_arena )
+    {
+        for ( _KeyT key : keys )
+            m_set.insert( key );
+    }
+
+    PmrArenaSet ( PmrArenaSet const & ) = delete;
+    PmrArenaSet & operator = ( PmrArenaSet const & ) = delete;
+
+    auto find ( _KeyT key ) const { return m_set.find( key ); }
+    auto end () const { return m_set.end(); }
+    std::size_t size () const { return m_set.size(); }
+
+    // Bytes the arena got from upstream, which holds all nodes.
+    std::size_t memoryBytes () const { return m_upstream.bytes(); }
+
+private:
+
+    CountingResource m_upstream;
+    std::pmr::monotonic_buffer_resource m_arena;
+    std::pmr::set< _KeyT > m_set;
+};
+
+template < typename _KeyT >
+class PoolSet
+{
+
+public:
+
+    template < typename _AllocT >
+    explicit PoolSet ( std::vector< _KeyT, _AllocT > const & keys )
+        :   m_pool( keys.size() * SET_NODE_SIZE_ESTIMATE< _KeyT > + 1 )
+        ,   m_set( std::less< _KeyT >(), BumpAllocator< _KeyT >( m_pool ) )
+    {
+        for ( _KeyT key : keys )
+            m_set.insert( key );
+    }
+
+    PoolSet ( PoolSet const & ) = delete;
+    PoolSet & operator = ( PoolSet const & ) = delete;
+
+    auto find ( _KeyT key ) const { return m_set.find( key ); }
+    auto end () const { return m_set.end(); }
+    std::size_t size () const { return m_set.size(); }
+
+    // Bytes reserved by the pool, which holds all nodes.
+    std::size_t memoryBytes () const { return m_pool.reserved(); }
+
+private:
+
+    BumpPool m_pool;
+    std::set< _KeyT, std::less< _KeyT >, BumpAllocator< _KeyT > > m_set;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Sorted-vector map. Keys are kept apart from the values, so a search only
+walks the keys. Inserting one at a time would be quadratic, so the
+constructor gathers the pairs and sorts them once, dropping duplicate keys
+(the first value wins, as with std::map::insert).
+find returns a pointer to the value, nullptr if the key is absent.
+*/
+template < typename _KeyT, typename _ValueT >
+class FlatMap
+{
+
+public:
+
+    template < typename _PairsT >
+    explicit FlatMap ( _PairsT const & pairs )
+    {
+        std::vector< std::pair< _KeyT, _ValueT > > sorted(
+            pairs.begin(), pairs.end()
+        );
+        std::stable_sort(
+            sorted.begin(), sorted.end(),
+            [] ( auto const & a, auto const & b ) { return a.first < b.first; }
+        );
+        m_keys.reserve( sorted.size() );
+        m_values.reserve( sorted.size() );
+        for ( auto const & [ key, value ] : sorted )
+        {
+            if ( !m_keys.empty() && m_keys.back() == key )
+                continue;
+            m_keys.push_back( key );
+            m_values.push_back( value );
+        }
+    }
+
+    const _ValueT * find ( _KeyT key ) const
+    {
+        auto it = std::lower_bound( m_keys.begin(), m_keys.end(), key );
+        if ( it == m_keys.end() || *it != key )
+            return nullptr;
+        return &m_values[ it - m_keys.begin() ];
+    }
+
+    std::size_t size () const { return m_keys.size(); }
+
+    std::size_t memoryBytes () const
+    {
+        return m_keys.capacity() * sizeof( _KeyT )
+            + m_values.capacity() * sizeof( _ValueT );
+    }
+
+private:
+
+    std::vector< _KeyT > m_keys;
+    std::vector< _ValueT > m_values;
+};
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __CPU_CACHES__ORDERED_SETS_H__
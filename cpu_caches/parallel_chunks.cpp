@@ -1,156 +1,311 @@
 #include "../utils/benchmark.hpp"
+#include "../utils/bounded_queue.h"
+#include "../utils/mapped_file.h"
+#include "../utils/numa.h"
+#include "../utils/page_allocator.h"
+#include "../utils/parallel_reduce.hpp"
+#include "../utils/system_info.h"
+#include "../utils/thread_pool.h"
+#include "../utils/trace.h"
+#include "../utils/work_stealing.h"
+#include "count_kernels.h"
+#include "incremental_counter.h"
+#include "matrix.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <random>
+#include <sstream>
+#include <string>
 #include <thread>
 #include <vector>
 
 /*----------------------------------------------------------------------------*/
 
-template < typename T >
-inline void doNotOptimize ( T const & value )
-{
-    asm volatile( "" : : "r,m"(value) : "memory" );
-}
+/*
+The counting kernels split the rows into one contiguous chunk per thread and
+run the chunks through an executor (utils/thread_pool.h). The overloads
+without an executor spawn fresh threads on every call.
+countWithLocalCounter records a trace zone for the call and one per worker
+(utils/trace.h), so with --trace the start skew, the stragglers and the join
+show on a timeline.
+*/
 
-/*----------------------------------------------------------------------------*/
+/*
+Per-thread result slots for the false-sharing experiment.
 
-using Matrix = std::vector< std::vector< int > >;
+The value is volatile so that every increment in the counting loop is a real
+store to the slot; otherwise the compiler is free to keep the count in a
+register and the slots are only written once per thread.
+- PackedSlot: adjacent 8-byte slots, several threads share a cache line.
+- InterferenceSlot: one slot per DESTRUCTIVE_INTERFERENCE_SIZE, a cache line.
+- PairedLineSlot: one slot per 128 bytes. Apple cores (and Intel's adjacent
+  line prefetcher) move lines in pairs, so 64 bytes can still interfere.
+*/
+struct PackedSlot
+{
+    volatile long long value = 0;
+};
 
-Matrix generateMatrix ( int rows, int cols )
+struct alignas( DESTRUCTIVE_INTERFERENCE_SIZE ) InterferenceSlot
 {
-    return Matrix( rows, std::vector<int>(cols, 150) );
-}
+    volatile long long value = 0;
+};
 
-std::unique_ptr< Matrix > generateMatrixOnHeap ( int rows, int cols )
+struct alignas( 128 ) PairedLineSlot
 {
-    auto pMatrix = std::make_unique<Matrix>(rows, std::vector<int>(cols, 0));
-    for ( int i = 0; i < rows; ++i )
+    volatile long long value = 0;
+};
+
+// Every thread increments its own slot in `results` for each match.
+template < typename _SlotT, typename _MatrixT, typename _ExecutorT >
+long long countWithSlots (
+    const _MatrixT& matrix, int threshold, int numThreads,
+    _ExecutorT & executor
+)
+{
+    int numRows = ::numRows( matrix );
+    int numCols = ::numCols( matrix );
+
+    std::vector< _SlotT > results( numThreads );
+
+    // Determine chunk size (round up)
+    int chunkSize = (numRows + numThreads - 1) / numThreads;
+
+    executor.run( numThreads, [&] ( int t )
     {
-        for ( int j = 0; j < cols; ++j )
-        {
-            // matrix[i][j] = ((i + j) * 100) % 256;
-            (*pMatrix)[i][j] = ( i % 2 == 1 && j % 2 == 1 ) ? 150 : 100;
+        int startRow = t * chunkSize;
+        int endRow = std::min(startRow + chunkSize, numRows);
+        _SlotT & slot = results[ t ];
+        for (int i = startRow; i < endRow; ++i) {
+            const int * row = rowData( matrix, i );
+            for (int j = 0; j < numCols; ++j) {
+                if (row[j] > threshold)
+                    slot.value = slot.value + 1;
+            }
         }
+    } );
+
+    // Combine partial results
+    long long totalCount = 0;
+    for (const auto & slot : results)
+    {
+        totalCount += slot.value;
     }
-    return pMatrix;
+    return totalCount;
 }
 
-Matrix generateRandomMatrix ( int rows, int cols )
+// Every thread counts into a local variable and writes its slot once.
+template < typename _MatrixT, typename _ExecutorT >
+long long countWithThreadLocalSlots (
+    const _MatrixT& matrix, int threshold, int numThreads,
+    _ExecutorT & executor
+)
 {
-    Matrix matrix(rows, std::vector<int>(cols, 0));
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dist(0, 255);
+    int numRows = ::numRows( matrix );
+    int numCols = ::numCols( matrix );
 
-    for (int i = 0; i < rows; ++i)
+    std::vector< PackedSlot > results( numThreads );
+
+    // Determine chunk size (round up)
+    int chunkSize = (numRows + numThreads - 1) / numThreads;
+
+    executor.run( numThreads, [&] ( int t )
     {
-        for (int j = 0; j < cols; ++j)
-        {
-            matrix[i][j] = dist(gen);
+        int startRow = t * chunkSize;
+        int endRow = std::min(startRow + chunkSize, numRows);
+        long long localCount = 0;
+        for (int i = startRow; i < endRow; ++i) {
+            const int * row = rowData( matrix, i );
+            for (int j = 0; j < numCols; ++j) {
+                if (row[j] > threshold)
+                    ++localCount;
+            }
         }
+        // Write the local count into the container
+        results[ t ].value = localCount;
+    } );
+
+    long long totalCount = 0;
+    for (const auto & slot : results)
+    {
+        totalCount += slot.value;
     }
-    return matrix;
+    return totalCount;
 }
 
-/*----------------------------------------------------------------------------*/
+// Shared, packed container of per-thread counters: the false sharing case.
+template < typename _MatrixT, typename _ExecutorT >
+long long countWithContainer (
+    const _MatrixT& matrix, int threshold, int numThreads,
+    _ExecutorT & executor
+)
+{
+    return countWithSlots< PackedSlot >(
+        matrix, threshold, numThreads, executor
+    );
+}
 
+template < typename _MatrixT >
 long long
-countWithContainer ( const Matrix& matrix, int threshold, int numThreads )
+countWithContainer ( const _MatrixT& matrix, int threshold, int numThreads )
 {
-    int numRows = static_cast<int>(matrix.size());
+    SpawnExecutor executor;
+    return countWithContainer( matrix, threshold, numThreads, executor );
+}
 
-    std::vector<long long> results(numThreads, 0);
+template < typename _MatrixT, typename _ExecutorT >
+long long countWithLocalCounter (
+    const _MatrixT& matrix, int threshold, int numThreads,
+    _ExecutorT & executor
+)
+{
+    int numRows = ::numRows( matrix );
+    int numCols = ::numCols( matrix );
 
-    std::vector<std::thread> threads;
-    threads.reserve( numThreads );
+    std::atomic<long long> globalCount(0);
 
     // Determine chunk size (round up)
-    int chunkSize = (numRows + numThreads - 1) / numThreads;
+    int chunkSize = ( numRows + numThreads - 1 ) / numThreads;
 
-    for (int t = 0; t < numThreads; ++t)
+    TraceZone zone( "countWithLocalCounter", numThreads );
+    executor.run( numThreads, [&] ( int t )
     {
+        TraceZone workerZone( "countWithLocalCounter worker", t );
         int startRow = t * chunkSize;
         int endRow = std::min(startRow + chunkSize, numRows);
-        threads.emplace_back([&, startRow, endRow, t]()
+        long long localCount = 0;
+        for (int i = startRow; i < endRow; ++i)
         {
-            long long localCount = 0;
-            for (int i = startRow; i < endRow; ++i) {
-                for (int value : matrix[i]) {
-                    if (value > threshold)
-                        ++results[ t ];
-                }
+            const int * row = rowData( matrix, i );
+            for ( int j = 0; j < numCols; ++j )
+            {
+                if ( row[ j ] > threshold )
+                    ++localCount;
             }
-            // Write the local count into the container
-            results[ t ] = localCount;
-        });
-    }
-
-    // Wait for all threads to complete
-    for (auto& th : threads)
-    {
-        th.join();
-    }
+        }
+        // Atomically add the local counter to the global counter.
+        globalCount.fetch_add( localCount, std::memory_order_relaxed );
+    } );
 
-    // Combine partial results
-    long long totalCount = 0;
-    for (auto count : results)
-    {
-        totalCount += count;
-    }
-    return totalCount;
+    return globalCount.load();
 }
 
+template < typename _MatrixT >
 long long
-countWithLocalCounter ( const Matrix& matrix, int threshold, int numThreads )
+countWithLocalCounter ( const _MatrixT& matrix, int threshold, int numThreads )
+{
+    SpawnExecutor executor;
+    return countWithLocalCounter( matrix, threshold, numThreads, executor );
+}
+
+// Same partitioning as countWithLocalCounter, but every row is counted by an
+// explicit kernel from count_kernels.h instead of the compiler's loop.
+template < typename _MatrixT, typename _ExecutorT >
+long long countWithLocalCounterKernel (
+    const _MatrixT& matrix, int threshold, int numThreads, RowCountFunc kernel,
+    _ExecutorT & executor
+)
 {
-    int numRows = static_cast< int >( matrix.size() );
+    int numRows = ::numRows( matrix );
+    int numCols = ::numCols( matrix );
 
     std::atomic<long long> globalCount(0);
-    std::vector<std::thread> threads;
-    threads.reserve( numThreads );
 
     // Determine chunk size (round up)
     int chunkSize = ( numRows + numThreads - 1 ) / numThreads;
 
-    for (int t = 0; t < numThreads; ++t )
+    executor.run( numThreads, [&] ( int t )
     {
         int startRow = t * chunkSize;
         int endRow = std::min(startRow + chunkSize, numRows);
+        long long localCount = 0;
+        for (int i = startRow; i < endRow; ++i)
+        {
+            localCount += kernel( rowData( matrix, i ), numCols, threshold );
+        }
+        globalCount.fetch_add( localCount, std::memory_order_relaxed );
+    } );
+
+    return globalCount.load();
+}
+
+template < typename _MatrixT >
+long long countWithLocalCounterKernel (
+    const _MatrixT& matrix, int threshold, int numThreads, RowCountFunc kernel
+)
+{
+    SpawnExecutor executor;
+    return countWithLocalCounterKernel(
+        matrix, threshold, numThreads, kernel, executor
+    );
+}
+
+// Dynamic counterpart of countWithLocalCounter: rows are handed out in
+// ranges of `grain` rows by a WorkStealingScheduler instead of one fixed
+// chunk per thread. grain <= 0 picks WorkStealingScheduler::defaultGrain.
+template < typename _MatrixT, typename _ExecutorT >
+long long countWithLocalCounterStealing (
+    const _MatrixT& matrix, int threshold, int numThreads, int grain,
+    WorkStealingScheduler & scheduler, _ExecutorT & executor
+)
+{
+    int numCols = ::numCols( matrix );
+
+    std::atomic<long long> globalCount(0);
+
+    scheduler.distribute( ::numRows( matrix ), numThreads, grain );
 
-        threads.emplace_back( [&, startRow, endRow, t] ()
+    executor.run( numThreads, [&] ( int t )
+    {
+        long long localCount = 0;
+        scheduler.work( t, [&] ( int startRow, int endRow )
         {
-            long long localCount = 0;
             for (int i = startRow; i < endRow; ++i)
             {
-                for (int value : matrix[i] )
+                const int * row = rowData( matrix, i );
+                for ( int j = 0; j < numCols; ++j )
                 {
-                    if ( value > threshold )
+                    if ( row[ j ] > threshold )
                         ++localCount;
                 }
             }
-            // Atomically add the local counter to the global counter.
-            globalCount.fetch_add( localCount, std::memory_order_relaxed );
         } );
-    }
+        globalCount.fetch_add( localCount, std::memory_order_relaxed );
+    } );
+
+    return globalCount.load();
+}
 
-    for ( auto& th : threads )
+// Single-threaded reference count used to validate the parallel kernels.
+template < typename _MatrixT >
+long long countSerial ( const _MatrixT& matrix, int threshold )
+{
+    long long count = 0;
+    for ( int i = 0; i < numRows( matrix ); ++i )
     {
-        th.join();
+        count += countAboveScalar(
+            rowData( matrix, i ), numCols( matrix ), threshold
+        );
     }
-
-    return globalCount.load();
+    return count;
 }
 
 /*----------------------------------------------------------------------------*/
 
-template <typename Func>
-std::vector<std::vector<double>> runBenchmark (
+template < typename _MatrixT = Matrix, typename Func >
+std::vector<std::vector<double>> runThreadBenchmark (
     int maxThreads, int iterations, int threshold, int rows, int cols,
-    Func benchmarkFunc, const std::string & timerLabel
+    Func benchmarkFunc, const std::string & timerLabel,
+    RowPadding padding = RowPadding::None
 )
 {
     std::vector<std::vector<double>> containerTimes(maxThreads);
@@ -158,11 +313,13 @@ std::vector<std::vector<double>> runBenchmark (
     {
         for (int iter = 0; iter < iterations; ++iter)
         {
-            auto pImage = generateMatrix(rows, cols);
+            auto pImage = generateMatrix< _MatrixT >(rows, cols, padding);
+            PerfScope perf;
             Timer<std::micro> timer(timerLabel);
             auto res = benchmarkFunc(pImage, threshold, numThreads);
             doNotOptimize(res);
             containerTimes[numThreads - 1].push_back(timer.stop());
+            perf.stop();
         }
     }
     return containerTimes;
@@ -170,11 +327,11 @@ std::vector<std::vector<double>> runBenchmark (
 
 /*----------------------------------------------------------------------------*/
 
+// Mean and deviation per thread count, after MAD outlier rejection.
 void computeStatistics (
     const std::vector<std::vector<double>>& times,
     std::vector<double>& avg,
-    std::vector<double>& stdDev,
-    int iterations
+    std::vector<double>& stdDev
 )
 {
     int maxThreads = static_cast<int>(times.size());
@@ -183,24 +340,96 @@ void computeStatistics (
 
     for (int i = 0; i < maxThreads; ++i)
     {
-        double sum = 0.0;
-        for (double t : times[i])
-            sum += t;
-        avg[i] = sum / iterations;
-        stdDev[i] = calculateStdDev(times[i], avg[i]);
+        BenchmarkStats stats = computeBenchmarkStats( times[i] );
+        avg[i] = stats.mean;
+        stdDev[i] = stats.stdDev;
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+// One measured curve: per-thread-count average and deviation.
+// Written to the CSV as the "<name>Avg" and "<name>Std" rows, followed by a
+// "<name><metric>" row for every extra metric. With a PerfRecorder active,
+// the hardware counters are metrics too ("<name>Cycles", ...).
+struct BenchmarkSeries
+{
+    std::string name;
+    std::vector<double> avg;
+    std::vector<double> std;
+    std::vector< std::pair< std::string, std::vector<double> > > metrics;
+};
+
+// Order statistics per thread count, as "<name>Median", "<name>P90",
+// "<name>P99" and "<name>Min" metrics.
+void appendRobustMetrics (
+    BenchmarkSeries & series,
+    const std::vector<std::vector<double>>& times
+)
+{
+    std::vector<double> median, p90, p99, minimum;
+    for ( const auto & threadTimes : times )
+    {
+        BenchmarkStats stats = computeBenchmarkStats( threadTimes );
+        median.push_back( stats.median );
+        p90.push_back( stats.p90 );
+        p99.push_back( stats.p99 );
+        minimum.push_back( stats.min );
+    }
+    series.metrics.emplace_back( "Median", median );
+    series.metrics.emplace_back( "P90", p90 );
+    series.metrics.emplace_back( "P99", p99 );
+    series.metrics.emplace_back( "Min", minimum );
+}
+
+// Move the counters recorded since the last series into per-thread-count
+// "<Event>" metrics. Events the machine cannot count are left out.
+void appendPerfMetrics ( BenchmarkSeries & series, int iterations )
+{
+    PerfRecorder * recorder = PerfRecorder::active();
+    if ( !recorder )
+        return;
+
+    auto averages = recorder->groupAverages( iterations );
+    recorder->clear();
+    for ( int e = 0; e < PERF_EVENT_COUNT; ++e )
+    {
+        PerfEvent event = perfEventAt( e );
+        if ( !recorder->counters().isAvailable( event ) )
+            continue;
+        std::vector< double > values;
+        for ( const PerfCounts & counts : averages )
+            values.push_back( counts[ event ] );
+        series.metrics.emplace_back( perfEventName( event ), values );
     }
 }
 
+BenchmarkSeries makeSeries (
+    const std::string& name,
+    const std::vector<std::vector<double>>& times,
+    int iterations
+)
+{
+    BenchmarkSeries series{ name, {}, {}, {} };
+    computeStatistics(times, series.avg, series.std);
+    appendRobustMetrics( series, times );
+    appendPerfMetrics( series, iterations );
+    return series;
+}
+
 /*----------------------------------------------------------------------------*/
 
+// Name of the machine the CSV files are tagged with, e.g. "MacOsM1".
+std::string archName ()
+{
+    return machineName();
+}
+
 void writeResultsToCSV (
-    const std::string& arch,
-    const std::vector<double>& containerAvg,
-    const std::vector<double>& containerStd,
-    const std::vector<double>& localAvg,
-    const std::vector<double>& localStd)
+    const std::string& filename,
+    const std::vector<BenchmarkSeries>& series
+)
 {
-    std::string filename = "benchmarks_" + arch + ".csv";
     std::ofstream ofs(filename);
     if ( !ofs )
     {
@@ -210,138 +439,2142 @@ void writeResultsToCSV (
         return;
     }
 
-    int maxThreads = static_cast<int>(containerAvg.size());
+    int maxThreads =
+        series.empty() ? 0 : static_cast<int>(series.front().avg.size());
 
-    // Write CSV header
+    // Write CSV header, then the pages the flat matrices were placed on.
     ofs << "ThreadCount";
     for (int t = 1; t <= maxThreads; ++t)
         ofs << "," << t;
+    ofs << "\nPages";
+    for (int t = 1; t <= maxThreads; ++t)
+        ofs << "," << pageDescription();
     ofs << "\n";
 
     // Write rows for each metric.
-    ofs << "ContainerAvg";
-    for (double v : containerAvg)
-        ofs << "," << v;
-    ofs << "\n";
-
-    ofs << "ContainerStd";
-    for (double v : containerStd)
-        ofs << "," << v;
-    ofs << "\n";
+    for ( const auto& s : series )
+    {
+        ofs << s.name << "Avg";
+        for (double v : s.avg)
+            ofs << "," << v;
+        ofs << "\n";
 
-    ofs << "LocalCounterAvg";
-    for (double v : localAvg)
-        ofs << "," << v;
-    ofs << "\n";
+        ofs << s.name << "Std";
+        for (double v : s.std)
+            ofs << "," << v;
+        ofs << "\n";
 
-    ofs << "LocalCounterStd";
-    for (double v : localStd)
-        ofs << "," << v;
-    ofs << "\n";
+        for ( const auto& metric : s.metrics )
+        {
+            ofs << s.name << metric.first;
+            for (double v : metric.second)
+                ofs << "," << v;
+            ofs << "\n";
+        }
+    }
 
     ofs.close();
     std::cout << "Benchmark results written to " << filename << std::endl;
+    printPageStats( std::cout );
 }
 
 /*----------------------------------------------------------------------------*/
 
-// compute the average duration (in microseconds),
-// and then write the results to a CSV file.
-void runBenchmarks (
-        const Matrix& image
+enum class MatrixLayout
+{
+        Nested      // std::vector< std::vector< int > >
+    ,   Flat        // FlatMatrix, rows packed
+    ,   PaddedFlat  // FlatMatrix, rows padded to a cache line
+};
+
+// Parse the --layout value: nested, flat, padded or all. Returns false on an
+// unknown value and leaves layouts unchanged.
+bool parseLayouts (
+    const std::string & value, std::vector< MatrixLayout > & layouts
+)
+{
+    if ( value == "nested" )
+        layouts = { MatrixLayout::Nested };
+    else if ( value == "flat" )
+        layouts = { MatrixLayout::Flat };
+    else if ( value == "padded" )
+        layouts = { MatrixLayout::PaddedFlat };
+    else if ( value == "all" )
+    {
+        layouts = {
+            MatrixLayout::Nested, MatrixLayout::Flat, MatrixLayout::PaddedFlat
+        };
+    }
+    else
+        return false;
+    return true;
+}
+
+// Parse the --kernels value: none, best, all or a single kernel name.
+// Returns false on a name that is unknown or not available on this CPU, and
+// leaves kernels unchanged.
+bool parseKernels (
+    const std::string & value, std::vector< CountKernel > & kernels
+)
+{
+    std::vector< CountKernel > available = availableCountKernels();
+    if ( value == "none" )
+        kernels.clear();
+    else if ( value == "best" )
+        kernels = { available.back() };
+    else if ( value == "all" )
+        kernels = available;
+    else
+    {
+        auto kernel = std::find_if(
+            available.begin(), available.end(),
+            [ & ] ( const CountKernel & k ) { return value == k.name; }
+        );
+        if ( kernel == available.end() )
+            return false;
+        kernels = { *kernel };
+    }
+    return true;
+}
+
+enum class ExecutionMode
+{
+        Spawn   // std::thread per chunk, created and joined on every call
+    ,   Pool    // persistent ThreadPool shared by all calls
+};
+
+// Parse the --exec value: spawn, pool or both. Returns false on an unknown
+// value and leaves executions unchanged.
+bool parseExecutionModes (
+    const std::string & value, std::vector< ExecutionMode > & executions
+)
+{
+    if ( value == "spawn" )
+        executions = { ExecutionMode::Spawn };
+    else if ( value == "pool" )
+        executions = { ExecutionMode::Pool };
+    else if ( value == "both" )
+        executions = { ExecutionMode::Spawn, ExecutionMode::Pool };
+    else
+        return false;
+    return true;
+}
+
+enum class ScheduleMode
+{
+        Static  // one rounded-up chunk of rows per thread
+    ,   Steal   // grain-sized row ranges with work stealing
+};
+
+// Parse the --schedule value: static, steal or both. Returns false on an
+// unknown value and leaves schedules unchanged.
+bool parseScheduleModes (
+    const std::string & value, std::vector< ScheduleMode > & schedules
+)
+{
+    if ( value == "static" )
+        schedules = { ScheduleMode::Static };
+    else if ( value == "steal" )
+        schedules = { ScheduleMode::Steal };
+    else if ( value == "both" )
+        schedules = { ScheduleMode::Static, ScheduleMode::Steal };
+    else
+        return false;
+    return true;
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Options of the "benchmark" mode.
+struct BenchmarkOptions
+{
+    int maxThreads = 30;
+    int iterations = 5;
+    int rows = 1000;
+    int cols = 1000;
+    std::vector< MatrixLayout > layouts{ MatrixLayout::Nested };
+    std::vector< CountKernel > kernels;
+    std::vector< ExecutionMode > executions{ ExecutionMode::Spawn };
+    std::vector< ScheduleMode > schedules{ ScheduleMode::Static };
+    // Rows per work-stealing range, <= 0 for the scheduler's default.
+    int grain = 0;
+    bool pinThreads = true;
+    // Streaming mode: raw int32 matrix file, rows per tile (<= 0 for about
+    // 64 MB tiles) and whether to drop the page cache before every pass.
+    std::string file;
+    int tileRows = 0;
+    bool coldCache = false;
+    // Pipelined mode: frames per stream and frames in flight.
+    int frames = 200;
+    int depth = 4;
+    // Delta mode: fractions of dirty tiles, and the tile width (the height
+    // is tileRows); <= 0 for the default 32 x 32, i.e. 1024 tiles on the
+    // default matrix, so the default fractions are whole tile counts.
+    std::vector< double > dirtyFractions{ 0.001, 0.01, 0.1 };
+    int tileCols = 0;
+    // Chrome trace JSON written at exit, empty for no tracing.
+    std::string traceFile;
+};
+
+bool hasSchedule ( const BenchmarkOptions & options, ScheduleMode mode )
+{
+    return std::find(
+        options.schedules.begin(), options.schedules.end(), mode
+    ) != options.schedules.end();
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Static-split series of runLayoutBenchmarks.
+template < typename _MatrixT, typename _ExecutorT >
+void runStaticBenchmarks (
+        const std::string & prefix
+    ,   const std::string & suffix
+    ,   RowPadding padding
     ,   int threshold
-    ,   int maxThreads = 10
-    ,   int iterations = 20
-    ,   int rows = 1000
-    ,   int cols = 1000
+    ,   const BenchmarkOptions & options
+    ,   _ExecutorT & executor
+    ,   std::vector< BenchmarkSeries > & series
 )
 {
-    // Run benchmarks.
-    auto containerTimes = runBenchmark(
+    const int maxThreads = options.maxThreads;
+    const int iterations = options.iterations;
+    const int rows = options.rows;
+    const int cols = options.cols;
+
+    auto containerTimes = runThreadBenchmark< _MatrixT >(
         maxThreads, iterations, threshold, rows, cols,
-        countWithContainer, "countWithContainer"
+        [ &executor ] ( const _MatrixT & matrix, int threshold, int numThreads )
+        {
+            return countWithContainer(
+                matrix, threshold, numThreads, executor
+            );
+        },
+        prefix + "countWithContainer" + suffix,
+        padding
     );
+    series.push_back( makeSeries(
+        prefix + "Container" + suffix, containerTimes, iterations
+    ) );
 
-    auto localTimes = runBenchmark(
+    auto localTimes = runThreadBenchmark< _MatrixT >(
         maxThreads, iterations, threshold, rows, cols,
-        countWithLocalCounter, "countWithLocalCounter"
+        [ &executor ] ( const _MatrixT & matrix, int threshold, int numThreads )
+        {
+            return countWithLocalCounter(
+                matrix, threshold, numThreads, executor
+            );
+        },
+        prefix + "countWithLocalCounter" + suffix,
+        padding
     );
+    series.push_back( makeSeries(
+        prefix + "LocalCounter" + suffix, localTimes, iterations
+    ) );
+
+    for ( const auto & kernel : options.kernels )
+    {
+        RowCountFunc func = kernel.func;
+        auto kernelTimes = runThreadBenchmark< _MatrixT >(
+            maxThreads, iterations, threshold, rows, cols,
+            [ func, &executor ] (
+                const _MatrixT & matrix, int threshold, int numThreads
+            )
+            {
+                return countWithLocalCounterKernel(
+                    matrix, threshold, numThreads, func, executor
+                );
+            },
+            prefix + "countWithLocalCounter" + kernel.name + suffix,
+            padding
+        );
+        series.push_back( makeSeries(
+            prefix + "LocalCounter" + kernel.name + suffix,
+            kernelTimes, iterations
+        ) );
+    }
+}
+
+/*
+Benchmark both counting approaches for one matrix layout and executor and
+append the series to `series`. Series are named
+"<prefix>Container<suffix>", "<prefix>LocalCounter<suffix>" and, for every
+explicit kernel, "<prefix>LocalCounter<kernel><suffix>". The work-stealing
+schedule adds "<prefix>LocalCounterSteal<suffix>".
+*/
+template < typename _MatrixT, typename _ExecutorT >
+void runLayoutBenchmarks (
+        const std::string & prefix
+    ,   const std::string & suffix
+    ,   RowPadding padding
+    ,   int threshold
+    ,   const BenchmarkOptions & options
+    ,   _ExecutorT & executor
+    ,   std::vector< BenchmarkSeries > & series
+)
+{
+    const int maxThreads = options.maxThreads;
+    const int iterations = options.iterations;
+    const int rows = options.rows;
+    const int cols = options.cols;
 
-    // Compute statistics.
-    std::vector<double> containerAvg, containerStd;
-    std::vector<double> localAvg, localStd;
-    computeStatistics(containerTimes, containerAvg, containerStd, iterations);
-    computeStatistics(localTimes, localAvg, localStd, iterations);
+    if ( hasSchedule( options, ScheduleMode::Static ) )
+    {
+        runStaticBenchmarks< _MatrixT >(
+            prefix, suffix, padding, threshold, options, executor, series
+        );
+    }
 
-    // Write results.
-    std::string arch = "MacOsM1"; // TODO: determine automaticlly.
-    writeResultsToCSV(arch, containerAvg, containerStd, localAvg, localStd);
+    if ( hasSchedule( options, ScheduleMode::Steal ) )
+    {
+        WorkStealingScheduler scheduler( maxThreads );
+        const int grain = options.grain;
+        auto stealTimes = runThreadBenchmark< _MatrixT >(
+            maxThreads, iterations, threshold, rows, cols,
+            [ &executor, &scheduler, grain ] (
+                const _MatrixT & matrix, int threshold, int numThreads
+            )
+            {
+                return countWithLocalCounterStealing(
+                    matrix, threshold, numThreads, grain, scheduler, executor
+                );
+            },
+            prefix + "countWithLocalCounterSteal" + suffix,
+            padding
+        );
+        series.push_back( makeSeries(
+            prefix + "LocalCounterSteal" + suffix, stealTimes, iterations
+        ) );
+    }
+}
+
+// Run every selected layout through one executor.
+template < typename _ExecutorT >
+void runExecutorBenchmarks (
+        const std::string & suffix
+    ,   int threshold
+    ,   const BenchmarkOptions & options
+    ,   _ExecutorT & executor
+    ,   std::vector< BenchmarkSeries > & series
+)
+{
+    for ( MatrixLayout layout : options.layouts )
+    {
+        switch ( layout )
+        {
+            case MatrixLayout::Nested:
+                runLayoutBenchmarks< Matrix >(
+                    "", suffix, RowPadding::None,
+                    threshold, options, executor, series
+                );
+                break;
+            case MatrixLayout::Flat:
+                runLayoutBenchmarks< FlatMatrix >(
+                    "Flat", suffix, RowPadding::None,
+                    threshold, options, executor, series
+                );
+                break;
+            case MatrixLayout::PaddedFlat:
+                runLayoutBenchmarks< FlatMatrix >(
+                    "PaddedFlat", suffix, RowPadding::CacheLine,
+                    threshold, options, executor, series
+                );
+                break;
+        }
+    }
 }
 
 /*----------------------------------------------------------------------------*/
 
-int main ( int argc, char* argv[] )
+// compute the average duration (in microseconds),
+// and then write the results to a CSV file.
+void runBenchmarks (
+        const Matrix& image
+    ,   int threshold
+    ,   const BenchmarkOptions & options
+)
 {
-    const int defaultRows = 1000;
-    const int defaultCols = 1000;
-    const int defaultMaxThreads = 30;
-    const int threshold = 128;
-    const int defaultIterations = 5;
+    std::vector< BenchmarkSeries > series;
 
-    // Check if benchmark mode is requested.
-    if (argc > 1 && std::string(argv[1]) == "benchmark" )
+    // Run benchmarks. All layouts and executors are swept over the same
+    // thread counts, so their rows in the CSV are directly comparable.
+    for ( ExecutionMode execution : options.executions )
     {
-        // Use default values.
-        int maxThreads = defaultMaxThreads;
-        int rows = defaultRows;
-        int cols = defaultCols;
-        int iterations = defaultIterations;
-
-        // Parse named parameters.
-        for (int i = 2; i < argc; ++i)
+        switch ( execution )
         {
-            std::string arg = argv[i];
-            if ( arg == "--threads" && (i + 1) < argc )
+            case ExecutionMode::Spawn:
             {
-                maxThreads = std::stoi(argv[++i]);
+                SpawnExecutor executor;
+                runExecutorBenchmarks(
+                    "", threshold, options, executor, series
+                );
+                break;
             }
-            else if ( arg == "--rows" && (i + 1) < argc )
+            case ExecutionMode::Pool:
             {
-                rows = std::stoi(argv[++i]);
+                ThreadPool pool( options.maxThreads, options.pinThreads );
+                runExecutorBenchmarks(
+                    "Pool", threshold, options, pool, series
+                );
+                break;
             }
-            else if ( arg == "--cols" && (i + 1) < argc )
+        }
+    }
+
+    // Write results.
+    writeResultsToCSV("benchmarks_" + archName() + ".csv", series);
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+False-sharing suite: the same static split with four result-slot layouts,
+measured over 1..maxThreads threads on one FlatMatrix. Every result is
+checked against countSerial. Besides the time, every layout reports its
+throughput in matrix elements per second (the "<layout>Throughput" row).
+Returns false if any layout produced a wrong count.
+*/
+template < typename _ExecutorT >
+bool runFalseSharingBenchmarks (
+        const std::string & suffix
+    ,   int threshold
+    ,   const BenchmarkOptions & options
+    ,   _ExecutorT & executor
+    ,   std::vector< BenchmarkSeries > & series
+)
+{
+    const FlatMatrix matrix =
+        generateMatrix< FlatMatrix >( options.rows, options.cols );
+    const long long expected = countSerial( matrix, threshold );
+    const double elements =
+        static_cast< double >( options.rows ) * options.cols;
+    bool allCorrect = true;
+
+    auto measure = [ & ] ( const std::string & name, auto count )
+    {
+        std::vector< std::vector< double > > times( options.maxThreads );
+        for ( int numThreads = 1; numThreads <= options.maxThreads;
+              ++numThreads )
+        {
+            for ( int iter = 0; iter < options.iterations; ++iter )
             {
-                cols = std::stoi(argv[++i]);
+                PerfScope perf;
+                Timer< std::micro > timer( name );
+                long long result = count( matrix, threshold, numThreads );
+                times[ numThreads - 1 ].push_back( timer.stop() );
+                perf.stop();
+                if ( result != expected )
+                {
+                    std::cerr
+                        << name << suffix << " with " << numThreads
+                        << " threads counted " << result << ", expected "
+                        << expected << "\n"
+                    ;
+                    allCorrect = false;
+                }
             }
-            else if ( arg == "--rowscols" && (i + 1) < argc )
+        }
+
+        BenchmarkSeries s =
+            makeSeries( name + suffix, times, options.iterations );
+        std::vector< double > throughput;
+        for ( double avg : s.avg )
+            throughput.push_back( elements / ( avg * 1e-6 ) );
+        s.metrics.emplace_back( "Throughput", throughput );
+        series.push_back( s );
+    };
+
+    measure( "Packed", [ & ] ( const FlatMatrix & m, int th, int n ) {
+        return countWithSlots< PackedSlot >( m, th, n, executor );
+    } );
+    measure( "Interference", [ & ] ( const FlatMatrix & m, int th, int n ) {
+        return countWithSlots< InterferenceSlot >( m, th, n, executor );
+    } );
+    measure( "PairedLine", [ & ] ( const FlatMatrix & m, int th, int n ) {
+        return countWithSlots< PairedLineSlot >( m, th, n, executor );
+    } );
+    measure( "ThreadLocal", [ & ] ( const FlatMatrix & m, int th, int n ) {
+        return countWithThreadLocalSlots( m, th, n, executor );
+    } );
+
+    return allCorrect;
+}
+
+// Run the false-sharing suite for every selected executor and write
+// false_sharing_<arch>.csv.
+bool runFalseSharingSuite ( int threshold, const BenchmarkOptions & options )
+{
+    std::cout
+        << "Slot sizes: packed " << sizeof( PackedSlot )
+        << ", interference " << sizeof( InterferenceSlot )
+        << ", paired line " << sizeof( PairedLineSlot ) << " bytes\n"
+    ;
+
+    std::vector< BenchmarkSeries > series;
+    bool allCorrect = true;
+    for ( ExecutionMode execution : options.executions )
+    {
+        switch ( execution )
+        {
+            case ExecutionMode::Spawn:
             {
-                rows = std::stoi(argv[++i]);
-                cols = std::stoi(argv[i]);
+                SpawnExecutor executor;
+                allCorrect &= runFalseSharingBenchmarks(
+                    "", threshold, options, executor, series
+                );
+                break;
             }
-            else if ( arg == "--iterations" && (i + 1) < argc )
+            case ExecutionMode::Pool:
             {
-                iterations = std::stoi(argv[++i]);
+                ThreadPool pool( options.maxThreads, options.pinThreads );
+                allCorrect &= runFalseSharingBenchmarks(
+                    "Pool", threshold, options, pool, series
+                );
+                break;
             }
         }
+    }
 
-        std::cout
-            << "Running benchmarks with rows=" << rows
-            << ", cols=" << cols
-            << ", maxThreads=" << maxThreads
-            << ", iterations=" << iterations << std::endl
-        ;
+    writeResultsToCSV( "false_sharing_" + archName() + ".csv", series );
+    return allCorrect;
+}
 
-        // Generate a deterministic matrix.
-        Matrix image = generateMatrix(rows, cols);
+/*----------------------------------------------------------------------------*/
 
-        // Run the benchmarks.
-        runBenchmarks( image, threshold, maxThreads, iterations, rows, cols );
+// Write a rows x cols matrix of random values in [0, 255] as raw,
+// native-endian int32, one row at a time so any size fits in memory.
+bool writeMatrixFile ( const std::string & path, int rows, int cols )
+{
+    std::ofstream ofs( path, std::ios::binary );
+    if ( !ofs )
+    {
+        std::cerr << "Error: cannot open file " << path << " for writing.\n";
+        return false;
     }
-    else
+
+    std::mt19937 gen( 42 );
+    std::uniform_int_distribution<> dist( 0, 255 );
+    std::vector< int > row( cols );
+    for ( int i = 0; i < rows; ++i )
     {
-        const int numThreads = 10;
+        for ( int & value : row )
+            value = dist( gen );
+        ofs.write(
+            reinterpret_cast< const char * >( row.data() ),
+            static_cast< std::streamsize >( row.size() * sizeof( int ) )
+        );
+    }
 
-        Matrix image = generateMatrix( defaultRows, defaultCols );
+    if ( !ofs )
+    {
+        std::cerr << "Error: failed writing " << path << ".\n";
+        return false;
+    }
+    std::cout << "Matrix file written to " << path << std::endl;
+    return true;
+}
+
+// Rows per streamed tile: the requested count, or about 64 MB worth.
+int streamTileRows ( const BenchmarkOptions & options, int rows )
+{
+    if ( options.tileRows > 0 )
+        return std::min( options.tileRows, rows );
+    std::size_t rowBytes = static_cast< std::size_t >( options.cols ) * 4;
+    std::size_t tileRows = ( std::size_t( 64 ) << 20 ) / rowBytes;
+    return static_cast< int >(
+        std::clamp< std::size_t >(
+            tileRows, 1, static_cast< std::size_t >( rows )
+        )
+    );
+}
+
+/*
+Count a memory-mapped matrix file tile by tile. While a tile is counted the
+next one is prefetched with MADV_WILLNEED; counted tiles are released with
+MADV_DONTNEED so the resident set stays around two tiles for any file size.
+*/
+template < typename _ExecutorT >
+long long countMappedFile (
+        const MappedFile & file
+    ,   int rows
+    ,   int cols
+    ,   int tileRows
+    ,   int threshold
+    ,   int numThreads
+    ,   _ExecutorT & executor
+)
+{
+    const int * base = reinterpret_cast< const int * >( file.data() );
+    const std::size_t rowBytes = static_cast< std::size_t >( cols ) * 4;
+    long long total = 0;
+    int count = 0;
+    for ( int first = 0; first < rows; first += count )
+    {
+        count = std::min( tileRows, rows - first );
+        if ( first + count < rows )
+            file.willNeed( ( first + count ) * rowBytes, tileRows * rowBytes );
+
+        MatrixView tile{
+            base + static_cast< std::size_t >( first ) * cols,
+            count, cols, static_cast< std::size_t >( cols )
+        };
+        total += countWithLocalCounter( tile, threshold, numThreads, executor );
+
+        file.dontNeed( first * rowBytes, count * rowBytes );
+    }
+    return total;
+}
+
+/*
+Streaming suite: sweep 1..maxThreads over the memory-mapped file and over an
+in-memory reference that counts one resident tile-sized FlatMatrix as many
+times as the file has tiles, i.e. the same number of bytes without I/O.
+Both series get a "GBps" row. Returns false if the thread counts disagree.
+*/
+template < typename _ExecutorT >
+bool runMappedBenchmarks (
+        const std::string & suffix
+    ,   int threshold
+    ,   const BenchmarkOptions & options
+    ,   const MappedFile & file
+    ,   int rows
+    ,   _ExecutorT & executor
+    ,   std::vector< BenchmarkSeries > & series
+)
+{
+    using MappedTimer = Timer< std::milli >;
+
+    const int cols = options.cols;
+    const std::size_t rowBytes = static_cast< std::size_t >( cols ) * 4;
+    const int tileRows = streamTileRows( options, rows );
+    const int numTiles = ( rows + tileRows - 1 ) / tileRows;
+    const double bytes = static_cast< double >( rows ) * rowBytes;
+
+    auto addSeries = [ & ] (
+        const std::string & name, std::vector< std::vector< double > > & times
+    )
+    {
+        BenchmarkSeries s =
+            makeSeries( name + suffix, times, options.iterations );
+        std::vector< double > gbps;
+        for ( double avg : s.avg )
+            gbps.push_back( bytes / ( avg * 1e-3 ) / 1e9 );
+        s.metrics.emplace_back( "GBps", gbps );
+        series.push_back( s );
+    };
+
+    bool consistent = true;
+    long long expected = -1;
+    std::vector< std::vector< double > > mappedTimes( options.maxThreads );
+    for ( int numThreads = 1; numThreads <= options.maxThreads; ++numThreads )
+    {
+        for ( int iter = 0; iter < options.iterations; ++iter )
+        {
+            if ( options.coldCache )
+                file.dropPageCache();
+            PerfScope perf;
+            MappedTimer timer( "countMappedFile" );
+            long long result = countMappedFile(
+                file, rows, cols, tileRows, threshold, numThreads, executor
+            );
+            mappedTimes[ numThreads - 1 ].push_back( timer.stop() );
+            perf.stop();
+            if ( expected < 0 )
+                expected = result;
+            consistent &= result == expected;
+        }
+    }
+    addSeries( "Mmap", mappedTimes );
+
+    const FlatMatrix tile =
+        generateRandomMatrix< FlatMatrix >( tileRows, cols );
+    std::vector< std::vector< double > > memoryTimes( options.maxThreads );
+    for ( int numThreads = 1; numThreads <= options.maxThreads; ++numThreads )
+    {
+        for ( int iter = 0; iter < options.iterations; ++iter )
+        {
+            PerfScope perf;
+            MappedTimer timer( "countInMemory" );
+            long long result = 0;
+            for ( int t = 0; t < numTiles; ++t )
+                result += countWithLocalCounter(
+                    tile, threshold, numThreads, executor
+                );
+            doNotOptimize( result );
+            memoryTimes[ numThreads - 1 ].push_back( timer.stop() );
+            perf.stop();
+        }
+    }
+    addSeries( "InMemory", memoryTimes );
+
+    if ( !consistent )
+        std::cerr << "Error: mapped counts differ between thread counts.\n";
+    return consistent;
+}
+
+// Map options.file and run the streaming suite for every selected executor,
+// writing mmap_<arch>.csv.
+bool runMappedSuite ( int threshold, const BenchmarkOptions & options )
+{
+    MappedFile file( options.file );
+    if ( !file.isValid() )
+        return false;
+
+    const std::size_t rowBytes =
+        static_cast< std::size_t >( options.cols ) * 4;
+    const std::size_t fileRows = file.size() / rowBytes;
+    if ( fileRows == 0 )
+    {
+        std::cerr
+            << "Error: " << options.file << " is smaller than one row.\n";
+        return false;
+    }
+    // Rows are counted with int indices, as in every other mode.
+    if ( fileRows > static_cast< std::size_t >(
+                        std::numeric_limits< int >::max() ) )
+    {
+        std::cerr
+            << "Error: " << options.file << " has " << fileRows
+            << " rows, more than the " << std::numeric_limits< int >::max()
+            << " supported.\n"
+        ;
+        return false;
+    }
+    const int rows = static_cast< int >( fileRows );
+    if ( file.size() % rowBytes != 0 )
+    {
+        std::cerr
+            << "Warning: ignoring " << file.size() % rowBytes
+            << " trailing bytes of " << options.file << ".\n"
+        ;
+    }
+    std::cout
+        << "Streaming " << rows << " x " << options.cols << " ("
+        << file.size() / 1e9 << " GB) in tiles of "
+        << streamTileRows( options, rows ) << " rows" << std::endl
+    ;
+
+    std::vector< BenchmarkSeries > series;
+    bool consistent = true;
+    for ( ExecutionMode execution : options.executions )
+    {
+        switch ( execution )
+        {
+            case ExecutionMode::Spawn:
+            {
+                SpawnExecutor executor;
+                consistent &= runMappedBenchmarks(
+                    "", threshold, options, file, rows, executor, series
+                );
+                break;
+            }
+            case ExecutionMode::Pool:
+            {
+                ThreadPool pool( options.maxThreads, options.pinThreads );
+                consistent &= runMappedBenchmarks(
+                    "Pool", threshold, options, file, rows, pool, series
+                );
+                break;
+            }
+        }
+    }
+
+    writeResultsToCSV( "mmap_" + archName() + ".csv", series );
+    return consistent;
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Element types of the reduction benchmark: CSV name and the value range the
+// random data is drawn from.
+template < typename _ElementT > struct ReduceTraits;
+
+template <> struct ReduceTraits< std::uint8_t >
+{
+    static constexpr const char * name = "U8";
+    static constexpr double maxValue = 255;
+};
+
+template <> struct ReduceTraits< std::uint16_t >
+{
+    static constexpr const char * name = "U16";
+    static constexpr double maxValue = 65535;
+};
+
+template <> struct ReduceTraits< int >
+{
+    static constexpr const char * name = "I32";
+    static constexpr double maxValue = 255;
+};
+
+template <> struct ReduceTraits< float >
+{
+    static constexpr const char * name = "F32";
+    static constexpr double maxValue = 1;
+};
+
+template < typename _AccT >
+bool sameResult ( _AccT const & a, _AccT const & b )
+{
+    return a == b;
+}
+
+// Floating-point sums depend on the summation order, i.e. the thread count.
+inline bool sameResult ( double a, double b )
+{
+    return std::abs( a - b ) <= 1e-9 * std::max( std::abs( a ), 1.0 );
+}
+
+/*
+Sweep one reducer over 1..maxThreads and append "<Type><label>" with "GBps"
+and "ElementsPerSec" rows. Times are in microseconds. Returns false
+if a thread count disagrees with the single-threaded result.
+*/
+template < typename _ElementT, typename _ReducerT, typename _ExecutorT >
+bool runReduction (
+        const std::string & label
+    ,   const std::string & suffix
+    ,   const std::vector< _ElementT > & data
+    ,   _ReducerT const & reducer
+    ,   const BenchmarkOptions & options
+    ,   _ExecutorT & executor
+    ,   std::vector< BenchmarkSeries > & series
+)
+{
+    const std::string name = ReduceTraits< _ElementT >::name + label + suffix;
+
+    SpawnExecutor serial;
+    const auto expected =
+        parallelReduce( serial, 1, data.data(), data.size(), reducer );
+    bool correct = true;
+
+    std::vector< std::vector< double > > times( options.maxThreads );
+    for ( int numThreads = 1; numThreads <= options.maxThreads; ++numThreads )
+    {
+        for ( int iter = 0; iter < options.iterations; ++iter )
+        {
+            PerfScope perf;
+            Timer< std::micro > timer( name );
+            auto result = parallelReduce(
+                executor, numThreads, data.data(), data.size(), reducer
+            );
+            doNotOptimize( result );
+            times[ numThreads - 1 ].push_back( timer.stop() );
+            perf.stop();
+            if ( !sameResult( result, expected ) )
+            {
+                std::cerr
+                    << name << " with " << numThreads
+                    << " threads differs from the serial result\n"
+                ;
+                correct = false;
+            }
+        }
+    }
+
+    BenchmarkSeries s = makeSeries( name, times, options.iterations );
+    const double elements = static_cast< double >( data.size() );
+    std::vector< double > gbps, perSecond;
+    for ( double avg : s.avg )
+    {
+        perSecond.push_back( elements / ( avg * 1e-6 ) );
+        gbps.push_back( perSecond.back() * sizeof( _ElementT ) / 1e9 );
+    }
+    s.metrics.emplace_back( "GBps", gbps );
+    s.metrics.emplace_back( "ElementsPerSec", perSecond );
+    series.push_back( s );
+    return correct;
+}
+
+// All reductions for one element type, over rows * cols random elements.
+template < typename _ElementT, typename _ExecutorT >
+bool runTypedReductions (
+        const std::string & suffix
+    ,   const BenchmarkOptions & options
+    ,   _ExecutorT & executor
+    ,   std::vector< BenchmarkSeries > & series
+)
+{
+    using Traits = ReduceTraits< _ElementT >;
+
+    std::vector< _ElementT > data(
+        static_cast< std::size_t >( options.rows ) * options.cols
+    );
+    std::mt19937 gen( 42 );
+    std::uniform_real_distribution<> dist( 0, Traits::maxValue );
+    for ( auto & value : data )
+        value = static_cast< _ElementT >( dist( gen ) );
+
+    const Above< _ElementT > above{
+        static_cast< _ElementT >( Traits::maxValue / 2 )
+    };
+
+    bool correct = true;
+    correct &= runReduction(
+        "CountIf", suffix, data, CountIf< Above< _ElementT > >{ above },
+        options, executor, series
+    );
+    correct &= runReduction(
+        "MaskedSum", suffix, data,
+        MaskedSum< _ElementT, Above< _ElementT > >{ above },
+        options, executor, series
+    );
+    correct &= runReduction(
+        "MinMax", suffix, data, MinMax< _ElementT >{},
+        options, executor, series
+    );
+    correct &= runReduction(
+        "Histogram", suffix, data,
+        Histogram< _ElementT, 16 >::over(
+            0, static_cast< _ElementT >( Traits::maxValue )
+        ),
+        options, executor, series
+    );
+    return correct;
+}
+
+template < typename _ExecutorT >
+bool runReduceBenchmarks (
+        const std::string & suffix
+    ,   const BenchmarkOptions & options
+    ,   _ExecutorT & executor
+    ,   std::vector< BenchmarkSeries > & series
+)
+{
+    bool correct = true;
+    correct &= runTypedReductions< std::uint8_t >(
+        suffix, options, executor, series
+    );
+    correct &= runTypedReductions< std::uint16_t >(
+        suffix, options, executor, series
+    );
+    correct &= runTypedReductions< int >( suffix, options, executor, series );
+    correct &= runTypedReductions< float >( suffix, options, executor, series );
+    return correct;
+}
+
+// Run the reduction suite for every selected executor, writing
+// reduce_<arch>.csv.
+bool runReduceSuite ( const BenchmarkOptions & options )
+{
+    std::vector< BenchmarkSeries > series;
+    bool correct = true;
+    for ( ExecutionMode execution : options.executions )
+    {
+        switch ( execution )
+        {
+            case ExecutionMode::Spawn:
+            {
+                SpawnExecutor executor;
+                correct &= runReduceBenchmarks( "", options, executor, series );
+                break;
+            }
+            case ExecutionMode::Pool:
+            {
+                ThreadPool pool( options.maxThreads, options.pinThreads );
+                correct &= runReduceBenchmarks( "Pool", options, pool, series );
+                break;
+            }
+        }
+    }
+
+    writeResultsToCSV( "reduce_" + archName() + ".csv", series );
+    return correct;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+NUMA placement suite. For every thread count a FlatMatrix is allocated
+uninitialized and its pages are placed before the matrix is filled:
+- Local: every worker binds and first-touches its own row chunk, the same
+  chunk countWithLocalCounter later hands it, so all reads are node-local.
+- Interleaved: the pages are spread round-robin over the nodes.
+Workers are pinned to numaTopology().workerCpus() in both cases, so the two
+series only differ in where the memory is. Besides GBps, every series has a
+"LocalPages" row: the share of sampled pages that sit on the node of the
+thread reading them, -1 if the platform cannot tell.
+*/
+enum class NumaPlacement
+{
+        Local
+    ,   Interleaved
+};
+
+// Rows [first, last) of thread t in the countWithLocalCounter split.
+IndexRange chunkRows ( int rows, int numThreads, int t )
+{
+    int chunkSize = ( rows + numThreads - 1 ) / numThreads;
+    int first = std::min( t * chunkSize, rows );
+    return { first, std::min( first + chunkSize, rows ) };
+}
+
+// Returns false if a policy could not be applied to the whole matrix.
+template < typename _ExecutorT >
+bool placeMatrix (
+        FlatMatrix & matrix
+    ,   NumaPlacement placement
+    ,   int numThreads
+    ,   std::vector< int > const & cpus
+    ,   _ExecutorT & executor
+)
+{
+    const std::size_t rowBytes = matrix.stride() * sizeof( int );
+    std::atomic< bool > placed{ true };
+    if ( placement == NumaPlacement::Interleaved
+        && !interleaveMemory( matrix.data(), matrix.rows() * rowBytes ) )
+        placed = false;
+
+    executor.run( numThreads, [ & ] ( int t )
+    {
+        IndexRange range = chunkRows( matrix.rows(), numThreads, t );
+        if ( range.begin == range.end )
+            return;
+        if ( placement == NumaPlacement::Local
+            && !bindMemoryToNode(
+                   matrix.row( range.begin ),
+                   ( range.end - range.begin ) * rowBytes,
+                   numaTopology().nodeOfCpu( cpus[ t % cpus.size() ] ) ) )
+            placed.store( false, std::memory_order_relaxed );
+        for ( int i = range.begin; i < range.end; ++i )
+        {
+            int * row = matrix.row( i );
+            for ( int j = 0; j < matrix.cols(); ++j )
+                row[ j ] = ( i + j ) % 256;
+        }
+    } );
+    return placed.load();
+}
+
+// Share of sampled pages on the node of the thread that counts them.
+double localPageShare (
+    const FlatMatrix & matrix, int numThreads, std::vector< int > const & cpus
+)
+{
+    const int samplesPerChunk = 16;
+    int known = 0;
+    int local = 0;
+    for ( int t = 0; t < numThreads; ++t )
+    {
+        IndexRange range = chunkRows( matrix.rows(), numThreads, t );
+        int node = numaTopology().nodeOfCpu( cpus[ t % cpus.size() ] );
+        for ( int k = 0; k < samplesPerChunk; ++k )
+        {
+            int row = range.begin
+                + ( range.end - range.begin ) * k / samplesPerChunk;
+            if ( row >= range.end )
+                break;
+            int pageNode = memoryNode( matrix.row( row ) );
+            if ( pageNode < 0 )
+                continue;
+            ++known;
+            local += pageNode == node;
+        }
+    }
+    return known ? static_cast< double >( local ) / known : -1.0;
+}
+
+template < typename _ExecutorT >
+bool runNumaBenchmarks (
+        const std::string & suffix
+    ,   int threshold
+    ,   const BenchmarkOptions & options
+    ,   std::vector< int > const & cpus
+    ,   _ExecutorT & executor
+    ,   std::vector< BenchmarkSeries > & series
+)
+{
+    const double bytes =
+        static_cast< double >( options.rows ) * options.cols * sizeof( int );
+    bool allCorrect = true;
+
+    for ( NumaPlacement placement :
+          { NumaPlacement::Local, NumaPlacement::Interleaved } )
+    {
+        const std::string name = std::string( "Numa" )
+            + ( placement == NumaPlacement::Local ? "Local" : "Interleaved" )
+            + suffix;
+
+        std::vector< std::vector< double > > times( options.maxThreads );
+        std::vector< double > localPages;
+        bool placed = true;
+        for ( int numThreads = 1; numThreads <= options.maxThreads;
+              ++numThreads )
+        {
+            // Placement follows the split, so it is redone per thread count.
+            FlatMatrix matrix( options.rows, options.cols );
+            placed &=
+                placeMatrix( matrix, placement, numThreads, cpus, executor );
+            const long long expected = countSerial( matrix, threshold );
+            localPages.push_back( localPageShare( matrix, numThreads, cpus ) );
+
+            for ( int iter = 0; iter < options.iterations; ++iter )
+            {
+                PerfScope perf;
+                Timer< std::micro > timer( name );
+                long long result = countWithLocalCounter(
+                    matrix, threshold, numThreads, executor
+                );
+                times[ numThreads - 1 ].push_back( timer.stop() );
+                perf.stop();
+                if ( result != expected )
+                {
+                    std::cerr
+                        << name << " with " << numThreads
+                        << " threads counted " << result << ", expected "
+                        << expected << "\n"
+                    ;
+                    allCorrect = false;
+                }
+            }
+        }
+
+        // On one node there is nothing to place, macOS has no policies.
+        if ( !placed && numaTopology().numNodes() > 1 )
+        {
+            std::cerr
+                << "Warning: " << name << " placement could not be applied "
+                << "to every page; see the LocalPages row for where they "
+                << "are.\n"
+            ;
+        }
+
+        BenchmarkSeries s = makeSeries( name, times, options.iterations );
+        std::vector< double > gbps;
+        for ( double avg : s.avg )
+            gbps.push_back( bytes / ( avg * 1e-6 ) / 1e9 );
+        s.metrics.emplace_back( "GBps", gbps );
+        s.metrics.emplace_back( "LocalPages", localPages );
+        series.push_back( s );
+    }
+    return allCorrect;
+}
+
+// Run the NUMA suite for every selected executor and write numa_<arch>.csv.
+// Threads are always pinned here, --no-pin does not apply.
+bool runNumaSuite ( int threshold, const BenchmarkOptions & options )
+{
+    NumaTopology const & topology = numaTopology();
+    std::cout << "NUMA nodes: " << topology.numNodes() << "\n";
+    for ( int n = 0; n < topology.numNodes(); ++n )
+    {
+        std::cout
+            << "  node " << topology.nodeIds[ n ] << ": "
+            << topology.nodeCpus[ n ].size() << " CPUs\n"
+        ;
+    }
+    if ( topology.numNodes() == 1 )
+        std::cout << "Single node: both placements are equivalent here.\n";
+
+    const std::vector< int > cpus = topology.workerCpus();
+    std::vector< BenchmarkSeries > series;
+    bool allCorrect = true;
+    for ( ExecutionMode execution : options.executions )
+    {
+        switch ( execution )
+        {
+            case ExecutionMode::Spawn:
+            {
+                SpawnExecutor executor( cpus );
+                allCorrect &= runNumaBenchmarks(
+                    "", threshold, options, cpus, executor, series
+                );
+                break;
+            }
+            case ExecutionMode::Pool:
+            {
+                ThreadPool pool( options.maxThreads, cpus );
+                allCorrect &= runNumaBenchmarks(
+                    "Pool", threshold, options, cpus, pool, series
+                );
+                break;
+            }
+        }
+    }
+
+    writeResultsToCSV( "numa_" + archName() + ".csv", series );
+    return allCorrect;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Pipelined stream suite. A stream of options.frames frames goes through three
+overlapped stages, all running at once on their own threads:
+- one producer generates every frame tile by tile into one of `depth`
+  preallocated frame slots, and pushes each tile to a work queue as soon as
+  it is written;
+- numThreads workers pop tiles, count them, and add the result to the count
+  of their frame; the worker that finishes the last tile of a frame hands
+  the frame to the reducer;
+- the reducer checks and sums the frame counts, records the latency of the
+  frame and returns its slot to the producer.
+All three hand-offs are BoundedQueue's (utils/bounded_queue.h). With every
+slot in flight the producer waits for the reducer to free one, so a slow
+stage backs the whole pipeline up instead of growing a queue; that wait is
+reported as "StallUs" per frame.
+
+The "Sequential" reference processes the same frames the way the benchmark
+mode does, one step after the other: generate a whole frame, then count it
+with countWithLocalCounterKernel. Both count with the same kernel, the
+widest from count_kernels.h, so they differ only in the overlap. The
+reference runs on every executor of --exec; the pipelined stages always
+spawn their own threads, whatever --exec. Both series are in microseconds
+per frame and have "FramesPerSec" and per-frame latency rows
+("LatencyMedian", "LatencyP90", "LatencyP99", "LatencyMax", also in
+microseconds). The latency of a frame
+runs from the start of its generation to the end of its reduction.
+*/
+
+using PipelineClock = std::chrono::steady_clock;
+
+// Frame `frame` of the stream: row i holds ( 37 i + 11 frame ) mod 256, so
+// every frame is different and its count is known without scanning it.
+void fillFrameRows ( FlatMatrix & matrix, int frame, int first, int last )
+{
+    for ( int i = first; i < last; ++i )
+    {
+        std::fill_n(
+            matrix.row( i ), matrix.cols(), ( i * 37 + frame * 11 ) & 255
+        );
+    }
+}
+
+long long expectedFrameCount ( int rows, int cols, int frame, int threshold )
+{
+    long long count = 0;
+    for ( int i = 0; i < rows; ++i )
+    {
+        if ( ( ( i * 37 + frame * 11 ) & 255 ) > threshold )
+            count += cols;
+    }
+    return count;
+}
+
+double elapsedMicros ( PipelineClock::time_point start )
+{
+    return std::chrono::duration< double, std::micro >(
+        PipelineClock::now() - start
+    ).count();
+}
+
+// Spin briefly, then yield: the stages may outnumber the CPUs.
+void pipelineBackoff ( int & spins )
+{
+    if ( ++spins < 64 )
+        cpuRelax();
+    else
+        std::this_thread::yield();
+}
+
+// Rows per pipeline tile: the requested count, or four tiles per worker.
+int pipelineTileRows ( const BenchmarkOptions & options, int numThreads )
+{
+    if ( options.tileRows > 0 )
+        return std::min( options.tileRows, options.rows );
+    return std::max( 1, options.rows / ( 4 * numThreads ) );
+}
+
+struct PipelineSlot
+{
+    explicit PipelineSlot ( int rows, int cols )
+        :   frame( rows, cols )
+    {
+    }
+
+    FlatMatrix frame;
+    int index = 0;
+    long long expected = 0;
+    PipelineClock::time_point start;
+    // Updated by every worker, kept off the line of the fields above.
+    alignas( DESTRUCTIVE_INTERFERENCE_SIZE )
+        std::atomic< long long > count{ 0 };
+    std::atomic< int > pendingTiles{ 0 };
+};
+
+struct PipelineTile
+{
+    int slot = 0;
+    int firstRow = 0;
+};
+
+// Latencies of every frame and the producer's wait for a free slot, in
+// microseconds, of one pass over the stream.
+struct PipelineRun
+{
+    std::vector< double > latencies;
+    double stallUs = 0.0;
+    bool correct = true;
+};
+
+// One pass of the pipelined stream with numThreads counting workers.
+template < typename _ExecutorT >
+PipelineRun runPipeline (
+        int threshold
+    ,   int numThreads
+    ,   const BenchmarkOptions & options
+    ,   std::vector< std::unique_ptr< PipelineSlot > > & slots
+    ,   RowCountFunc kernel
+    ,   _ExecutorT & executor
+)
+{
+    const int rows = options.rows;
+    const int cols = options.cols;
+    const int frames = options.frames;
+    const int tileRows = pipelineTileRows( options, numThreads );
+    const int tilesPerFrame = ( rows + tileRows - 1 ) / tileRows;
+    const int depth = static_cast< int >( slots.size() );
+
+    BoundedQueue< int > freeSlots( depth );
+    BoundedQueue< PipelineTile > tiles(
+        static_cast< std::size_t >( depth ) * tilesPerFrame
+    );
+    BoundedQueue< int > doneSlots( depth );
+    for ( int s = 0; s < depth; ++s )
+        freeSlots.tryPush( s );
+
+    std::atomic< bool > finished{ false };
+    PipelineRun run;
+    run.latencies.reserve( frames );
+
+    auto produce = [ & ] ()
+    {
+        for ( int f = 0; f < frames; ++f )
+        {
+            int s = 0;
+            int spins = 0;
+            const PipelineClock::time_point waitStart = PipelineClock::now();
+            while ( !freeSlots.tryPop( s ) )
+                pipelineBackoff( spins );
+            run.stallUs += elapsedMicros( waitStart );
+
+            TraceZone zone( "pipeline produce", f );
+            PipelineSlot & slot = *slots[ s ];
+            slot.start = PipelineClock::now();
+            slot.index = f;
+            slot.expected = expectedFrameCount( rows, cols, f, threshold );
+            slot.count.store( 0, std::memory_order_relaxed );
+            slot.pendingTiles.store( tilesPerFrame, std::memory_order_relaxed );
+            for ( int first = 0; first < rows; first += tileRows )
+            {
+                fillFrameRows(
+                    slot.frame, f, first, std::min( first + tileRows, rows )
+                );
+                spins = 0;
+                while ( !tiles.tryPush( PipelineTile{ s, first } ) )
+                    pipelineBackoff( spins );
+            }
+        }
+    };
+
+    auto count = [ & ] ( int worker )
+    {
+        PipelineTile tile;
+        int spins = 0;
+        while ( !finished.load( std::memory_order_acquire ) )
+        {
+            if ( !tiles.tryPop( tile ) )
+            {
+                pipelineBackoff( spins );
+                continue;
+            }
+            spins = 0;
+
+            TraceZone zone( "pipeline count", worker );
+            PipelineSlot & slot = *slots[ tile.slot ];
+            const int last = std::min( tile.firstRow + tileRows, rows );
+            long long local = 0;
+            for ( int i = tile.firstRow; i < last; ++i )
+            {
+                local += kernel( slot.frame.row( i ), cols, threshold );
+            }
+            // The release orders the count before the hand-off, the acquire
+            // of the last worker sees the counts of all the others.
+            slot.count.fetch_add( local, std::memory_order_relaxed );
+            if ( slot.pendingTiles.fetch_sub(
+                     1, std::memory_order_acq_rel ) == 1 )
+            {
+                int doneSpins = 0;
+                while ( !doneSlots.tryPush( tile.slot ) )
+                    pipelineBackoff( doneSpins );
+            }
+        }
+    };
+
+    auto reduce = [ & ] ()
+    {
+        long long total = 0;
+        for ( int reduced = 0; reduced < frames; )
+        {
+            int s = 0;
+            int spins = 0;
+            while ( !doneSlots.tryPop( s ) )
+                pipelineBackoff( spins );
+
+            PipelineSlot & slot = *slots[ s ];
+            const long long frameCount =
+                slot.count.load( std::memory_order_relaxed );
+            if ( frameCount != slot.expected )
+            {
+                std::cerr
+                    << "Pipelined frame " << slot.index << " with "
+                    << numThreads << " workers counted " << frameCount
+                    << ", expected " << slot.expected << "\n"
+                ;
+                run.correct = false;
+            }
+            total += frameCount;
+            run.latencies.push_back( elapsedMicros( slot.start ) );
+            ++reduced;
+            spins = 0;
+            while ( !freeSlots.tryPush( s ) )
+                pipelineBackoff( spins );
+        }
+        doNotOptimize( total );
+        finished.store( true, std::memory_order_release );
+    };
+
+    // Task 0 produces, task 1 reduces, the others count.
+    executor.run( numThreads + 2, [ & ] ( int t )
+    {
+        if ( t == 0 )
+            produce();
+        else if ( t == 1 )
+            reduce();
+        else
+            count( t - 2 );
+    } );
+    return run;
+}
+
+// Frames per second and latency percentiles of every thread count.
+void appendFrameMetrics (
+    BenchmarkSeries & series,
+    const std::vector< std::vector< double > > & latencies
+)
+{
+    std::vector< double > perSecond, median, p90, p99, maximum;
+    for ( double avg : series.avg )
+        perSecond.push_back( 1e6 / avg );
+    for ( const auto & frameLatencies : latencies )
+    {
+        BenchmarkStats stats = computeBenchmarkStats( frameLatencies );
+        median.push_back( stats.median );
+        p90.push_back( stats.p90 );
+        p99.push_back( stats.p99 );
+        maximum.push_back( stats.max );
+    }
+    series.metrics.emplace_back( "FramesPerSec", perSecond );
+    series.metrics.emplace_back( "LatencyMedian", median );
+    series.metrics.emplace_back( "LatencyP90", p90 );
+    series.metrics.emplace_back( "LatencyP99", p99 );
+    series.metrics.emplace_back( "LatencyMax", maximum );
+}
+
+// Sequential reference: generate, then count every frame, with the
+// executor's threads.
+template < typename _ExecutorT >
+bool runSequentialFrames (
+        const std::string & suffix
+    ,   int threshold
+    ,   const BenchmarkOptions & options
+    ,   RowCountFunc kernel
+    ,   _ExecutorT & executor
+    ,   std::vector< BenchmarkSeries > & series
+)
+{
+    const std::string name = "Sequential" + suffix;
+    FlatMatrix matrix( options.rows, options.cols );
+    bool allCorrect = true;
+
+    std::vector< std::vector< double > > times( options.maxThreads );
+    std::vector< std::vector< double > > latencies( options.maxThreads );
+    for ( int numThreads = 1; numThreads <= options.maxThreads; ++numThreads )
+    {
+        for ( int iter = 0; iter < options.iterations; ++iter )
+        {
+            PerfScope perf;
+            Timer< std::micro > timer( name );
+            for ( int f = 0; f < options.frames; ++f )
+            {
+                const PipelineClock::time_point start = PipelineClock::now();
+                fillFrameRows( matrix, f, 0, options.rows );
+                long long result = countWithLocalCounterKernel(
+                    matrix, threshold, numThreads, kernel, executor
+                );
+                latencies[ numThreads - 1 ].push_back( elapsedMicros( start ) );
+                const long long expected = expectedFrameCount(
+                    options.rows, options.cols, f, threshold
+                );
+                if ( result != expected )
+                {
+                    std::cerr
+                        << name << " frame " << f << " with " << numThreads
+                        << " threads counted " << result << ", expected "
+                        << expected << "\n"
+                    ;
+                    allCorrect = false;
+                }
+            }
+            times[ numThreads - 1 ].push_back( timer.stop() / options.frames );
+            perf.stop();
+        }
+    }
+
+    BenchmarkSeries s = makeSeries( name, times, options.iterations );
+    appendFrameMetrics( s, latencies );
+    series.push_back( s );
+    return allCorrect;
+}
+
+// Pipelined series, 1..maxThreads counting workers plus the producer and
+// the reducer. Workers are pinned unless --no-pin is given.
+bool runPipelinedFrames (
+        int threshold
+    ,   const BenchmarkOptions & options
+    ,   RowCountFunc kernel
+    ,   std::vector< BenchmarkSeries > & series
+)
+{
+    std::vector< int > cpus;
+    if ( options.pinThreads )
+    {
+        const int hardwareThreads =
+            std::max( 1u, std::thread::hardware_concurrency() );
+        for ( int cpu = 0; cpu < hardwareThreads; ++cpu )
+            cpus.push_back( cpu );
+    }
+    SpawnExecutor executor( cpus );
+
+    std::vector< std::unique_ptr< PipelineSlot > > slots;
+    for ( int s = 0; s < options.depth; ++s )
+    {
+        slots.push_back(
+            std::make_unique< PipelineSlot >( options.rows, options.cols )
+        );
+    }
+
+    bool allCorrect = true;
+    std::vector< std::vector< double > > times( options.maxThreads );
+    std::vector< std::vector< double > > latencies( options.maxThreads );
+    std::vector< double > stalls( options.maxThreads, 0.0 );
+    for ( int numThreads = 1; numThreads <= options.maxThreads; ++numThreads )
+    {
+        for ( int iter = 0; iter < options.iterations; ++iter )
+        {
+            PerfScope perf;
+            Timer< std::micro > timer( "Pipelined" );
+            PipelineRun run =
+                runPipeline(
+                threshold, numThreads, options, slots, kernel, executor
+            );
+            times[ numThreads - 1 ].push_back( timer.stop() / options.frames );
+            perf.stop();
+            allCorrect &= run.correct;
+            latencies[ numThreads - 1 ].insert(
+                latencies[ numThreads - 1 ].end(),
+                run.latencies.begin(), run.latencies.end()
+            );
+            stalls[ numThreads - 1 ] +=
+                run.stallUs / options.frames / options.iterations;
+        }
+    }
+
+    BenchmarkSeries s = makeSeries( "Pipelined", times, options.iterations );
+    appendFrameMetrics( s, latencies );
+    s.metrics.emplace_back( "StallUs", stalls );
+    series.push_back( s );
+    return allCorrect;
+}
+
+// Run the sequential reference for every selected executor and the
+// pipelined stream, writing pipeline_<arch>.csv.
+bool runPipelineSuite ( int threshold, const BenchmarkOptions & options )
+{
+    if ( options.frames < 1 || options.depth < 1 )
+    {
+        std::cerr << "Error: pipeline needs --frames and --depth >= 1.\n";
+        return false;
+    }
+
+    const CountKernel kernel = bestCountKernel();
+    std::cout << "Counting kernel: " << kernel.name << std::endl;
+
+    std::vector< BenchmarkSeries > series;
+    bool allCorrect = true;
+    for ( ExecutionMode execution : options.executions )
+    {
+        switch ( execution )
+        {
+            case ExecutionMode::Spawn:
+            {
+                SpawnExecutor executor;
+                allCorrect &= runSequentialFrames(
+                    "", threshold, options, kernel.func, executor, series
+                );
+                break;
+            }
+            case ExecutionMode::Pool:
+            {
+                ThreadPool pool( options.maxThreads, options.pinThreads );
+                allCorrect &= runSequentialFrames(
+                    "Pool", threshold, options, kernel.func, pool, series
+                );
+                break;
+            }
+        }
+    }
+    allCorrect &= runPipelinedFrames( threshold, options, kernel.func, series );
+
+    writeResultsToCSV( "pipeline_" + archName() + ".csv", series );
+    return allCorrect;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Delta counting suite. Models a stream of frames that change only in small
+regions between ticks: before every timed call, a fraction of the tiles of
+one random FlatMatrix is rewritten and marked dirty in an
+IncrementalCounter (incremental_counter.h), which then recounts only those
+tiles. The "FullRescan" reference counts the whole matrix with the same
+kernel (the widest the CPU supports) and the same split as
+countWithLocalCounterKernel. Rewriting and marking the tiles is not timed,
+only the counting is. Every count is checked against countSerial.
+
+Every fraction of --dirty is a series "Incremental<percent>Pct", with a
+"DirtyTiles" row (tiles recounted per call) and a "Speedup" row over the
+full rescan at the same thread count.
+*/
+
+// Parse the --dirty value: a comma-separated list of fractions in [0, 1].
+std::vector< double > parseDirtyFractions ( const std::string & value )
+{
+    std::vector< double > fractions;
+    std::stringstream list( value );
+    for ( std::string item; std::getline( list, item, ',' ); )
+    {
+        try
+        {
+            fractions.push_back( std::clamp( std::stod( item ), 0.0, 1.0 ) );
+        }
+        catch ( std::exception const & )
+        {
+            std::cerr << "Ignoring dirty fraction '" << item << "'.\n";
+        }
+    }
+    return fractions;
+}
+
+// Tile height or width of the delta suite: the requested one, or 32.
+int deltaTileSize ( int requested )
+{
+    return requested > 0 ? requested : 32;
+}
+
+// Rewrite `dirty` random tiles of the matrix and mark them in the counter.
+void touchTiles (
+        FlatMatrix & matrix
+    ,   IncrementalCounter & counter
+    ,   int dirty
+    ,   std::vector< int > & tiles
+    ,   std::mt19937 & gen
+)
+{
+    std::shuffle( tiles.begin(), tiles.end(), gen );
+    for ( int k = 0; k < dirty; ++k )
+    {
+        const int ty = tiles[ k ] / counter.tilesAcross();
+        const int tx = tiles[ k ] % counter.tilesAcross();
+        const IndexRange rows{
+            ty * counter.tileRows(),
+            std::min( ( ty + 1 ) * counter.tileRows(), matrix.rows() )
+        };
+        const IndexRange cols{
+            tx * counter.tileCols(),
+            std::min( ( tx + 1 ) * counter.tileCols(), matrix.cols() )
+        };
+        for ( int i = rows.begin; i < rows.end; ++i )
+        {
+            int * row = matrix.row( i );
+            for ( int j = cols.begin; j < cols.end; ++j )
+                row[ j ] = ( row[ j ] + 97 ) & 255;
+        }
+        counter.markDirty( rows, cols );
+    }
+}
+
+template < typename _ExecutorT >
+bool runDeltaBenchmarks (
+        const std::string & suffix
+    ,   int threshold
+    ,   const BenchmarkOptions & options
+    ,   _ExecutorT & executor
+    ,   std::vector< BenchmarkSeries > & series
+)
+{
+    const CountKernel kernel = bestCountKernel();
+    const int tileRows = deltaTileSize( options.tileRows );
+    const int tileCols = deltaTileSize( options.tileCols );
+    FlatMatrix matrix =
+        generateRandomMatrix< FlatMatrix >( options.rows, options.cols );
+    bool allCorrect = true;
+
+    auto check = [ & ] (
+        const std::string & name, int numThreads, long long result
+    )
+    {
+        const long long expected = countSerial( matrix, threshold );
+        if ( result == expected )
+            return;
+        std::cerr
+            << name << " with " << numThreads << " threads counted "
+            << result << ", expected " << expected << "\n"
+        ;
+        allCorrect = false;
+    };
+
+    const std::string fullName = "FullRescan" + suffix;
+    std::vector< std::vector< double > > fullTimes( options.maxThreads );
+    for ( int numThreads = 1; numThreads <= options.maxThreads; ++numThreads )
+    {
+        for ( int iter = 0; iter < options.iterations; ++iter )
+        {
+            PerfScope perf;
+            Timer< std::micro > timer( fullName );
+            long long result = countWithLocalCounterKernel(
+                matrix, threshold, numThreads, kernel.func, executor
+            );
+            fullTimes[ numThreads - 1 ].push_back( timer.stop() );
+            perf.stop();
+            check( fullName, numThreads, result );
+        }
+    }
+    BenchmarkSeries full =
+        makeSeries( fullName, fullTimes, options.iterations );
+    series.push_back( full );
+
+    std::mt19937 gen( 42 );
+    std::vector< int > measured;
+    for ( double fraction : options.dirtyFractions )
+    {
+        IncrementalCounter counter(
+            options.rows, options.cols, tileRows, tileCols, threshold,
+            kernel.func
+        );
+        const int numTiles = counter.numTiles();
+        // At least one tile for any fraction above zero.
+        const int dirty = std::max(
+            fraction > 0.0 ? 1 : 0,
+            static_cast< int >( std::lround( fraction * numTiles ) )
+        );
+
+        // The series is named after the fraction of whole tiles actually
+        // dirtied, which rounding can move away from the requested one;
+        // a move of more than 5% is worth a warning.
+        const double actual = static_cast< double >( dirty ) / numTiles;
+        std::ostringstream percent;
+        percent << std::setprecision( 3 ) << actual * 100;
+        const std::string name = "Incremental" + percent.str() + "Pct" + suffix;
+        if ( std::find( measured.begin(), measured.end(), dirty )
+             != measured.end() )
+        {
+            std::cerr
+                << "Warning: dirty fraction " << fraction << " rounds to "
+                << dirty << " of " << numTiles << " tiles, already measured "
+                << "as " << name << "; skipped.\n"
+            ;
+            continue;
+        }
+        if ( std::abs( actual - fraction ) > 0.05 * fraction )
+        {
+            std::cerr
+                << "Warning: dirty fraction " << fraction << " rounds to "
+                << dirty << " of " << numTiles << " tiles, measured as "
+                << name << ".\n"
+            ;
+        }
+        measured.push_back( dirty );
+
+        counter.update( matrix, options.maxThreads, executor );
+        std::vector< int > tiles( numTiles );
+        for ( int tile = 0; tile < numTiles; ++tile )
+            tiles[ tile ] = tile;
+
+        std::vector< std::vector< double > > times( options.maxThreads );
+        for ( int numThreads = 1; numThreads <= options.maxThreads;
+              ++numThreads )
+        {
+            for ( int iter = 0; iter < options.iterations; ++iter )
+            {
+                touchTiles( matrix, counter, dirty, tiles, gen );
+                PerfScope perf;
+                Timer< std::micro > timer( name );
+                long long result =
+                    counter.update( matrix, numThreads, executor );
+                times[ numThreads - 1 ].push_back( timer.stop() );
+                perf.stop();
+                check( name, numThreads, result );
+            }
+        }
+
+        BenchmarkSeries s = makeSeries( name, times, options.iterations );
+        std::vector< double > speedup;
+        for ( std::size_t t = 0; t < s.avg.size(); ++t )
+            speedup.push_back( full.avg[ t ] / s.avg[ t ] );
+        s.metrics.emplace_back(
+            "DirtyTiles", std::vector< double >( s.avg.size(), dirty )
+        );
+        s.metrics.emplace_back( "Speedup", speedup );
+        series.push_back( s );
+    }
+    return allCorrect;
+}
+
+// Run the delta suite for every selected executor and write
+// delta_<arch>.csv.
+bool runDeltaSuite ( int threshold, const BenchmarkOptions & options )
+{
+    std::cout
+        << "Counting kernel: " << bestCountKernel().name << ", tiles of "
+        << deltaTileSize( options.tileRows ) << " x "
+        << deltaTileSize( options.tileCols ) << "\n"
+    ;
+
+    std::vector< BenchmarkSeries > series;
+    bool allCorrect = true;
+    for ( ExecutionMode execution : options.executions )
+    {
+        switch ( execution )
+        {
+            case ExecutionMode::Spawn:
+            {
+                SpawnExecutor executor;
+                allCorrect &= runDeltaBenchmarks(
+                    "", threshold, options, executor, series
+                );
+                break;
+            }
+            case ExecutionMode::Pool:
+            {
+                ThreadPool pool( options.maxThreads, options.pinThreads );
+                allCorrect &= runDeltaBenchmarks(
+                    "Pool", threshold, options, pool, series
+                );
+                break;
+            }
+        }
+    }
+
+    writeResultsToCSV( "delta_" + archName() + ".csv", series );
+    return allCorrect;
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Parse the named parameters shared by all benchmark modes, from argv[first].
+// Returns false, with a message, on an unknown or invalid value.
+bool parseBenchmarkOptions (
+    int argc, char* argv[], int first, BenchmarkOptions & options
+)
+{
+    for (int i = first; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if ( arg == "--threads" && (i + 1) < argc )
+        {
+            options.maxThreads = std::stoi(argv[++i]);
+        }
+        else if ( arg == "--rows" && (i + 1) < argc )
+        {
+            options.rows = std::stoi(argv[++i]);
+        }
+        else if ( arg == "--cols" && (i + 1) < argc )
+        {
+            options.cols = std::stoi(argv[++i]);
+        }
+        else if ( arg == "--rowscols" && (i + 1) < argc )
+        {
+            options.rows = std::stoi(argv[++i]);
+            options.cols = std::stoi(argv[i]);
+        }
+        else if ( arg == "--iterations" && (i + 1) < argc )
+        {
+            options.iterations = std::stoi(argv[++i]);
+        }
+        else if ( arg == "--layout" && (i + 1) < argc )
+        {
+            std::string value = argv[++i];
+            if ( !parseLayouts( value, options.layouts ) )
+            {
+                std::cerr << "Error: unknown layout " << value
+                          << " (expected nested, flat, padded or all)\n";
+                return false;
+            }
+        }
+        else if ( arg == "--kernels" && (i + 1) < argc )
+        {
+            std::string value = argv[++i];
+            if ( !parseKernels( value, options.kernels ) )
+            {
+                std::cerr << "Error: kernel " << value
+                          << " is unknown or not available on this CPU"
+                          << " (expected none, best, all";
+                for ( const auto & kernel : availableCountKernels() )
+                    std::cerr << ", " << kernel.name;
+                std::cerr << ")\n";
+                return false;
+            }
+        }
+        else if ( arg == "--exec" && (i + 1) < argc )
+        {
+            std::string value = argv[++i];
+            if ( !parseExecutionModes( value, options.executions ) )
+            {
+                std::cerr << "Error: unknown execution mode " << value
+                          << " (expected spawn, pool or both)\n";
+                return false;
+            }
+        }
+        else if ( arg == "--schedule" && (i + 1) < argc )
+        {
+            std::string value = argv[++i];
+            if ( !parseScheduleModes( value, options.schedules ) )
+            {
+                std::cerr << "Error: unknown schedule " << value
+                          << " (expected static, steal or both)\n";
+                return false;
+            }
+        }
+        else if ( arg == "--grain" && (i + 1) < argc )
+        {
+            options.grain = std::stoi(argv[++i]);
+        }
+        else if ( arg == "--no-pin" )
+        {
+            options.pinThreads = false;
+        }
+        else if ( arg == "--file" && (i + 1) < argc )
+        {
+            options.file = argv[++i];
+        }
+        else if ( arg == "--tile-rows" && (i + 1) < argc )
+        {
+            options.tileRows = std::stoi(argv[++i]);
+        }
+        else if ( arg == "--cold" )
+        {
+            options.coldCache = true;
+        }
+        else if ( arg == "--tile-cols" && (i + 1) < argc )
+        {
+            options.tileCols = std::stoi(argv[++i]);
+        }
+        else if ( arg == "--dirty" && (i + 1) < argc )
+        {
+            options.dirtyFractions = parseDirtyFractions( argv[++i] );
+        }
+        else if ( arg == "--frames" && (i + 1) < argc )
+        {
+            options.frames = std::stoi(argv[++i]);
+        }
+        else if ( arg == "--depth" && (i + 1) < argc )
+        {
+            options.depth = std::stoi(argv[++i]);
+        }
+        else if ( arg == "--trace" && (i + 1) < argc )
+        {
+            options.traceFile = argv[++i];
+        }
+        else if ( arg == "--pages" && (i + 1) < argc )
+        {
+            std::string name = argv[++i];
+            if ( !parsePageMode( name, pageOptions().mode ) )
+            {
+                std::cerr << "Error: unknown page mode " << name
+                          << " (expected default, thp, 2m or 1g)\n";
+                return false;
+            }
+        }
+        else if ( arg == "--prefault" )
+        {
+            pageOptions().prefault = true;
+        }
+        else if ( arg == "--align" && (i + 1) < argc )
+        {
+            std::string value = argv[++i];
+            if ( !parseAlignment( value, pageOptions().alignment ) )
+            {
+                std::cerr << "Error: invalid alignment " << value
+                          << " (expected a power of two up to 4096)\n";
+                return false;
+            }
+        }
+    }
+
+    if ( !options.traceFile.empty() )
+        enableTracing( options.traceFile );
+    return true;
+}
+
+/*----------------------------------------------------------------------------*/
+
+int main ( int argc, char* argv[] )
+{
+    const int defaultRows = 1000;
+    const int defaultCols = 1000;
+    const int defaultMaxThreads = 30;
+    const int threshold = 128;
+    const int defaultIterations = 5;
+
+    std::string mode = argc > 1 ? argv[1] : "";
+
+    // Hardware counters for every timed iteration; every series gets their
+    // averages as extra CSV rows where the machine supports them.
+    PerfRecorder perfRecorder;
+    if ( !perfRecorder.counters().isAvailable() )
+        std::cout << "Hardware performance counters are unavailable.\n";
+
+    // Use default values.
+    BenchmarkOptions options;
+    options.maxThreads = defaultMaxThreads;
+    options.rows = defaultRows;
+    options.cols = defaultCols;
+    options.iterations = defaultIterations;
+
+    // Check if benchmark mode is requested.
+    if ( mode == "benchmark" )
+    {
+        if ( !parseBenchmarkOptions( argc, argv, 2, options ) )
+            return 1;
+
+        std::cout
+            << "Running benchmarks with rows=" << options.rows
+            << ", cols=" << options.cols
+            << ", maxThreads=" << options.maxThreads
+            << ", iterations=" << options.iterations << std::endl
+        ;
+
+        // Generate a deterministic matrix.
+        Matrix image = generateMatrix(options.rows, options.cols);
+
+        // Run the benchmarks.
+        runBenchmarks( image, threshold, options );
+    }
+    else if ( mode == "falsesharing" )
+    {
+        if ( !parseBenchmarkOptions( argc, argv, 2, options ) )
+            return 1;
+
+        std::cout
+            << "Running false-sharing suite with rows=" << options.rows
+            << ", cols=" << options.cols
+            << ", maxThreads=" << options.maxThreads
+            << ", iterations=" << options.iterations << std::endl
+        ;
+
+        if ( !runFalseSharingSuite( threshold, options ) )
+            return 1;
+    }
+    else if ( mode == "reduce" )
+    {
+        if ( !parseBenchmarkOptions( argc, argv, 2, options ) )
+            return 1;
+
+        std::cout
+            << "Running reduction benchmarks over rows * cols = "
+            << static_cast< long long >( options.rows ) * options.cols
+            << " elements, maxThreads=" << options.maxThreads
+            << ", iterations=" << options.iterations << std::endl
+        ;
+
+        if ( !runReduceSuite( options ) )
+            return 1;
+    }
+    else if ( mode == "numa" )
+    {
+        if ( !parseBenchmarkOptions( argc, argv, 2, options ) )
+            return 1;
+
+        std::cout
+            << "Running NUMA placement suite with rows=" << options.rows
+            << ", cols=" << options.cols
+            << ", maxThreads=" << options.maxThreads
+            << ", iterations=" << options.iterations << std::endl
+        ;
+
+        if ( !runNumaSuite( threshold, options ) )
+            return 1;
+    }
+    else if ( mode == "pipeline" )
+    {
+        if ( !parseBenchmarkOptions( argc, argv, 2, options ) )
+            return 1;
+
+        std::cout
+            << "Running pipelined stream of " << options.frames
+            << " frames with rows=" << options.rows
+            << ", cols=" << options.cols
+            << ", depth=" << options.depth
+            << ", maxThreads=" << options.maxThreads
+            << ", iterations=" << options.iterations << std::endl
+        ;
+
+        if ( !runPipelineSuite( threshold, options ) )
+            return 1;
+    }
+    else if ( mode == "delta" )
+    {
+        if ( !parseBenchmarkOptions( argc, argv, 2, options ) )
+            return 1;
+
+        std::cout
+            << "Running delta counting suite with rows=" << options.rows
+            << ", cols=" << options.cols
+            << ", maxThreads=" << options.maxThreads
+            << ", iterations=" << options.iterations << std::endl
+        ;
+
+        if ( !runDeltaSuite( threshold, options ) )
+            return 1;
+    }
+    else if ( mode == "genfile" )
+    {
+        if ( !parseBenchmarkOptions( argc, argv, 2, options ) )
+            return 1;
+        if ( options.file.empty() )
+        {
+            std::cerr << "Error: genfile needs --file <path>.\n";
+            return 1;
+        }
+        if ( !writeMatrixFile( options.file, options.rows, options.cols ) )
+            return 1;
+    }
+    else if ( mode == "mmap" )
+    {
+        if ( !parseBenchmarkOptions( argc, argv, 2, options ) )
+            return 1;
+        if ( options.file.empty() )
+        {
+            std::cerr << "Error: mmap needs --file <path>.\n";
+            return 1;
+        }
+
+        std::cout
+            << "Running streaming benchmarks on " << options.file
+            << " with cols=" << options.cols
+            << ", maxThreads=" << options.maxThreads
+            << ", iterations=" << options.iterations << std::endl
+        ;
+
+        if ( !runMappedSuite( threshold, options ) )
+            return 1;
+    }
+    else
+    {
+        const int numThreads = 10;
+
+        Matrix image = generateMatrix( defaultRows, defaultCols );
 
         {
             Timer< std::micro > timer( "countWithContainer" );
@@ -352,6 +2585,16 @@ int main ( int argc, char* argv[] )
             Timer< std::micro > timer( "countWithLocalCounter" );
             long long count1 = countWithLocalCounter(image, threshold, numThreads);
         }
+
+        FlatMatrix flatImage =
+            generateMatrix< FlatMatrix >( defaultRows, defaultCols );
+
+        {
+            Timer< std::micro > timer( "countWithLocalCounter (flat)" );
+            long long count1 =
+                countWithLocalCounter(flatImage, threshold, numThreads);
+            doNotOptimize( count1 );
+        }
     }
     return 0;
 }
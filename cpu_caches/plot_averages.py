@@ -7,13 +7,34 @@ import matplotlib.pyplot as plt
 from watchdog.observers import Observer
 from watchdog.events import FileSystemEventHandler
 
+def plot_strides(df, ax):
+    """
+    Plot the time per entity against the stride, one line per layout, for
+    the CSV written by oo_benchmark_array_sizes (columns Layout, StrideBytes,
+    NsPerEntity, ...).
+    """
+    ax.clear()
+    for layout, rows in df.groupby("Layout", sort=False):
+        rows = rows.sort_values("StrideBytes")
+        ax.plot(rows["StrideBytes"], rows["NsPerEntity"], marker='o',
+                label=layout)
+    ax.set_xscale('log', base=2)
+    ax.set_xlabel('Stride (bytes per entity)')
+    ax.set_ylabel('Average Time per Entity (ns)')
+    ax.set_title('Entity Update Time vs Stride')
+    ax.legend()
+    ax.grid(True)
+    plt.draw()
+
 def read_and_plot(filename, ax):
     """
     Read the CSV file and update the average plot on the given axes.
-    Assumes the file has the following structure:
+    A file with a StrideBytes column is plotted by plot_strides. Otherwise
+    the file is assumed to have the following structure:
       Row 0: "ThreadCount", t1, t2, ..., tN
-      Row 1: "ContainerAvg", avg1, avg2, ..., avgN
-      Row 3: "LocalCounterAvg", avg1, avg2, ..., avgN
+      "ContainerAvg", v1, v2, ..., vN
+      "LocalCounterAvg", v1, v2, ..., vN
+    Other rows (more series, counters, ...) are ignored.
     """
     try:
         df = pd.read_csv(filename, header=None)
@@ -21,10 +42,25 @@ def read_and_plot(filename, ax):
         print(f"Error reading file: {e}")
         return
 
+    if "StrideBytes" in df.iloc[0].tolist():
+        df.columns = df.iloc[0]
+        df = df.iloc[1:].reset_index(drop=True)
+        try:
+            for column in ("StrideBytes", "NsPerEntity"):
+                df[column] = df[column].astype(float)
+        except Exception as e:
+            print(f"Error processing CSV data: {e}")
+            return
+        plot_strides(df, ax)
+        return
+
     try:
+        rows = df.set_index(0)
         thread_counts = list(map(int, df.iloc[0, 1:].tolist()))
-        container_avg = list(map(float, df.iloc[1, 1:].tolist()))
-        localcounter_avg = list(map(float, df.iloc[3, 1:].tolist()))
+        container_avg = list(map(float, rows.loc["ContainerAvg"].tolist()))
+        localcounter_avg = list(
+            map(float, rows.loc["LocalCounterAvg"].tolist())
+        )
     except Exception as e:
         print(f"Error processing CSV data: {e}")
         return
@@ -8,7 +8,7 @@ import pandas as pd
 import matplotlib
 import matplotlib.pyplot as plt
 
-def update_plot(ax1, ax2, file_path):
+def update_plot(ax1, ax2, file_path, metric='Avg'):
     """Clear ax1, ax2 and re-plot data from 'file_path'."""
     ax1.clear()
     ax2.clear()
@@ -16,22 +16,24 @@ def update_plot(ax1, ax2, file_path):
     df = pd.read_csv(file_path, header=None)
     x = df.iloc[0, 1:].astype(float)
 
-    container_avg = df.iloc[1, 1:].astype(float)
-    container_std = df.iloc[2, 1:].astype(float)
-    local_avg     = df.iloc[3, 1:].astype(float)
-    local_std     = df.iloc[4, 1:].astype(float)
+    # Every metric row is labelled "<Series><Metric>"; plot the chosen metric
+    # (Avg by default) and the Std rows of all series present
+    # (nested, flat, padded layouts, ...). Text rows such as "Pages" and the
+    # key "Distribution" of search_throughput.csv are skipped.
+    for _, row in df.iloc[1:].iterrows():
+        label = str(row.iloc[0])
+        if label.endswith(metric):
+            ax1.plot(x, row.iloc[1:].astype(float), marker='o', label=label)
+        elif label.endswith('Std'):
+            ax2.plot(x, row.iloc[1:].astype(float), marker='o', label=label)
 
     # Plot Averages
-    ax1.plot(x, container_avg, marker='o', label='ContainerAvg')
-    ax1.plot(x, local_avg,     marker='o', label='LocalCounterAvg')
-    ax1.set_title('Averages')
+    ax1.set_title('Averages' if metric == 'Avg' else metric)
     ax1.set_xlabel('ThreadCount')
-    ax1.set_ylabel('Average')
+    ax1.set_ylabel('Average' if metric == 'Avg' else metric)
     ax1.legend()
 
     # Plot Standard Deviations
-    ax2.plot(x, container_std, marker='o', label='ContainerStd')
-    ax2.plot(x, local_std,     marker='o', label='LocalCounterStd')
     ax2.set_title('Standard Deviations')
     ax2.set_xlabel('ThreadCount')
     ax2.set_ylabel('Std')
@@ -42,7 +44,7 @@ def update_plot(ax1, ax2, file_path):
 
 
 
-def watch_file(file_path, ax1, ax2, check_interval=1.0):
+def watch_file(file_path, ax1, ax2, metric='Avg', check_interval=1.0):
     """
     Background thread that checks for CSV file changes every 'check_interval'
     seconds and updates the plot if changed.
@@ -59,7 +61,7 @@ def watch_file(file_path, ax1, ax2, check_interval=1.0):
             if current_mod_time != last_mod_time:
                 last_mod_time = current_mod_time
                 print("File changed, updating plot...")
-                update_plot(ax1, ax2, file_path)
+                update_plot(ax1, ax2, file_path, metric)
         except Exception as e:
             print("Error watching file:", e)
 
@@ -68,6 +70,9 @@ def main():
     parser.add_argument('file', help='Path to the CSV file')
     parser.add_argument('--vertical', action='store_true',
                         help='Arrange plots vertically instead of side-by-side')
+    parser.add_argument('--metric', default='Avg',
+                        help='Row suffix to plot on the left, e.g. GBps or '
+                             'LookupsPerSec (default: Avg)')
     args = parser.parse_args()
 
     # Create a single figure/axes pair for the entire session
@@ -77,12 +82,12 @@ def main():
         fig, (ax1, ax2) = plt.subplots(1, 2, figsize=(12, 5))
 
     # Initial plot
-    update_plot(ax1, ax2, args.file)
+    update_plot(ax1, ax2, args.file, args.metric)
 
     # Start the background watcher thread
     watcher = threading.Thread(
         target=watch_file,
-        args=(args.file, ax1, ax2),
+        args=(args.file, ax1, ax2, args.metric),
         daemon=True
     )
     watcher.start()
@@ -8,8 +8,12 @@ import pandas as pd
 import matplotlib
 import matplotlib.pyplot as plt
 
-def update_plot(ax1, ax2, file_path):
-    """Clear ax1, ax2 and re-plot data from 'file_path'."""
+def update_plot(ax1, ax2, file_path, build=False):
+    """Clear ax1, ax2 and re-plot data from 'file_path'.
+
+    Lookup times by default; with 'build', the container build times
+    ("<Container>BuildAvg"), which are orders of magnitude larger.
+    """
     ax1.clear()
     ax2.clear()
 
@@ -17,29 +21,23 @@ def update_plot(ax1, ax2, file_path):
     df = pd.read_csv(file_path)
     x = df["Size"].astype(float)
 
-    # Extract average values from columns
-    linear_avg = df["LinearSearchAvg"].astype(float)
-    binary_avg = df["BinarySearchAvg"].astype(float)
-    set_avg    = df["SetLookupAvg"].astype(float)
-
-    # Extract standard deviation values from columns
-    linear_std = df["LinearSearchStd"].astype(float)
-    binary_std = df["BinarySearchStd"].astype(float)
-    set_std    = df["SetLookupStd"].astype(float)
+    # Every "<Method>Avg" column has a matching "<Method>Std" column
+    methods = [c[:-len("Avg")] for c in df.columns if c.endswith("Avg")]
+    methods = [m for m in methods if m.endswith("Build") == build]
 
     # Plot Averages
-    ax1.plot(x, linear_avg, marker='o', label='LinearSearchAvg')
-    ax1.plot(x, binary_avg, marker='o', label='BinarySearchAvg')
-    ax1.plot(x, set_avg,    marker='o', label='SetLookupAvg')
+    for method in methods:
+        ax1.plot(x, df[method + "Avg"].astype(float), marker='o',
+                 label=method + 'Avg')
     ax1.set_title('Averages')
     ax1.set_xlabel('Number of Elements')
     ax1.set_ylabel('Average (ns)')
     ax1.legend()
 
     # Plot Standard Deviations
-    ax2.plot(x, linear_std, marker='o', label='LinearSearchStd')
-    ax2.plot(x, binary_std, marker='o', label='BinarySearchStd')
-    ax2.plot(x, set_std,    marker='o', label='SetLookupStd')
+    for method in methods:
+        ax2.plot(x, df[method + "Std"].astype(float), marker='o',
+                 label=method + 'Std')
     ax2.set_title('Standard Deviations')
     ax2.set_xlabel('Number of Elements')
     ax2.set_ylabel('Std (ns)')
@@ -48,7 +46,7 @@ def update_plot(ax1, ax2, file_path):
     ax1.figure.tight_layout()
     ax1.figure.canvas.draw_idle()  # Redraw without blocking
 
-def watch_file(file_path, ax1, ax2, check_interval=1.0):
+def watch_file(file_path, ax1, ax2, build=False, check_interval=1.0):
     """
     Background thread that checks for CSV file changes every 'check_interval'
     seconds and updates the plot if changed.
@@ -65,7 +63,7 @@ def watch_file(file_path, ax1, ax2, check_interval=1.0):
             if current_mod_time != last_mod_time:
                 last_mod_time = current_mod_time
                 print("File changed, updating plot...")
-                update_plot(ax1, ax2, file_path)
+                update_plot(ax1, ax2, file_path, build)
         except Exception as e:
             print("Error watching file:", e)
 
@@ -74,6 +72,8 @@ def main():
     parser.add_argument('file', help='Path to the CSV file')
     parser.add_argument('--vertical', action='store_true',
                         help='Arrange plots vertically instead of side-by-side')
+    parser.add_argument('--build', action='store_true',
+                        help='Plot container build times instead of lookups')
     args = parser.parse_args()
 
     # Create a single figure/axes pair for the entire session
@@ -83,12 +83,12 @@ def main():
         fig, (ax1, ax2) = plt.subplots(1, 2, figsize=(12, 5))
 
     # Initial plot
-    update_plot(ax1, ax2, args.file)
+    update_plot(ax1, ax2, args.file, args.build)
 
     # Start the background watcher thread
     watcher = threading.Thread(
         target=watch_file,
-        args=(args.file, ax1, ax2),
+        args=(args.file, ax1, ax2, args.build),
         daemon=True
     )
     watcher.start()
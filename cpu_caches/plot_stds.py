@@ -11,8 +11,9 @@ def read_and_plot(filename, ax):
     Read the CSV file and update the plot on the given axes.
     Assumes the file has the following structure:
       Row 0: "ThreadCount", t1, t2, ..., tN
-      Row 1: "ContainerStd", std1, std2, ..., stdN
-      Row 3: "LocalCounterStd", std1, std2, ..., stdN
+      "ContainerStd", v1, v2, ..., vN
+      "LocalCounterStd", v1, v2, ..., vN
+    Other rows (more series, counters, ...) are ignored.
     """
     try:
         df = pd.read_csv(filename, header=None)
@@ -21,9 +22,12 @@ def read_and_plot(filename, ax):
         return
 
     try:
+        rows = df.set_index(0)
         thread_counts = list(map(int, df.iloc[0, 1:].tolist()))
-        container_std = list(map(float, df.iloc[1, 1:].tolist()))
-        localcounter_std = list(map(float, df.iloc[3, 1:].tolist()))
+        container_std = list(map(float, rows.loc["ContainerStd"].tolist()))
+        localcounter_std = list(
+            map(float, rows.loc["LocalCounterStd"].tolist())
+        )
     except Exception as e:
         print(f"Error processing CSV data: {e}")
         return
@@ -3,21 +3,56 @@
  *
  * This program benchmarks two search methods (linear vs. binary)
  * on an increasingly large, sorted data set. It computes the average
- * execution time (in microseconds) and the standard deviation across
- * multiple iterations. Results are written to a CSV file.
+ * execution time (in nanoseconds) and the standard deviation, after
+ * outlier rejection, plus the median, p90, p99 and minimum.
+ * Results are written to a CSV file.
  *
  * Usage (example):
- *   ./search_benchmarks [--iterations 5] [--maxSize 1000000]
+ *   ./search_benchmarks [--iterations 30] [--max-iterations 10000]
+ *                       [--target-ci 0.01] [--warmup 3] [--maxSize 1000000]
+ *                       [--calibration memory_calibration.csv]
  *
- * By default, it will run 5 iterations for each size in an internal
- * list of sizes (e.g., 1000, 10000, 100000, etc.) up to 1,000,000.
- * Adjust or extend the sizes as needed.
+ * Every measurement is warmed up, then repeated at least --iterations
+ * times and until the 95% confidence interval of the mean is within
+ * --target-ci of the mean (or --max-iterations is reached), for each size
+ * in an internal list of sizes (e.g., 1000, 10000, 100000, etc.).
+ * Adjust or extend the sizes as needed. When memory_probe has written
+ * memory_calibration.csv (or the file given with --calibration, "" for
+ * none), the sizes around every calibrated cache level are added.
+ *
+ * Lookups are timed with TscTimer (utils/timer.h), which reads the cycle
+ * counter and subtracts the cost of reading it.
+ *
+ * Every timed lookup searches the next key of a precomputed stream (see
+ * key_stream.h), recorded in the Distribution column of each CSV. By default
+ * the single lookups always search the largest key (--keys position with
+ * --position 1), the batched and throughput sweeps uniform hits. --keys
+ * selects uniform, zipf, sequential, hits (--hit-ratio), position
+ * (--position 0..1), miss or hotset (--hot-fraction) for any sweep.
+ *
+ * With --batch <lookups>, the program instead times whole batches of
+ * lookups over the key stream, since a single lookup is below the timer
+ * resolution at small sizes. It reports nanoseconds per lookup and lookups
+ * per second and writes them to search_batched.csv.
+ *
+ * With --threads <n>, 1..n threads instead issue batched lookups against
+ * one shared, read-only table of the largest size (--no-pin leaves the
+ * threads unpinned). The aggregate lookups per second go to
+ * search_throughput.csv, laid out like the parallel_chunks CSVs.
 */
 
-#include "../utils/math.h"
-#include "../utils/timer.h"
+#include "../utils/benchmark.hpp"
+#include "../utils/cache.h"
+#include "../utils/counting_allocator.h"
+#include "../utils/page_allocator.h"
+#include "../utils/thread_pool.h"
+#include "hash_tables.h"
+#include "key_stream.h"
+#include "ordered_sets.h"
+#include "search_layouts.h"
 
 #include <algorithm>
+#include <array>
 #include <chrono>
 #include <cmath>
 #include <fstream>
@@ -25,19 +60,20 @@
 #include <random>
 #include <set>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 /*----------------------------------------------------------------------------*/
 
 using ElementType = long long;
-using TimerType = Timer<std::nano>;
-
-constexpr ElementType keyTransform ( ElementType const & _key )
-{
-    return _key * 0.5;
-}
+// Sorted data and key streams, on the pages selected with --pages.
+using KeyVector = PageVector<ElementType>;
+// Single lookups take tens of nanoseconds, about the cost of a clock call, so
+// they are timed on the cycle counter with its overhead subtracted.
+using TimerType = TscTimer<std::nano>;
 
 constexpr int ITERATIONS = 30;
+constexpr int MAX_ITERATIONS = 10000;
 
 static std::vector<ElementType> SIZES =
 {
@@ -48,23 +84,67 @@ static std::vector<ElementType> SIZES =
     100000, 200000, 500000
 };
 
+// Largest size added from the calibration: every size builds all the sets
+// and tables side by side, about 250 bytes per key.
+constexpr ElementType MAX_CALIBRATED_SIZE = ElementType{ 1 } << 22;
+
+// SIZES, plus half, one and two times the number of keys that fill each
+// cache level of the calibration written by memory_probe, which puts sizes
+// on both sides of every level, up to MAX_CALIBRATED_SIZE. Only SIZES
+// without a calibration.
+std::vector< ElementType > searchSizes ()
+{
+    std::vector< ElementType > sizes = SIZES;
+    const CacheSizes & calibrated = calibratedCacheSizes();
+    for ( std::size_t bytes : { calibrated.l1d, calibrated.l2, calibrated.l3 } )
+    {
+        const auto keys =
+            static_cast< ElementType >( bytes / sizeof( ElementType ) );
+        if ( keys < 2 )
+            continue;
+        for ( ElementType size : { keys / 2, keys, keys * 2 } )
+        {
+            if ( size <= MAX_CALIBRATED_SIZE )
+                sizes.push_back( size );
+        }
+    }
+    std::sort( sizes.begin(), sizes.end() );
+    sizes.erase( std::unique( sizes.begin(), sizes.end() ), sizes.end() );
+    return sizes;
+}
+
 constexpr int SIZE_FACTOR = 1;
 
 constexpr size_t ARRAY_SIZE = 50;
 
-/*----------------------------------------------------------------------------*/
+constexpr int BUILD_ITERATIONS = 5;
 
-template < typename T >
-inline void doNotOptimize ( const T& value )
-{
-    asm volatile( "" : : "r,m"(value) : "memory" );
-}
+// Length of the key stream the single lookups cycle through.
+constexpr size_t SINGLE_LOOKUP_KEYS = 1024;
+
+// Key distribution of every sweep unless --keys is given. Single lookups
+// search the largest key, the worst case of the linear scans; the batched
+// and throughput sweeps draw uniform hits.
+constexpr KeyDistribution SINGLE_LOOKUP_DISTRIBUTION =
+    KeyDistribution::Position;
+constexpr KeyDistribution BATCHED_DISTRIBUTION = KeyDistribution::Uniform;
+
+constexpr const char * BATCHED_FILENAME = "search_batched.csv";
+constexpr const char * THROUGHPUT_FILENAME = "search_throughput.csv";
+
+// Lookups per thread and timed region when --threads is given without
+// --batch.
+constexpr size_t DEFAULT_BATCH = 1024;
+
+// Lookups per candidate and largest candidate of the hybrid cutoff tuning.
+constexpr size_t TUNING_LOOKUPS = 1024;
+constexpr size_t MAX_HYBRID_CUTOFF = 1024;
 
 /*----------------------------------------------------------------------------*/
 
-std::vector<ElementType> generateSortedVector ( ElementType size )
+KeyVector generateSortedVector ( ElementType size )
 {
-    std::vector<ElementType> data(size);
+    KeyVector data(size);
     for (int i = 0; i < size; ++i)
     {
         data[i] = i;
@@ -74,7 +154,7 @@ std::vector<ElementType> generateSortedVector ( ElementType size )
 
 /*----------------------------------------------------------------------------*/
 
-int linearSearch ( const std::vector<ElementType>& data, ElementType key )
+int linearSearch ( const KeyVector& data, ElementType key )
 {
     for (int i = 0; i < static_cast<int>(data.size()); ++i)
     {
@@ -86,9 +166,16 @@ int linearSearch ( const std::vector<ElementType>& data, ElementType key )
     return -1;
 }
 
+// Vectorized counterpart, through the widest kernel the CPU supports.
+int simdLinearSearch ( const KeyVector& data, ElementType key )
+{
+    static const LinearSearchFunc scan = bestLinearSearch();
+    return scan( data.data(), data.size(), key );
+}
+
 /*----------------------------------------------------------------------------*/
 
-int binarySearch ( const std::vector<ElementType>& data, ElementType key )
+int binarySearch ( const KeyVector& data, ElementType key )
 {
     int left = 0;
     int right = static_cast<int>(data.size()) - 1;
@@ -113,52 +200,148 @@ int binarySearch ( const std::vector<ElementType>& data, ElementType key )
 
 /*----------------------------------------------------------------------------*/
 
+// Times single lookups: every timed call searches the next key of `keys`,
+// starting over at the end of the stream.
+template <typename LookupFunc>
+std::vector<double> runSingleLookups (
+    LookupFunc lookup,
+    const KeyVector& keys,
+    RunnerOptions const & options
+)
+{
+    size_t next = 0;
+    return runBenchmarkAdaptiveSingle< TimerType >(
+        options,
+        [ & ] ()
+        {
+            ElementType key = keys[next];
+            next = next + 1 == keys.size() ? 0 : next + 1;
+            return lookup( key );
+        }
+    );
+}
+
 template <typename SearchFunc>
 std::vector<double> runBenchmarkVec (
     SearchFunc searchFunction,
-    int size,
-    int iterations
+    const KeyVector& data,
+    const KeyVector& keys,
+    RunnerOptions const & options
 )
 {
-    // Generate a sorted vector of the requested size
-    std::vector<ElementType> data = generateSortedVector( size );
-    // The key is at the very end to ensure worst-case for linear search
-    int key = data[size - 1];
+    return runSingleLookups(
+        [ & ] ( ElementType key ) -> ElementType
+        {
+            return searchFunction( data, key );
+        },
+        keys, options
+    );
+}
 
-    std::vector<double> times;
-    times.reserve(iterations);
+/*----------------------------------------------------------------------------*/
 
-    for (int i = 0; i < iterations; ++i)
-    {
-        TimerType timer("Search iteration");
-        ElementType result = searchFunction(data, key);
-        doNotOptimize(result);
-        double duration = timer.stop();
-        times.push_back(duration);
-    }
+// Insertion order of the ordered containers: the keys shuffled with a fixed
+// seed, as a container filled over time would see them. Inserting sorted keys
+// would hand out nodes in key order and hide the effect of the allocator.
+KeyVector insertionOrder ( const KeyVector& data )
+{
+    KeyVector keys = data;
+    std::shuffle( keys.begin(), keys.end(), std::mt19937_64( 12345 ) );
+    return keys;
+}
+
+std::set<ElementType> buildStdSet ( const KeyVector& keys )
+{
+    std::set<ElementType> s;
+    for ( ElementType key : keys )
+        s.insert( key );
+    return s;
+}
 
-    return times;
+// FlatMap input: every key maps to itself.
+std::vector< std::pair<ElementType, ElementType> > keyValuePairs (
+    const KeyVector& keys
+)
+{
+    std::vector< std::pair<ElementType, ElementType> > pairs;
+    pairs.reserve( keys.size() );
+    for ( ElementType key : keys )
+        pairs.emplace_back( key, key );
+    return pairs;
 }
 
+using FlatSearchMap = FlatMap<ElementType, ElementType>;
+
+// Heap bytes of a standard container filled with `keys`, measured on a twin
+// that allocates through CountingAllocator.
+template <typename CountedContainer>
+std::size_t allocatedBytes ( const KeyVector& keys )
+{
+    std::size_t bytes = 0;
+    CountingAllocator<ElementType> allocator( bytes );
+    CountedContainer container( allocator );
+    for ( ElementType key : keys )
+        container.insert( key );
+    return bytes;
+}
+
+using CountedSet = std::set<
+    ElementType, std::less<ElementType>, CountingAllocator<ElementType>
+>;
+using CountedUnorderedSet = std::unordered_set<
+    ElementType, std::hash<ElementType>, std::equal_to<ElementType>,
+    CountingAllocator<ElementType>
+>;
+
 /*----------------------------------------------------------------------------*/
 
+// Works for every container with std::set's find: std::set, PmrArenaSet,
+// PoolSet, FlatMap.
+template <typename SetType>
 std::vector<double> runBenchmarkSet(
-    const std::set<ElementType>& s,
-    ElementType key,
-    int iterations
+    const SetType& s,
+    const KeyVector& keys,
+    RunnerOptions const & options
 )
 {
-    std::vector<double> times;
-    times.reserve(iterations);
-    for (int i = 0; i < iterations; ++i)
-    {
-        TimerType timer("Set lookup iteration");
-        auto result = s.find(key);
-        doNotOptimize(result);
-        double duration = timer.stop();
-        times.push_back(duration);
-    }
-    return times;
+    return runSingleLookups(
+        [ & ] ( ElementType key ) { return s.find( key ); }, keys, options
+    );
+}
+
+// Time to build a container from `keys`; `build` returns it by value, so it
+// is destroyed after the timer stopped. Builds are slow, so at most
+// BUILD_ITERATIONS are run, after at most one warmup build.
+template <typename BuildFunc>
+std::vector<double> runBenchmarkBuild (
+    BuildFunc build,
+    RunnerOptions const & options
+)
+{
+    RunnerOptions buildOptions = options;
+    buildOptions.warmupIterations = std::min( options.warmupIterations, 1 );
+    buildOptions.minIterations =
+        std::min( options.minIterations, BUILD_ITERATIONS );
+    buildOptions.maxIterations =
+        std::min( options.maxIterations, BUILD_ITERATIONS );
+    return runBenchmarkAdaptiveSingle< TimerType >(
+        buildOptions, build
+    );
+}
+
+// Same measurement for a search structure built from the sorted vector.
+template <typename Layout>
+std::vector<double> runBenchmarkLayout (
+    const KeyVector& data,
+    const KeyVector& keys,
+    RunnerOptions const & options
+)
+{
+    Layout layout( data );
+    return runSingleLookups(
+        [ & ] ( ElementType key ) { return layout.search( key ); },
+        keys, options
+    );
 }
 
 /*----------------------------------------------------------------------------*/
@@ -187,43 +370,222 @@ int linearSearchArray ( const std::array<ElementType, N>& arr, ElementType key )
     return -1;
 }
 
-// Run benchmark for linear search on an std::array.
-std::vector<double> runBenchmarkArrayLinear ( int iterations )
+// Run benchmark for linear search on an std::array, with the scalar loop or
+// the vectorized kernel.
+std::vector<double> runBenchmarkArrayLinear (
+    RunnerOptions const & options, bool simd
+)
 {
     constexpr size_t N = ARRAY_SIZE;
     std::array<ElementType, N> arr = generateSortedArray<N>();
     ElementType key = arr[N - 1]; // Worst-case scenario.
-    std::vector<double> times;
-    times.reserve(iterations);
-    for (int i = 0; i < iterations; ++i)
+    if ( simd )
+    {
+        LinearSearchFunc scan = bestLinearSearch();
+        return runBenchmarkAdaptiveSingle< TimerType >(
+            options, [ & ] () { return scan( arr.data(), N, key ); }
+        );
+    }
+    return runBenchmarkAdaptiveSingle< TimerType >(
+        options, [ & ] () { return linearSearchArray( arr, key ); }
+    );
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Average hardware counters of the iterations recorded since the last call.
+PerfCounts takePerfCounts ()
+{
+    PerfRecorder * recorder = PerfRecorder::active();
+    if ( !recorder || recorder->samples().empty() )
+        return PerfCounts();
+    PerfCounts counts =
+        recorder->groupAverages( recorder->samples().size() ).front();
+    recorder->clear();
+    return counts;
+}
+
+/*----------------------------------------------------------------------------*/
+
+// One batched measurement: every timed region runs `lookup` over the whole
+// key stream, so timer overhead is amortized over thousands of lookups.
+// Lookups are independent, so this measures throughput rather than the
+// latency of a dependent chain. `perf` holds the counters per lookup.
+struct BatchedLookupResult
+{
+    BenchmarkStats stats;
+    double nsPerLookup = 0.0;
+    double nsPerLookupStd = 0.0;
+    double nsPerLookupMedian = 0.0;
+    double lookupsPerSec = 0.0;
+    PerfCounts perf;
+};
+
+template <typename LookupFunc>
+BatchedLookupResult runBatchedLookups (
+    LookupFunc lookup,
+    const KeyVector& keys,
+    RunnerOptions const & options
+)
+{
+    auto times = runBenchmarkAdaptiveSingle< TimerType >(
+        options,
+        [ & ] ()
+        {
+            // Summing the results keeps every lookup alive.
+            long long checksum = 0;
+            for ( ElementType key : keys )
+                checksum += lookup( key );
+            return checksum;
+        }
+    );
+
+    BatchedLookupResult result;
+    result.stats = computeBenchmarkStats( times, options.filter );
+    // Nanoseconds per timer unit, divided over the batch.
+    const double scale = 1e9 * TimerType::Ratio::num / TimerType::Ratio::den
+        / static_cast<double>( keys.size() );
+    result.nsPerLookup = result.stats.mean * scale;
+    result.nsPerLookupStd = result.stats.stdDev * scale;
+    result.nsPerLookupMedian = result.stats.median * scale;
+    result.lookupsPerSec = 1e9 / result.nsPerLookup;
+    result.perf = takePerfCounts();
+    for ( double & value : result.perf.values )
+    {
+        if ( value >= 0 )
+            value /= static_cast<double>( keys.size() );
+    }
+    return result;
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Pick the HybridSearch cutoff with the lowest median batched lookup time on
+// `data`: powers of two from 4 up to the first one covering the whole vector
+// (a pure scan), at most MAX_HYBRID_CUTOFF. Measured with uniform keys and a
+// short, fixed budget per candidate.
+std::size_t tuneHybridCutoff ( const KeyVector& data )
+{
+    KeyStreamOptions keyOptions;
+    KeyVector keys =
+        generateKeyStream( data, TUNING_LOOKUPS, keyOptions );
+
+    RunnerOptions tuning;
+    tuning.warmupIterations = 1;
+    tuning.minIterations = 5;
+    tuning.maxIterations = 50;
+    tuning.targetRelativeCi = 0.02;
+    tuning.maxSeconds = 0.05;
+
+    std::size_t best = 0;
+    double bestTime = 0.0;
+    for ( std::size_t cutoff = 4; cutoff <= MAX_HYBRID_CUTOFF; cutoff *= 2 )
     {
-        TimerType timer("Array linear search iteration");
-        int result = linearSearchArray(arr, key);
-        doNotOptimize(result);
-        double duration = timer.stop();
-        times.push_back(duration);
+        HybridSearch hybrid( cutoff );
+        BatchedLookupResult result = runBatchedLookups(
+            [ & ] ( ElementType key ) { return hybrid( data, key ); },
+            keys, tuning
+        );
+        if ( best == 0 || result.nsPerLookupMedian < bestTime )
+        {
+            best = cutoff;
+            bestTime = result.nsPerLookupMedian;
+        }
+        if ( cutoff >= data.size() )
+            break;
     }
-    return times;
+    return best;
 }
 
 /*----------------------------------------------------------------------------*/
 
+// Measurements of one search method over the size sweep: the
+// outlier-filtered mean and deviation, the full statistics and the average
+// counters per size. `bytes` holds the heap footprint of the searched
+// structure per size; it stays empty for methods that search another one's
+// structure, or that have no footprint of their own (the builds).
+struct SearchMethodResults {
+    std::vector<double> avg;
+    std::vector<double> std;
+    std::vector<BenchmarkStats> stats;
+    std::vector<PerfCounts> perf;
+    std::vector<std::size_t> bytes;
+};
+
 // Structure to hold benchmark results for different search methods.
 struct SearchBenchmarkResults {
-    std::vector<double> linearAvg;
-    std::vector<double> linearStd;
-    std::vector<double> binaryAvg;
-    std::vector<double> binaryStd;
-    std::vector<double> setLookupAvg;
-    std::vector<double> setLookupStd;
+    SearchMethodResults linear;
+    SearchMethodResults binary;
+    SearchMethodResults setLookup;
+    SearchMethodResults branchless;
+    SearchMethodResults eytzinger;
+    SearchMethodResults sTree;
+    SearchMethodResults simdLinear;
+    SearchMethodResults hybrid;
+    SearchMethodResults pmrSetLookup;
+    SearchMethodResults poolSetLookup;
+    SearchMethodResults flatMapLookup;
+    SearchMethodResults unorderedSetLookup;
+    SearchMethodResults linearProbingLookup;
+    SearchMethodResults swissTableLookup;
+    // Build times of the ordered containers.
+    SearchMethodResults setBuild;
+    SearchMethodResults pmrSetBuild;
+    SearchMethodResults poolSetBuild;
+    SearchMethodResults flatMapBuild;
+    // Tuned HybridSearch cutoff per size.
+    std::vector<std::size_t> hybridCutoff;
+};
+
+// A column group of the results: the CSV name, the results, and whether the
+// batched sweep times the method too (every lookup, none of the builds).
+struct SearchMethod
+{
+    const char * name;
+    const SearchMethodResults * results;
+    bool batched;
 };
 
+// Every method, in column order.
+std::vector< SearchMethod >
+searchMethods ( const SearchBenchmarkResults & results )
+{
+    return {
+        { "LinearSearch", &results.linear, true },
+        { "BinarySearch", &results.binary, true },
+        { "SetLookup", &results.setLookup, true },
+        { "BranchlessBinarySearch", &results.branchless, true },
+        { "Eytzinger", &results.eytzinger, true },
+        { "STree", &results.sTree, true },
+        { "SimdLinearSearch", &results.simdLinear, true },
+        { "HybridSearch", &results.hybrid, true },
+        { "PmrSetLookup", &results.pmrSetLookup, true },
+        { "PoolSetLookup", &results.poolSetLookup, true },
+        { "FlatMapLookup", &results.flatMapLookup, true },
+        { "UnorderedSetLookup", &results.unorderedSetLookup, true },
+        { "LinearProbingLookup", &results.linearProbingLookup, true },
+        { "SwissTableLookup", &results.swissTableLookup, true },
+        { "SetBuild", &results.setBuild, false },
+        { "PmrSetBuild", &results.pmrSetBuild, false },
+        { "PoolSetBuild", &results.poolSetBuild, false },
+        { "FlatMapBuild", &results.flatMapBuild, false }
+    };
+}
+
 /*----------------------------------------------------------------------------*/
 
+// Columns: "Size", "Distribution" (keyStreamDescription of the lookup
+// keys) and "Pages" (pageDescription of the data), "<Method>Avg" and
+// "<Method>Std" for every method, then "<Method>Median", "<Method>P90",
+// "<Method>P99" and "<Method>Min", then a "<Method><Event>" column for every
+// event in `events`, the tuned "HybridCutoff", and last "<Method>Bytes" for
+// every method with a footprint.
 void writeResultsToCSV (
     const std::string& filename,
     const std::vector<ElementType>& sizes,
-    const SearchBenchmarkResults & results
+    KeyStreamOptions const & keyOptions,
+    const SearchBenchmarkResults & results,
+    const std::vector<PerfEvent> & events
 )
 {
     std::ofstream ofs( filename );
@@ -235,16 +597,53 @@ void writeResultsToCSV (
         return;
     }
 
-    ofs << "Size,LinearSearchAvg,LinearSearchStd,BinarySearchAvg,BinarySearchStd,SetLookupAvg,SetLookupStd\n";
+    const auto methods = searchMethods( results );
+    const std::string distribution = keyStreamDescription( keyOptions );
+    const std::string pages = pageDescription();
+
+    ofs << "Size,Distribution,Pages";
+    for ( const auto & [ name, method, batched ] : methods )
+        ofs << "," << name << "Avg," << name << "Std";
+    for ( const auto & [ name, method, batched ] : methods )
+    {
+        for ( const char * column : { "Median", "P90", "P99", "Min" } )
+            ofs << "," << name << column;
+    }
+    for ( PerfEvent event : events )
+    {
+        for ( const auto & [ name, method, batched ] : methods )
+            ofs << "," << name << perfEventName( event );
+    }
+    ofs << ",HybridCutoff";
+    for ( const auto & [ name, method, batched ] : methods )
+    {
+        if ( !method->bytes.empty() )
+            ofs << "," << name << "Bytes";
+    }
+    ofs << "\n";
     for (size_t i = 0; i < sizes.size(); ++i)
     {
-        ofs << sizes[i] << ","
-            << results.linearAvg[i] << ","
-            << results.linearStd[i] << ","
-            << results.binaryAvg[i] << ","
-            << results.binaryStd[i] << ","
-            << results.setLookupAvg[i] << ","
-            << results.setLookupStd[i] << "\n";
+        ofs << sizes[i] << "," << distribution << "," << pages;
+        for ( const auto & [ name, method, batched ] : methods )
+            ofs << "," << method->avg[i] << "," << method->std[i];
+        for ( const auto & [ name, method, batched ] : methods )
+        {
+            const BenchmarkStats & st = method->stats[i];
+            ofs << "," << st.median << "," << st.p90
+                << "," << st.p99 << "," << st.min;
+        }
+        for ( PerfEvent event : events )
+        {
+            for ( const auto & [ name, method, batched ] : methods )
+                ofs << "," << method->perf[i][event];
+        }
+        ofs << "," << results.hybridCutoff[i];
+        for ( const auto & [ name, method, batched ] : methods )
+        {
+            if ( !method->bytes.empty() )
+                ofs << "," << method->bytes[i];
+        }
+        ofs << "\n";
     }
 
     ofs.close();
@@ -253,99 +652,686 @@ void writeResultsToCSV (
 
 /*----------------------------------------------------------------------------*/
 
+// Append the statistics of one measurement, and the counters recorded for
+// it, to `method`. Returns the filtered mean.
+double recordSearchTimes (
+    SearchMethodResults & method,
+    const std::vector<double>& times,
+    RunnerOptions const & options
+)
+{
+    BenchmarkStats stats = computeBenchmarkStats( times, options.filter );
+    method.avg.push_back( stats.mean );
+    method.std.push_back( stats.stdDev );
+    method.stats.push_back( stats );
+    method.perf.push_back( takePerfCounts() );
+    return stats.mean;
+}
+
 void runSearchBenchmarks (
     const std::vector<ElementType>& sizes,
-    int iterations,
+    KeyStreamOptions const & keyOptions,
+    RunnerOptions const & options,
     SearchBenchmarkResults& results
 )
 {
-    // Resize result vectors to match the number of sizes.
-    results.linearAvg.resize(sizes.size(), 0.0);
-    results.linearStd.resize(sizes.size(), 0.0);
-    results.binaryAvg.resize(sizes.size(), 0.0);
-    results.binaryStd.resize(sizes.size(), 0.0);
-    results.setLookupAvg.resize(sizes.size(), 0.0);
-    results.setLookupStd.resize(sizes.size(), 0.0);
-
     for (size_t i = 0; i < sizes.size(); ++i)
     {
         int size = sizes[i];
 
         // Prepare data for vector-based searches.
-        std::vector<ElementType> data = generateSortedVector(size);
+        KeyVector data = generateSortedVector(size);
 
         for ( int i = 0; i < data.size(); ++i )
         {
             doNotOptimize( data[ i ] );
         }
 
-        int key = keyTransform( data.back() );
+        // Every method searches the same key stream.
+        KeyVector lookups =
+            generateKeyStream( data, SINGLE_LOOKUP_KEYS, keyOptions );
 
         // Run linear search benchmark.
-        auto linearTimes = runBenchmarkVec(linearSearch, key, iterations);
-        double sumLinear = 0.0;
-        for (auto t : linearTimes) sumLinear += t;
-        double avgLinear = sumLinear / linearTimes.size();
-        double stdLinear = calculateStdDev(linearTimes, avgLinear);
-        results.linearAvg[i] = avgLinear;
-        results.linearStd[i] = stdLinear;
+        double avgLinear = recordSearchTimes(
+            results.linear,
+            runBenchmarkVec(linearSearch, data, lookups, options), options
+        );
 
         // Run binary search benchmark.
-        auto binaryTimes = runBenchmarkVec(binarySearch, key, iterations);
-        double sumBinary = 0.0;
-        for (auto t : binaryTimes) sumBinary += t;
-        double avgBinary = sumBinary / binaryTimes.size();
-        double stdBinary = calculateStdDev(binaryTimes, avgBinary);
-        results.binaryAvg[i] = avgBinary;
-        results.binaryStd[i] = stdBinary;
+        double avgBinary = recordSearchTimes(
+            results.binary,
+            runBenchmarkVec(binarySearch, data, lookups, options), options
+        );
 
         // Run set lookup
         // Build a std::set from the vector for set lookup.
-        std::set<ElementType> s(data.begin(), data.end());
-        auto setTimes = runBenchmarkSet(s, key, iterations );
-        double sumSet = 0.0;
-        for (auto t : setTimes) sumSet += t;
-        double avgSet = sumSet / setTimes.size();
-        double stdSet = calculateStdDev(setTimes, avgSet);
-        results.setLookupAvg[i] = avgSet;
-        results.setLookupStd[i] = stdSet;
+        KeyVector order = insertionOrder(data);
+        std::set<ElementType> s = buildStdSet(order);
+        double avgSet = recordSearchTimes(
+            results.setLookup, runBenchmarkSet(s, lookups, options ), options
+        );
+
+        // The same tree over arena-allocated nodes, and a flat map.
+        PmrArenaSet<ElementType> pmrSet(order);
+        PoolSet<ElementType> poolSet(order);
+        FlatSearchMap flatMap(keyValuePairs(order));
+        double avgPmrSet = recordSearchTimes(
+            results.pmrSetLookup, runBenchmarkSet(pmrSet, lookups, options),
+            options
+        );
+        double avgPoolSet = recordSearchTimes(
+            results.poolSetLookup, runBenchmarkSet(poolSet, lookups, options),
+            options
+        );
+        double avgFlatMap = recordSearchTimes(
+            results.flatMapLookup, runBenchmarkSet(flatMap, lookups, options),
+            options
+        );
+
+        // Hash tables, filled in the same order.
+        std::unordered_set<ElementType> unorderedSet(
+            order.begin(), order.end()
+        );
+        LinearProbingSet<ElementType> linearProbing(order);
+        SwissTable<ElementType> swissTable(order);
+        double avgUnorderedSet = recordSearchTimes(
+            results.unorderedSetLookup,
+            runBenchmarkSet(unorderedSet, lookups, options), options
+        );
+        double avgLinearProbing = recordSearchTimes(
+            results.linearProbingLookup,
+            runBenchmarkSet(linearProbing, lookups, options), options
+        );
+        double avgSwissTable = recordSearchTimes(
+            results.swissTableLookup,
+            runBenchmarkSet(swissTable, lookups, options), options
+        );
+
+        // Footprints. The vector searches share the sorted vector, listed
+        // once under BinarySearch.
+        results.binary.bytes.push_back(
+            data.capacity() * sizeof(ElementType)
+        );
+        results.setLookup.bytes.push_back( allocatedBytes<CountedSet>(order) );
+        results.pmrSetLookup.bytes.push_back( pmrSet.memoryBytes() );
+        results.poolSetLookup.bytes.push_back( poolSet.memoryBytes() );
+        results.flatMapLookup.bytes.push_back( flatMap.memoryBytes() );
+        results.eytzinger.bytes.push_back(
+            EytzingerLayout<ElementType>(data).memoryBytes()
+        );
+        results.sTree.bytes.push_back( STree(data).memoryBytes() );
+        results.unorderedSetLookup.bytes.push_back(
+            allocatedBytes<CountedUnorderedSet>(order)
+        );
+        results.linearProbingLookup.bytes.push_back(
+            linearProbing.memoryBytes()
+        );
+        results.swissTableLookup.bytes.push_back( swissTable.memoryBytes() );
+
+        // Build times from the same insertion order.
+        auto pairs = keyValuePairs(order);
+        recordSearchTimes(
+            results.setBuild,
+            runBenchmarkBuild(
+                [ & ] () { return buildStdSet(order); }, options
+            ),
+            options
+        );
+        recordSearchTimes(
+            results.pmrSetBuild,
+            runBenchmarkBuild(
+                [ & ] () { return PmrArenaSet<ElementType>(order); }, options
+            ),
+            options
+        );
+        recordSearchTimes(
+            results.poolSetBuild,
+            runBenchmarkBuild(
+                [ & ] () { return PoolSet<ElementType>(order); }, options
+            ),
+            options
+        );
+        recordSearchTimes(
+            results.flatMapBuild,
+            runBenchmarkBuild(
+                [ & ] () { return FlatSearchMap(pairs); }, options
+            ),
+            options
+        );
+
+        // Cache-friendly layouts, measured like the vector searches.
+        double avgBranchless = recordSearchTimes(
+            results.branchless,
+            runBenchmarkVec(
+                branchlessBinarySearch<
+                    ElementType, KeyVector::allocator_type
+                >,
+                data, lookups, options
+            ),
+            options
+        );
+        double avgEytzinger = recordSearchTimes(
+            results.eytzinger,
+            runBenchmarkLayout< EytzingerLayout<ElementType> >(
+                data, lookups, options
+            ),
+            options
+        );
+        double avgSTree = recordSearchTimes(
+            results.sTree,
+            runBenchmarkLayout< STree >(data, lookups, options), options
+        );
+
+        // Vectorized scan, and the hybrid with the cutoff tuned for this size.
+        double avgSimdLinear = recordSearchTimes(
+            results.simdLinear,
+            runBenchmarkVec(simdLinearSearch, data, lookups, options), options
+        );
+        HybridSearch hybrid( tuneHybridCutoff( data ) );
+        results.hybridCutoff.push_back( hybrid.cutoff() );
+        double avgHybrid = recordSearchTimes(
+            results.hybrid,
+            runBenchmarkVec(hybrid, data, lookups, options), options
+        );
 
         std::cout << "Size: " << size
                 << " | Linear Avg: " << avgLinear << TimerType::unit()
                 << " | Set Lookup Avg: " << avgSet << TimerType::unit()
-                << " | Binary Avg: " << avgBinary << TimerType::unit() << "\n"
+                << " | Binary Avg: " << avgBinary << TimerType::unit()
+                << " | Branchless Avg: " << avgBranchless << TimerType::unit()
+                << " | Eytzinger Avg: " << avgEytzinger << TimerType::unit()
+                << " | STree Avg: " << avgSTree << TimerType::unit()
+                << " | SIMD Linear Avg: " << avgSimdLinear << TimerType::unit()
+                << " | Hybrid Avg: " << avgHybrid << TimerType::unit()
+                << " (cutoff " << hybrid.cutoff() << ")"
+                << " | Pmr Set Avg: " << avgPmrSet << TimerType::unit()
+                << " | Pool Set Avg: " << avgPoolSet << TimerType::unit()
+                << " | Flat Map Avg: " << avgFlatMap << TimerType::unit()
+                << " | Unordered Set Avg: " << avgUnorderedSet
+                << TimerType::unit()
+                << " | Linear Probing Avg: " << avgLinearProbing
+                << TimerType::unit()
+                << " | Swiss Table Avg: " << avgSwissTable << TimerType::unit()
+                << "\n"
+        ;
+    }
+}
+
+// Smallest size from which binary search beats the linear scan `linear` for
+// good, 0 if it never does.
+ElementType linearBinaryCrossover (
+    const std::vector<ElementType>& sizes,
+    const SearchMethodResults & linear,
+    const SearchMethodResults & binary
+)
+{
+    ElementType crossover = 0;
+    for ( size_t i = sizes.size(); i-- > 0; )
+    {
+        if ( binary.avg[i] >= linear.avg[i] )
+            break;
+        crossover = sizes[i];
+    }
+    return crossover;
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Methods of the batched sweep, the batched ones of searchMethods in column
+// order, which is also the order of every results row.
+const std::vector<std::string> BATCHED_METHODS = [] ()
+{
+    const SearchBenchmarkResults none;
+    std::vector<std::string> names;
+    for ( const SearchMethod & method : searchMethods( none ) )
+    {
+        if ( method.batched )
+            names.push_back( method.name );
+    }
+    return names;
+} ();
+
+// Results of one size: a measurement per method, in the order of
+// BATCHED_METHODS, and the HybridSearch cutoff tuned for it.
+struct BatchedSearchRow
+{
+    std::vector<BatchedLookupResult> methods;
+    std::size_t hybridCutoff = 0;
+};
+
+// Columns per method: "<Method>NsPerLookup", "<Method>NsPerLookupStd",
+// "<Method>NsPerLookupMedian", "<Method>LookupsPerSec", then a
+// "<Method><Event>" column, per lookup, for every event in `events`, and last
+// "HybridCutoff".
+void writeBatchedResultsToCSV (
+    const std::string& filename,
+    const std::vector<ElementType>& sizes,
+    KeyStreamOptions const & keyOptions,
+    const std::vector<BatchedSearchRow>& rows,
+    const std::vector<PerfEvent> & events
+)
+{
+    std::ofstream ofs( filename );
+    if ( !ofs )
+    {
+        std::cerr
+            << "Error: cannot open file " << filename << " for writing.\n"
         ;
+        return;
+    }
+
+    const std::string distribution = keyStreamDescription( keyOptions );
+    const std::string pages = pageDescription();
+
+    ofs << "Size,Distribution,Pages";
+    for ( const std::string & method : BATCHED_METHODS )
+    {
+        ofs << "," << method << "NsPerLookup"
+            << "," << method << "NsPerLookupStd"
+            << "," << method << "NsPerLookupMedian"
+            << "," << method << "LookupsPerSec";
+    }
+    for ( PerfEvent event : events )
+    {
+        for ( const std::string & method : BATCHED_METHODS )
+            ofs << "," << method << perfEventName( event );
+    }
+    ofs << ",HybridCutoff\n";
+    for ( size_t i = 0; i < sizes.size(); ++i )
+    {
+        ofs << sizes[i] << "," << distribution << "," << pages;
+        for ( const BatchedLookupResult & r : rows[i].methods )
+        {
+            ofs << "," << r.nsPerLookup << "," << r.nsPerLookupStd
+                << "," << r.nsPerLookupMedian << "," << r.lookupsPerSec;
+        }
+        for ( PerfEvent event : events )
+        {
+            for ( const BatchedLookupResult & r : rows[i].methods )
+                ofs << "," << r.perf[event];
+        }
+        ofs << "," << rows[i].hybridCutoff << "\n";
+    }
+
+    ofs.close();
+    std::cout << "Benchmark results written to " << filename << std::endl;
+}
+
+// Batched counterpart of runSearchBenchmarks: `batchSize` lookups drawn from
+// `keyOptions` per timed region. Returns one row per size.
+std::vector<BatchedSearchRow> runBatchedSearchBenchmarks (
+    const std::vector<ElementType>& sizes,
+    size_t batchSize,
+    KeyStreamOptions const & keyOptions,
+    RunnerOptions const & options
+)
+{
+    std::vector<BatchedSearchRow> rows;
+    for ( ElementType size : sizes )
+    {
+        KeyVector data = generateSortedVector( size );
+        KeyVector order = insertionOrder( data );
+        std::set<ElementType> s = buildStdSet( order );
+        PmrArenaSet<ElementType> pmrSet( order );
+        PoolSet<ElementType> poolSet( order );
+        FlatSearchMap flatMap( keyValuePairs( order ) );
+        std::unordered_set<ElementType> unorderedSet(
+            order.begin(), order.end()
+        );
+        LinearProbingSet<ElementType> linearProbing( order );
+        SwissTable<ElementType> swissTable( order );
+        EytzingerLayout<ElementType> eytzinger( data );
+        STree sTree( data );
+        LinearSearchFunc simdScan = bestLinearSearch();
+        HybridSearch hybrid( tuneHybridCutoff( data ) );
+        KeyVector keys =
+            generateKeyStream( data, batchSize, keyOptions );
+
+        BatchedSearchRow row;
+        row.hybridCutoff = hybrid.cutoff();
+        // One measurement per entry of BATCHED_METHODS, in its order.
+        std::vector<BatchedLookupResult> & results = row.methods;
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key ) { return linearSearch( data, key ); },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key ) { return binarySearch( data, key ); },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key ) -> ElementType
+            {
+                auto it = s.find( key );
+                return it == s.end() ? -1 : *it;
+            },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key )
+            {
+                return branchlessBinarySearch( data, key );
+            },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key ) { return eytzinger.search( key ); },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key ) { return sTree.search( key ); },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key )
+            {
+                return simdScan( data.data(), data.size(), key );
+            },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key ) { return hybrid( data, key ); },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key ) -> ElementType
+            {
+                auto it = pmrSet.find( key );
+                return it == pmrSet.end() ? -1 : *it;
+            },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key ) -> ElementType
+            {
+                auto it = poolSet.find( key );
+                return it == poolSet.end() ? -1 : *it;
+            },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key ) -> ElementType
+            {
+                const ElementType * value = flatMap.find( key );
+                return value ? *value : -1;
+            },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key ) -> ElementType
+            {
+                auto it = unorderedSet.find( key );
+                return it == unorderedSet.end() ? -1 : *it;
+            },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key ) -> ElementType
+            {
+                const ElementType * slot = linearProbing.find( key );
+                return slot ? *slot : -1;
+            },
+            keys, options
+        ) );
+        results.push_back( runBatchedLookups(
+            [ & ] ( ElementType key ) -> ElementType
+            {
+                const ElementType * slot = swissTable.find( key );
+                return slot ? *slot : -1;
+            },
+            keys, options
+        ) );
+
+        std::cout << "Size: " << size;
+        for ( size_t m = 0; m < results.size(); ++m )
+        {
+            std::cout
+                << " | " << BATCHED_METHODS[m] << ": "
+                << results[m].nsPerLookup << "ns/lookup"
+            ;
+        }
+        std::cout << " | Hybrid cutoff: " << row.hybridCutoff << "\n";
+        rows.push_back( row );
+    }
+    return rows;
+}
+
+/*----------------------------------------------------------------------------*/
+
+// One method of the throughput sweep, per thread count: the mean and
+// deviation of the wall time of one batch on every thread, and the aggregate
+// lookups per second. Written like the parallel_chunks series, as the
+// "<name>Avg", "<name>Std" and "<name>LookupsPerSec" rows.
+struct ThroughputSeries
+{
+    std::string name;
+    std::vector<double> avg;
+    std::vector<double> std;
+    std::vector<double> lookupsPerSec;
+};
+
+// Every thread runs `lookup` over its own key stream; a timed region ends
+// when the last thread is done.
+template <typename LookupFunc>
+ThroughputSeries runThroughputLookups (
+    const std::string& name,
+    LookupFunc lookup,
+    const std::vector< KeyVector >& threadKeys,
+    ThreadPool & pool,
+    RunnerOptions const & options
+)
+{
+    // Per-thread results on separate cache lines.
+    struct alignas( CACHE_LINE_SIZE ) Checksum
+    {
+        long long value;
+    };
+    std::vector<Checksum> checksums( threadKeys.size() );
+
+    ThroughputSeries series{ name, {}, {}, {} };
+    for ( int numThreads = 1; numThreads <= pool.size(); ++numThreads )
+    {
+        auto times = runBenchmarkAdaptiveSingle< TimerType >(
+            options,
+            [ & ] ()
+            {
+                pool.run( numThreads, [ & ] ( int t )
+                {
+                    long long checksum = 0;
+                    for ( ElementType key : threadKeys[t] )
+                        checksum += lookup( key );
+                    checksums[t].value = checksum;
+                } );
+                long long total = 0;
+                for ( int t = 0; t < numThreads; ++t )
+                    total += checksums[t].value;
+                return total;
+            }
+        );
+        takePerfCounts();
+
+        BenchmarkStats stats = computeBenchmarkStats( times, options.filter );
+        const double seconds =
+            stats.mean * TimerType::Ratio::num / TimerType::Ratio::den;
+        const double lookups = static_cast<double>( numThreads )
+            * static_cast<double>( threadKeys[0].size() );
+        series.avg.push_back( stats.mean );
+        series.std.push_back( stats.stdDev );
+        series.lookupsPerSec.push_back( lookups / seconds );
+    }
+    return series;
+}
+
+void writeThroughputResultsToCSV (
+    const std::string& filename,
+    int maxThreads,
+    KeyStreamOptions const & keyOptions,
+    const std::vector<ThroughputSeries>& series
+)
+{
+    std::ofstream ofs( filename );
+    if ( !ofs )
+    {
+        std::cerr
+            << "Error: cannot open file " << filename << " for writing.\n"
+        ;
+        return;
+    }
+
+    ofs << "ThreadCount";
+    for ( int t = 1; t <= maxThreads; ++t )
+        ofs << "," << t;
+    ofs << "\nDistribution";
+    for ( int t = 1; t <= maxThreads; ++t )
+        ofs << "," << keyStreamDescription( keyOptions );
+    ofs << "\nPages";
+    for ( int t = 1; t <= maxThreads; ++t )
+        ofs << "," << pageDescription();
+    ofs << "\n";
+
+    auto writeRow = [ & ] ( const std::string& label,
+                            const std::vector<double>& values )
+    {
+        ofs << label;
+        for ( double value : values )
+            ofs << "," << value;
+        ofs << "\n";
+    };
+    for ( const ThroughputSeries & s : series )
+    {
+        writeRow( s.name + "Avg", s.avg );
+        writeRow( s.name + "Std", s.std );
+        writeRow( s.name + "LookupsPerSec", s.lookupsPerSec );
+    }
+
+    ofs.close();
+    std::cout << "Benchmark results written to " << filename << std::endl;
+}
+
+// Throughput of the logarithmic searches against one shared table of `size`
+// keys, for 1..maxThreads threads issuing `batchSize` lookups each. Every
+// thread draws its own stream from `keyOptions`. The linear scans are left
+// out: at table sizes where sharing matters they measure only themselves.
+std::vector<ThroughputSeries> runThroughputBenchmarks (
+    ElementType size,
+    int maxThreads,
+    bool pinThreads,
+    size_t batchSize,
+    KeyStreamOptions const & keyOptions,
+    RunnerOptions const & options
+)
+{
+    KeyVector data = generateSortedVector( size );
+    std::set<ElementType> s = buildStdSet( insertionOrder( data ) );
+    EytzingerLayout<ElementType> eytzinger( data );
+    STree sTree( data );
+    HybridSearch hybrid( tuneHybridCutoff( data ) );
+
+    std::vector< KeyVector > threadKeys;
+    for ( int t = 0; t < maxThreads; ++t )
+    {
+        KeyStreamOptions threadOptions = keyOptions;
+        threadOptions.seed += t;
+        threadKeys.push_back(
+            generateKeyStream( data, batchSize, threadOptions )
+        );
+    }
+
+    ThreadPool pool( maxThreads, pinThreads );
+    std::vector<ThroughputSeries> series;
+    series.push_back( runThroughputLookups(
+        "BinarySearch",
+        [ & ] ( ElementType key ) { return binarySearch( data, key ); },
+        threadKeys, pool, options
+    ) );
+    series.push_back( runThroughputLookups(
+        "SetLookup",
+        [ & ] ( ElementType key ) -> ElementType
+        {
+            auto it = s.find( key );
+            return it == s.end() ? -1 : *it;
+        },
+        threadKeys, pool, options
+    ) );
+    series.push_back( runThroughputLookups(
+        "BranchlessBinarySearch",
+        [ & ] ( ElementType key )
+        {
+            return branchlessBinarySearch( data, key );
+        },
+        threadKeys, pool, options
+    ) );
+    series.push_back( runThroughputLookups(
+        "Eytzinger",
+        [ & ] ( ElementType key ) { return eytzinger.search( key ); },
+        threadKeys, pool, options
+    ) );
+    series.push_back( runThroughputLookups(
+        "STree",
+        [ & ] ( ElementType key ) { return sTree.search( key ); },
+        threadKeys, pool, options
+    ) );
+    series.push_back( runThroughputLookups(
+        "HybridSearch",
+        [ & ] ( ElementType key ) { return hybrid( data, key ); },
+        threadKeys, pool, options
+    ) );
+
+    for ( const ThroughputSeries & result : series )
+    {
+        std::cout << result.name << " lookups/s:";
+        for ( double perSecond : result.lookupsPerSec )
+            std::cout << " " << perSecond;
+        std::cout << "\n";
     }
+    return series;
 }
 
 /*----------------------------------------------------------------------------*/
 
-void runArrayBenchmark ( int iterations )
+void runArrayBenchmark ( RunnerOptions const & options )
 {
     std::cout
         << "\nBenchmarking linear search on std::array (size "
         << ARRAY_SIZE << ")...\n"
     ;
-    auto arrayTimes = runBenchmarkArrayLinear(iterations);
-    double sumArray = 0.0;
-    for (auto t : arrayTimes) { sumArray += t; }
-    double avgArray = sumArray / arrayTimes.size();
-    double stdArray = calculateStdDev(arrayTimes, avgArray);
-    std::cout
-        << "Array (std::array) linear search benchmark for size " << ARRAY_SIZE
-        << " | Avg: " << avgArray << TimerType::unit()
-        << " | Std: " << stdArray << TimerType::unit() << "\n"
-    ;
+    for ( bool simd : { false, true } )
+    {
+        const std::string label =
+            simd ? "SIMD linear search" : "Array linear search";
+        auto arrayTimes = runBenchmarkArrayLinear(options, simd);
+        PerfCounts arrayPerf = takePerfCounts();
+        BenchmarkStats arrayStats =
+            computeBenchmarkStats( arrayTimes, options.filter );
+        std::cout
+            << "Array (std::array) " << ( simd ? "SIMD " : "" )
+            << "linear search benchmark for size " << ARRAY_SIZE
+            << " | Avg: " << arrayStats.mean << TimerType::unit()
+            << " | Std: " << arrayStats.stdDev << TimerType::unit()
+            << " | Median: " << arrayStats.median << TimerType::unit()
+            << " | P99: " << arrayStats.p99 << TimerType::unit()
+            << " | Samples: " << arrayStats.samples << "\n"
+        ;
+        printPerfCounts( std::cout, label, arrayPerf );
+    }
 }
 
 /*----------------------------------------------------------------------------*/
 
 int main ( int argc, char* argv[] )
 {
-    auto iterations = ITERATIONS;
+    RunnerOptions options;
+    options.minIterations = ITERATIONS;
+    options.maxIterations = MAX_ITERATIONS;
     auto sizeFactor = SIZE_FACTOR;
+    size_t batchSize = 0;
+    int throughputThreads = 0;
+    bool pinThreads = true;
+    KeyStreamOptions keyOptions;
+    bool keysGiven = false;
 
-    std::vector< ElementType > sizes = SIZES;
+    std::vector< ElementType > sizes;
+    bool sizesGiven = false;
 
 
     for (int i = 1; i < argc; ++i)
@@ -353,48 +1339,209 @@ int main ( int argc, char* argv[] )
         std::string arg = argv[i];
         if (arg == "--iterations" && (i + 1) < argc)
         {
-            iterations = std::stoi(argv[++i]);
+            options.minIterations = std::stoi(argv[++i]);
+        }
+        else if (arg == "--max-iterations" && (i + 1) < argc)
+        {
+            options.maxIterations = std::stoi(argv[++i]);
+        }
+        else if (arg == "--target-ci" && (i + 1) < argc)
+        {
+            options.targetRelativeCi = std::stod(argv[++i]);
+        }
+        else if (arg == "--warmup" && (i + 1) < argc)
+        {
+            options.warmupIterations = std::stoi(argv[++i]);
         }
         else if (arg == "--maxSize" && (i + 1) < argc)
         {
             int maxSize = std::stoi(argv[++i]);
             sizes.clear();
+            sizesGiven = true;
             int step = maxSize / 10;
             for (int s = step; s <= maxSize; s += step)
             {
                 sizes.push_back(s);
             }
         }
+        else if (arg == "--calibration" && (i + 1) < argc)
+        {
+            cacheCalibrationPath() = argv[++i];
+        }
         else if (arg == "--factor" && (i + 1) < argc)
         {
             sizeFactor = std::stoi(argv[++i]);
         }
+        else if (arg == "--batch" && (i + 1) < argc)
+        {
+            batchSize = std::stoul(argv[++i]);
+        }
+        else if (arg == "--keys" && (i + 1) < argc)
+        {
+            std::string name = argv[++i];
+            if ( !parseKeyDistribution( name, keyOptions.distribution ) )
+            {
+                std::cerr << "Error: unknown key distribution " << name
+                          << " (expected uniform, zipf, sequential, hits,"
+                          << " position, miss or hotset)\n";
+                return 1;
+            }
+            keysGiven = true;
+        }
+        else if (arg == "--hit-ratio" && (i + 1) < argc)
+        {
+            keyOptions.hitRatio = std::stod(argv[++i]);
+        }
+        else if (arg == "--position" && (i + 1) < argc)
+        {
+            keyOptions.position = std::stod(argv[++i]);
+        }
+        else if (arg == "--hot-fraction" && (i + 1) < argc)
+        {
+            keyOptions.hotFraction = std::stod(argv[++i]);
+        }
+        else if (arg == "--threads" && (i + 1) < argc)
+        {
+            throughputThreads = std::stoi(argv[++i]);
+        }
+        else if (arg == "--no-pin")
+        {
+            pinThreads = false;
+        }
+        else if (arg == "--pages" && (i + 1) < argc)
+        {
+            std::string name = argv[++i];
+            if ( !parsePageMode( name, pageOptions().mode ) )
+            {
+                std::cerr << "Error: unknown page mode " << name
+                          << " (expected default, thp, 2m or 1g)\n";
+                return 1;
+            }
+        }
+        else if (arg == "--prefault")
+        {
+            pageOptions().prefault = true;
+        }
+        else if (arg == "--align" && (i + 1) < argc)
+        {
+            std::string value = argv[++i];
+            if ( !parseAlignment( value, pageOptions().alignment ) )
+            {
+                std::cerr << "Error: invalid alignment " << value
+                          << " (expected a power of two up to 4096)\n";
+                return 1;
+            }
+        }
     }
 
+    if ( !sizesGiven )
+        sizes = searchSizes();
     std::transform(
         sizes.begin(), sizes.end(), sizes.begin(),
         [ & ] ( ElementType x ) { return x * sizeFactor; }
     );
 
 
-    std::cout << "Running search benchmarks with iterations=" << iterations << "\n";
+    const CycleCounterCalibration & timerCalibration =
+        cycleCounterCalibration();
+    std::cout
+        << "Timer: cycle counter at " << timerCalibration.ticksPerNs
+        << " ticks/ns, " << timerCalibration.overheadTicks
+        << " ticks of overhead subtracted\n"
+    ;
+    std::cout
+        << "Running search benchmarks with iterations="
+        << options.minIterations << ".." << options.maxIterations
+        << ", target CI=" << options.targetRelativeCi << "\n"
+    ;
     std::cout << "Sizes to test: ";
     for (auto s : sizes)
         std::cout << s << " ";
     std::cout << "\n";
+    if ( !sizesGiven && calibratedCacheSizes().last() )
+        std::cout << "Cache levels calibrated from "
+                  << cacheCalibrationPath() << "\n";
+    std::cout << "Pages: " << pageDescription() << "\n";
+
+    // Hardware counters of every timed search, written as extra columns.
+    PerfRecorder perfRecorder;
+    std::vector< PerfEvent > perfEvents;
+    for ( int e = 0; e < PERF_EVENT_COUNT; ++e )
+    {
+        if ( perfRecorder.counters().isAvailable( perfEventAt( e ) ) )
+            perfEvents.push_back( perfEventAt( e ) );
+    }
+
+    if ( !keysGiven )
+    {
+        keyOptions.distribution = throughputThreads > 0 || batchSize > 0
+            ? BATCHED_DISTRIBUTION
+            : SINGLE_LOOKUP_DISTRIBUTION;
+    }
+
+    if ( throughputThreads > 0 )
+    {
+        if ( batchSize == 0 )
+            batchSize = DEFAULT_BATCH;
+        std::cout
+            << "Throughput: 1.." << throughputThreads << " threads, "
+            << batchSize << " " << keyStreamDescription( keyOptions )
+            << " keys per thread against " << sizes.back() << " keys\n"
+        ;
+        auto series = runThroughputBenchmarks(
+            sizes.back(), throughputThreads, pinThreads, batchSize,
+            keyOptions, options
+        );
+        printPageStats( std::cout );
+        writeThroughputResultsToCSV(
+            THROUGHPUT_FILENAME, throughputThreads, keyOptions, series
+        );
+        return 0;
+    }
+
+    if ( batchSize > 0 )
+    {
+        std::cout
+            << "Batched lookups: " << batchSize << " "
+            << keyStreamDescription( keyOptions )
+            << " keys per timed region\n"
+        ;
+        auto rows = runBatchedSearchBenchmarks(
+            sizes, batchSize, keyOptions, options
+        );
+        printPageStats( std::cout );
+        writeBatchedResultsToCSV(
+            BATCHED_FILENAME, sizes, keyOptions, rows, perfEvents
+        );
+        return 0;
+    }
+
+    std::cout
+        << "Single lookups: " << keyStreamDescription( keyOptions )
+        << " keys\n"
+    ;
 
     // Create a structure to hold benchmark results.
     SearchBenchmarkResults results;
 
     // Run the benchmarks.
-    runSearchBenchmarks(sizes, iterations, results);
+    runSearchBenchmarks(sizes, keyOptions, options, results);
 
+    printPageStats( std::cout );
     // Write results to CSV.
     std::string filename = "search_benchmarks.csv";
-    writeResultsToCSV(filename, sizes, results);
+    writeResultsToCSV(filename, sizes, keyOptions, results, perfEvents);
+
+    std::cout
+        << "Binary search beats linear search from size "
+        << linearBinaryCrossover( sizes, results.linear, results.binary )
+        << ", SIMD linear search from size "
+        << linearBinaryCrossover( sizes, results.simdLinear, results.binary )
+        << " (0: never)\n"
+    ;
 
 
-    runArrayBenchmark( iterations );
+    runArrayBenchmark( options );
 
     return 0;
 }
@@ -0,0 +1,537 @@
+#ifndef __CPU_CACHES__SEARCH_LAYOUTS_H__
+#define __CPU_CACHES__SEARCH_LAYOUTS_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "../utils/cache.h"
+#include "../utils/cpu_features.h"
+#include "../utils/page_allocator.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <vector>
+
+#if defined( PERF_ARCH_X86 )
+#include <immintrin.h>
+#elif defined( PERF_ARCH_ARM64 )
+#include <arm_neon.h>
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Cache-friendly layouts for searching a static sorted set of keys.
+
+Every structure is built once from a sorted vector and answers search( key )
+with the position of the key in its own storage, or -1 if the key is not
+stored, so the results of different layouts are not comparable positions,
+only hits and misses are.
+*/
+
+namespace search_detail
+{
+
+// Cache-line-aligned, uninitialized array of keys, on the pages selected
+// for the run (see utils/page_allocator.h).
+template < typename _KeyT >
+using AlignedKeys = PageArray< _KeyT >;
+
+} // namespace search_detail
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Branchless binary search: the loop always runs log2(n) steps and selects the
+next half with a conditional move instead of a branch, so there are no
+mispredictions, and the loads of consecutive steps can be issued
+speculatively.
+*/
+template < typename _KeyT, typename _AllocT = std::allocator< _KeyT > >
+int branchlessBinarySearch (
+    const std::vector< _KeyT, _AllocT > & data, _KeyT key
+)
+{
+    if ( data.empty() )
+        return -1;
+
+    const _KeyT * base = data.data();
+    std::size_t length = data.size();
+    while ( length > 1 )
+    {
+        std::size_t half = length / 2;
+        base = base[ half - 1 ] < key ? base + half : base;
+        length -= half;
+    }
+    std::size_t index = ( base - data.data() ) + ( *base < key );
+    return index < data.size() && data[ index ] == key
+        ? static_cast< int >( index )
+        : -1;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Eytzinger (BFS) layout: the implicit binary search tree stored level by
+level, node k at position k (1-based) with children 2k and 2k + 1. The top
+levels of the tree share a few cache lines that stay hot, and the search
+descends without branching on the comparison.
+
+The 16 descendants four levels below node k are contiguous (positions 16k to
+16k + 15), so every step prefetches them; by the time the search gets there
+the lines have arrived. The storage is cache-line aligned so that block never
+straddles more lines than it has to. Near the leaves the block lies past the
+last node; only the lines that start inside the array are prefetched, so no
+pointer is formed beyond it.
+*/
+template < typename _KeyT >
+class EytzingerLayout
+{
+
+public:
+
+    template < typename _AllocT >
+    explicit EytzingerLayout ( const std::vector< _KeyT, _AllocT > & sorted )
+        :   m_count( sorted.size() )
+        ,   m_keys( sorted.size() + 1 )
+    {
+        std::size_t next = 0;
+        build( sorted, next, 1 );
+    }
+
+    int search ( _KeyT key ) const
+    {
+        constexpr std::size_t prefetchLevels = 4;
+        constexpr std::size_t block = std::size_t{ 1 } << prefetchLevels;
+        constexpr std::size_t blockLines = std::max< std::size_t >(
+            block * sizeof( _KeyT ) / CACHE_LINE_SIZE, 1
+        );
+
+        constexpr std::size_t lineKeys = CACHE_LINE_SIZE / sizeof( _KeyT );
+
+        const _KeyT * keys = m_keys.data();
+        std::size_t k = 1;
+        while ( k <= m_count )
+        {
+            for ( std::size_t line = 0; line < blockLines; ++line )
+            {
+                const std::size_t first = k * block + line * lineKeys;
+                if ( first > m_count )
+                    break;
+                __builtin_prefetch( keys + first );
+            }
+            k = 2 * k + ( keys[ k ] < key );
+        }
+        // Undo the right turns taken after the last left turn: that node is
+        // the lower bound, 0 if the key is past the end.
+        k >>= __builtin_ffsll( static_cast< long long >( ~k ) );
+        return k != 0 && keys[ k ] == key ? static_cast< int >( k ) : -1;
+    }
+
+    std::size_t memoryBytes () const
+    {
+        return ( m_count + 1 ) * sizeof( _KeyT );
+    }
+
+private:
+
+    // In-order traversal of the implicit tree assigns the sorted keys.
+    template < typename _AllocT >
+    void build (
+        const std::vector< _KeyT, _AllocT > & sorted,
+        std::size_t & next,
+        std::size_t k
+    )
+    {
+        if ( k > m_count )
+            return;
+        build( sorted, next, 2 * k );
+        m_keys[ k ] = sorted[ next++ ];
+        build( sorted, next, 2 * k + 1 );
+    }
+
+    std::size_t m_count;
+    search_detail::AlignedKeys< _KeyT > m_keys;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Static B+ tree over 64-bit keys (S+ tree): every node is one cache line of
+STREE_NODE_KEYS keys, so a lookup touches one line per level, and a node is
+searched by comparing all its keys at once.
+
+Layers are stored top-down in one aligned buffer. The leaves hold all keys in
+sorted order, padded with the largest representable key. An internal node has
+STREE_NODE_KEYS + 1 children; its key j is the smallest key below child j + 1.
+In every node the search counts the keys smaller than the searched one, which
+is the child to descend into, and in the leaves the lower-bound position.
+Keys must be smaller than std::numeric_limits< long long >::max().
+
+The node search is picked at runtime from cpuFeatures() (AVX2, NEON or a
+scalar loop), like the counting kernels in count_kernels.h.
+*/
+constexpr std::size_t STREE_NODE_KEYS = CACHE_LINE_SIZE / sizeof( long long );
+
+namespace search_detail
+{
+
+struct STreeView
+{
+    const long long * nodes;
+    const std::size_t * layerOffsets;
+    int height;
+    std::size_t count;
+};
+
+using STreeSearchFunc = int (*)( STreeView const &, long long );
+
+inline int rankInNodeScalar ( const long long * node, long long key )
+{
+    int rank = 0;
+    for ( std::size_t j = 0; j < STREE_NODE_KEYS; ++j )
+        rank += node[ j ] < key;
+    return rank;
+}
+
+inline int sTreeSearchScalar ( STreeView const & tree, long long key )
+{
+    std::size_t k = 0;
+    for ( int h = 0; h + 1 < tree.height; ++h )
+    {
+        const long long * node =
+            tree.nodes + ( tree.layerOffsets[ h ] + k ) * STREE_NODE_KEYS;
+        k = k * ( STREE_NODE_KEYS + 1 ) + rankInNodeScalar( node, key );
+    }
+    const long long * leaves =
+        tree.nodes + tree.layerOffsets[ tree.height - 1 ] * STREE_NODE_KEYS;
+    std::size_t index = k * STREE_NODE_KEYS
+        + rankInNodeScalar( leaves + k * STREE_NODE_KEYS, key );
+    return index < tree.count && leaves[ index ] == key
+        ? static_cast< int >( index )
+        : -1;
+}
+
+#if defined( PERF_ARCH_X86 )
+
+__attribute__(( target( "avx2,popcnt" ) ))
+inline int rankInNodeAvx2 ( const long long * node, long long key )
+{
+    const __m256i k = _mm256_set1_epi64x( key );
+    const __m256i * lines = reinterpret_cast< const __m256i * >( node );
+    __m256i lo = _mm256_load_si256( lines );
+    __m256i hi = _mm256_load_si256( lines + 1 );
+    int mask = _mm256_movemask_pd(
+        _mm256_castsi256_pd( _mm256_cmpgt_epi64( k, lo ) )
+    );
+    mask |= _mm256_movemask_pd(
+        _mm256_castsi256_pd( _mm256_cmpgt_epi64( k, hi ) )
+    ) << 4;
+    return _mm_popcnt_u32( static_cast< unsigned >( mask ) );
+}
+
+__attribute__(( target( "avx2,popcnt" ) ))
+inline int sTreeSearchAvx2 ( STreeView const & tree, long long key )
+{
+    std::size_t k = 0;
+    for ( int h = 0; h + 1 < tree.height; ++h )
+    {
+        const long long * node =
+            tree.nodes + ( tree.layerOffsets[ h ] + k ) * STREE_NODE_KEYS;
+        k = k * ( STREE_NODE_KEYS + 1 ) + rankInNodeAvx2( node, key );
+    }
+    const long long * leaves =
+        tree.nodes + tree.layerOffsets[ tree.height - 1 ] * STREE_NODE_KEYS;
+    std::size_t index = k * STREE_NODE_KEYS
+        + rankInNodeAvx2( leaves + k * STREE_NODE_KEYS, key );
+    return index < tree.count && leaves[ index ] == key
+        ? static_cast< int >( index )
+        : -1;
+}
+
+#endif // PERF_ARCH_X86
+
+#if defined( PERF_ARCH_ARM64 )
+
+inline int rankInNodeNeon ( const long long * node, long long key )
+{
+    const int64x2_t k = vdupq_n_s64( key );
+    // Lanes with a smaller key are all ones, subtracting adds one.
+    uint64x2_t acc = vdupq_n_u64( 0 );
+    for ( std::size_t j = 0; j < STREE_NODE_KEYS; j += 2 )
+        acc = vsubq_u64( acc, vcltq_s64( vld1q_s64( node + j ), k ) );
+    return static_cast< int >( vaddvq_u64( acc ) );
+}
+
+inline int sTreeSearchNeon ( STreeView const & tree, long long key )
+{
+    std::size_t k = 0;
+    for ( int h = 0; h + 1 < tree.height; ++h )
+    {
+        const long long * node =
+            tree.nodes + ( tree.layerOffsets[ h ] + k ) * STREE_NODE_KEYS;
+        k = k * ( STREE_NODE_KEYS + 1 ) + rankInNodeNeon( node, key );
+    }
+    const long long * leaves =
+        tree.nodes + tree.layerOffsets[ tree.height - 1 ] * STREE_NODE_KEYS;
+    std::size_t index = k * STREE_NODE_KEYS
+        + rankInNodeNeon( leaves + k * STREE_NODE_KEYS, key );
+    return index < tree.count && leaves[ index ] == key
+        ? static_cast< int >( index )
+        : -1;
+}
+
+#endif // PERF_ARCH_ARM64
+
+inline STreeSearchFunc bestSTreeSearch ()
+{
+    CpuFeatures const & features = cpuFeatures();
+#if defined( PERF_ARCH_X86 )
+    if ( features.avx2 && features.popcnt )
+        return sTreeSearchAvx2;
+#elif defined( PERF_ARCH_ARM64 )
+    if ( features.neon )
+        return sTreeSearchNeon;
+#endif
+    (void)features;
+    return sTreeSearchScalar;
+}
+
+} // namespace search_detail
+
+class STree
+{
+
+public:
+
+    template < typename _AllocT >
+    explicit STree ( const std::vector< long long, _AllocT > & sorted )
+        :   m_count( sorted.size() )
+        ,   m_search( search_detail::bestSTreeSearch() )
+    {
+        constexpr std::size_t B = STREE_NODE_KEYS;
+        constexpr long long padding = std::numeric_limits< long long >::max();
+
+        // Nodes per layer, bottom-up.
+        std::vector< std::size_t > layerNodes{
+            std::max< std::size_t >( ( m_count + B - 1 ) / B, 1 )
+        };
+        while ( layerNodes.back() > 1 )
+            layerNodes.push_back( ( layerNodes.back() + B ) / ( B + 1 ) );
+        std::reverse( layerNodes.begin(), layerNodes.end() );
+        m_height = static_cast< int >( layerNodes.size() );
+
+        std::size_t totalNodes = 0;
+        for ( std::size_t nodes : layerNodes )
+        {
+            m_layerOffsets.push_back( totalNodes );
+            totalNodes += nodes;
+        }
+        m_totalNodes = totalNodes;
+        m_nodes = std::make_unique< search_detail::AlignedKeys< long long > >(
+            totalNodes * B
+        );
+        search_detail::AlignedKeys< long long > & nodes = *m_nodes;
+
+        long long * leaves = nodes.data() + m_layerOffsets.back() * B;
+        for ( std::size_t i = 0; i < layerNodes.back() * B; ++i )
+            leaves[ i ] = i < m_count ? sorted[ i ] : padding;
+
+        for ( int h = 0; h + 1 < m_height; ++h )
+        {
+            // Leaf blocks below one child of a node in this layer.
+            std::size_t leavesPerChild = 1;
+            for ( int below = h + 2; below < m_height; ++below )
+                leavesPerChild *= B + 1;
+
+            long long * layer = nodes.data() + m_layerOffsets[ h ] * B;
+            for ( std::size_t k = 0; k < layerNodes[ h ]; ++k )
+            {
+                for ( std::size_t j = 0; j < B; ++j )
+                {
+                    std::size_t child = k * ( B + 1 ) + j + 1;
+                    std::size_t first = child * leavesPerChild * B;
+                    layer[ k * B + j ] =
+                        first < m_count ? sorted[ first ] : padding;
+                }
+            }
+        }
+    }
+
+    int search ( long long key ) const
+    {
+        return m_search(
+            { m_nodes->data(), m_layerOffsets.data(), m_height, m_count }, key
+        );
+    }
+
+    std::size_t memoryBytes () const
+    {
+        return m_layerOffsets.size() * sizeof( std::size_t )
+            + m_totalNodes * STREE_NODE_KEYS * sizeof( long long );
+    }
+
+private:
+
+    std::size_t m_count;
+    int m_height = 0;
+    std::size_t m_totalNodes = 0;
+    std::vector< std::size_t > m_layerOffsets;
+    std::unique_ptr< search_detail::AlignedKeys< long long > > m_nodes;
+    search_detail::STreeSearchFunc m_search;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Vectorized linear search over 64-bit keys: index of the first element of
+data[0, count) equal to key, or -1. The vector kernels compare 16 keys per
+step and only locate the match inside the step once any lane hit, so the
+early exit costs one test per 16 keys. As with STree, the kernel is picked at
+runtime from cpuFeatures().
+*/
+using LinearSearchFunc = int (*)( const long long *, std::size_t, long long );
+
+inline int linearSearchScalar (
+    const long long * data, std::size_t count, long long key
+)
+{
+    for ( std::size_t i = 0; i < count; ++i )
+    {
+        if ( data[ i ] == key )
+            return static_cast< int >( i );
+    }
+    return -1;
+}
+
+#if defined( PERF_ARCH_X86 )
+
+// One bit per key of data[0, 4) equal to k.
+__attribute__(( target( "avx2" ) ))
+inline unsigned matchMaskAvx2 ( const long long * data, __m256i k )
+{
+    __m256i v =
+        _mm256_loadu_si256( reinterpret_cast< const __m256i * >( data ) );
+    return static_cast< unsigned >( _mm256_movemask_pd(
+        _mm256_castsi256_pd( _mm256_cmpeq_epi64( v, k ) )
+    ) );
+}
+
+__attribute__(( target( "avx2,bmi" ) ))
+inline int linearSearchAvx2 (
+    const long long * data, std::size_t count, long long key
+)
+{
+    const __m256i k = _mm256_set1_epi64x( key );
+    std::size_t i = 0;
+    for ( ; i + 16 <= count; i += 16 )
+    {
+        unsigned mask = matchMaskAvx2( data + i, k )
+            | matchMaskAvx2( data + i + 4, k ) << 4
+            | matchMaskAvx2( data + i + 8, k ) << 8
+            | matchMaskAvx2( data + i + 12, k ) << 12;
+        if ( mask != 0 )
+            return static_cast< int >( i + _tzcnt_u32( mask ) );
+    }
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        if ( unsigned mask = matchMaskAvx2( data + i, k ) )
+            return static_cast< int >( i + _tzcnt_u32( mask ) );
+    }
+    int tail = linearSearchScalar( data + i, count - i, key );
+    return tail < 0 ? -1 : static_cast< int >( i ) + tail;
+}
+
+#endif // PERF_ARCH_X86
+
+#if defined( PERF_ARCH_ARM64 )
+
+inline int linearSearchNeon (
+    const long long * data, std::size_t count, long long key
+)
+{
+    const int64x2_t k = vdupq_n_s64( key );
+    std::size_t i = 0;
+    for ( ; i + 16 <= count; i += 16 )
+    {
+        uint64x2_t any = vdupq_n_u64( 0 );
+        for ( std::size_t j = 0; j < 16; j += 2 )
+            any = vorrq_u64( any, vceqq_s64( vld1q_s64( data + i + j ), k ) );
+        if ( vmaxvq_u32( vreinterpretq_u32_u64( any ) ) != 0 )
+            break;
+    }
+    int tail = linearSearchScalar( data + i, count - i, key );
+    return tail < 0 ? -1 : static_cast< int >( i ) + tail;
+}
+
+#endif // PERF_ARCH_ARM64
+
+inline LinearSearchFunc bestLinearSearch ()
+{
+    CpuFeatures const & features = cpuFeatures();
+#if defined( PERF_ARCH_X86 )
+    if ( features.avx2 )
+        return linearSearchAvx2;
+#elif defined( PERF_ARCH_ARM64 )
+    if ( features.neon )
+        return linearSearchNeon;
+#endif
+    (void)features;
+    return linearSearchScalar;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Hybrid search: branchless binary search narrows the range until at most
+`cutoff` candidates are left, then a vectorized scan finishes. Small cutoffs
+behave like binary search, cutoffs above the size like linear search; the
+best one depends on the machine and is found by measuring (see
+tuneHybridCutoff in search_benchmarks.cpp).
+*/
+class HybridSearch
+{
+
+public:
+
+    explicit HybridSearch (
+        std::size_t cutoff, LinearSearchFunc scan = bestLinearSearch()
+    )
+        :   m_cutoff( std::max< std::size_t >( cutoff, 1 ) )
+        ,   m_scan( scan )
+    {
+    }
+
+    std::size_t cutoff () const { return m_cutoff; }
+
+    template < typename _AllocT >
+    int operator () (
+        const std::vector< long long, _AllocT > & data, long long key
+    ) const
+    {
+        const long long * base = data.data();
+        std::size_t length = data.size();
+        while ( length > m_cutoff )
+        {
+            std::size_t half = length / 2;
+            base = base[ half - 1 ] < key ? base + half : base;
+            length -= half;
+        }
+        // The lower bound lies in [base, base + length], end included.
+        std::size_t offset = base - data.data();
+        std::size_t window = std::min( length + 1, data.size() - offset );
+        int found = m_scan( base, window, key );
+        return found < 0 ? -1 : static_cast< int >( offset ) + found;
+    }
+
+private:
+
+    std::size_t m_cutoff;
+    LinearSearchFunc m_scan;
+};
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __CPU_CACHES__SEARCH_LAYOUTS_H__
@@ -0,0 +1,330 @@
+#ifndef __UTILS__BASELINE_H__
+#define __UTILS__BASELINE_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "benchmark_registry.h"
+#include "math.h"
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Comparison of a suite run with a stored baseline, the CSV written by
+writeSuiteCsv of an earlier run. Runs are matched by full name. A run
+regresses when all three hold:
+- its median is more than `threshold` (relative) above the baseline median,
+- the Mann-Whitney test of the two sets of samples gives p < alpha,
+- the 95% confidence intervals of the two means do not overlap.
+An improvement is the same, with the median below. Requiring the tests on
+top of the threshold keeps a noisy run from failing the comparison, and
+requiring the threshold keeps a tiny but significant change from failing it.
+Baselines from another machine, compiler or flags are compared, with a
+warning.
+*/
+
+struct BaselineResult
+{
+    double mean = 0.0;
+    double ciHalfWidth = 0.0;
+    double median = 0.0;
+    std::vector< double > samples;
+};
+
+struct Baseline
+{
+    std::vector< std::pair< std::string, std::string > > system;
+    std::map< std::string, BaselineResult > results;
+
+    // Value of a "# key: value" line, empty if the file had none.
+    std::string field ( std::string const & key ) const
+    {
+        for ( auto const & [ name, value ] : system )
+        {
+            if ( name == key )
+                return value;
+        }
+        return "";
+    }
+};
+
+// Reads a suite CSV. Returns false, with a message, if the file cannot be
+// read or lacks a needed column.
+inline bool loadBaseline ( std::string const & filename, Baseline & baseline )
+{
+    std::ifstream in( filename );
+    if ( !in )
+    {
+        std::cerr << "Error: cannot open baseline " << filename << "\n";
+        return false;
+    }
+
+    std::map< std::string, std::size_t > columns;
+    std::string line;
+    while ( std::getline( in, line ) )
+    {
+        if ( line.empty() )
+            continue;
+        if ( line.rfind( "# ", 0 ) == 0 )
+        {
+            const std::size_t colon = line.find( ": " );
+            if ( colon != std::string::npos )
+            {
+                baseline.system.emplace_back(
+                    line.substr( 2, colon - 2 ), line.substr( colon + 2 )
+                );
+            }
+            continue;
+        }
+
+        std::vector< std::string > cells;
+        std::stringstream row( line );
+        for ( std::string cell; std::getline( row, cell, ',' ); )
+            cells.push_back( cell );
+
+        if ( columns.empty() )
+        {
+            for ( std::size_t i = 0; i < cells.size(); ++i )
+                columns[ cells[ i ] ] = i;
+            for ( const char * name : {
+                "Name", "Mean", "CiHalfWidth", "Median", "Samples"
+            } )
+            {
+                if ( !columns.count( name ) )
+                {
+                    std::cerr << "Error: baseline " << filename
+                              << " has no " << name << " column\n";
+                    return false;
+                }
+            }
+            continue;
+        }
+
+        auto cellOf = [ & ] ( const char * name ) -> std::string
+        {
+            const std::size_t i = columns[ name ];
+            return i < cells.size() ? cells[ i ] : "";
+        };
+        BaselineResult result;
+        try
+        {
+            result.mean = std::stod( cellOf( "Mean" ) );
+            result.ciHalfWidth = std::stod( cellOf( "CiHalfWidth" ) );
+            result.median = std::stod( cellOf( "Median" ) );
+        }
+        catch ( std::exception const & )
+        {
+            std::cerr << "Error: malformed baseline row " << line << "\n";
+            return false;
+        }
+        std::stringstream samples( cellOf( "Samples" ) );
+        for ( double sample; samples >> sample; )
+            result.samples.push_back( sample );
+        baseline.results[ cellOf( "Name" ) ] = std::move( result );
+    }
+    if ( columns.empty() )
+    {
+        std::cerr << "Error: baseline " << filename << " is empty\n";
+        return false;
+    }
+    return true;
+}
+
+/*----------------------------------------------------------------------------*/
+
+enum class ComparisonVerdict
+{
+        Unchanged
+    ,   Regression
+    ,   Improvement
+    ,   New         // Not in the baseline.
+};
+
+inline const char * comparisonVerdictName ( ComparisonVerdict verdict )
+{
+    switch ( verdict )
+    {
+        case ComparisonVerdict::Unchanged:      return "Unchanged";
+        case ComparisonVerdict::Regression:     return "Regression";
+        case ComparisonVerdict::Improvement:    return "Improvement";
+        case ComparisonVerdict::New:            return "New";
+    }
+    return "Unknown";
+}
+
+struct ComparisonOptions
+{
+    // Relative change of the median a verdict needs, e.g. 0.05 for 5%.
+    double threshold = 0.05;
+    // Significance level of the Mann-Whitney test.
+    double alpha = 0.01;
+};
+
+struct BenchmarkComparison
+{
+    std::string name;
+    ComparisonVerdict verdict = ComparisonVerdict::New;
+    double baselineMedian = 0.0;
+    double currentMedian = 0.0;
+    // ( current - baseline ) / baseline of the medians.
+    double relativeChange = 0.0;
+    double pValue = 1.0;
+    bool ciOverlap = true;
+};
+
+inline BenchmarkComparison compareWithBaseline (
+    SuiteResult const & current,
+    BaselineResult const & baseline,
+    ComparisonOptions const & options
+)
+{
+    BenchmarkComparison comparison;
+    comparison.name = current.name;
+    comparison.baselineMedian = baseline.median;
+    comparison.currentMedian = current.stats.median;
+    if ( baseline.median > 0.0 )
+    {
+        comparison.relativeChange =
+            ( current.stats.median - baseline.median ) / baseline.median;
+    }
+    comparison.pValue = mannWhitneyPValue( current.samples, baseline.samples );
+    comparison.ciOverlap =
+        std::abs( current.stats.mean - baseline.mean )
+            <= current.stats.ciHalfWidth + baseline.ciHalfWidth;
+
+    const bool significant =
+        comparison.pValue < options.alpha && !comparison.ciOverlap;
+    if ( significant && comparison.relativeChange > options.threshold )
+        comparison.verdict = ComparisonVerdict::Regression;
+    else if ( significant && comparison.relativeChange < -options.threshold )
+        comparison.verdict = ComparisonVerdict::Improvement;
+    else
+        comparison.verdict = ComparisonVerdict::Unchanged;
+    return comparison;
+}
+
+// One comparison per current result, in the order of `results`.
+inline std::vector< BenchmarkComparison > compareWithBaseline (
+    std::vector< SuiteResult > const & results,
+    Baseline const & baseline,
+    ComparisonOptions const & options
+)
+{
+    std::vector< BenchmarkComparison > comparisons;
+    for ( SuiteResult const & result : results )
+    {
+        auto it = baseline.results.find( result.name );
+        if ( it != baseline.results.end() )
+        {
+            comparisons.push_back(
+                compareWithBaseline( result, it->second, options )
+            );
+            continue;
+        }
+        BenchmarkComparison comparison;
+        comparison.name = result.name;
+        comparison.currentMedian = result.stats.median;
+        comparisons.push_back( comparison );
+    }
+    return comparisons;
+}
+
+inline bool hasRegression ( std::vector< BenchmarkComparison > const & list )
+{
+    for ( BenchmarkComparison const & comparison : list )
+    {
+        if ( comparison.verdict == ComparisonVerdict::Regression )
+            return true;
+    }
+    return false;
+}
+
+// Warns about every system field that differs between the baseline and the
+// running binary.
+inline void warnOnSystemMismatch (
+    std::ostream & out, Baseline const & baseline, SuiteOptions const & options
+)
+{
+    for ( auto const & [ key, value ] : systemInfoFields( options ) )
+    {
+        if ( key == "repetitions" )
+            continue;
+        const std::string stored = baseline.field( key );
+        if ( !stored.empty() && stored != value )
+        {
+            out << "Warning: baseline " << key << " is \"" << stored
+                << "\", this run has \"" << value << "\"\n";
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+inline void printComparisons (
+    std::ostream & out, std::vector< BenchmarkComparison > const & list
+)
+{
+    std::ios::fmtflags flags = out.flags();
+    for ( BenchmarkComparison const & c : list )
+    {
+        out << std::left << std::setw( 40 ) << c.name << std::right << " "
+            << std::setw( 11 ) << comparisonVerdictName( c.verdict );
+        if ( c.verdict != ComparisonVerdict::New )
+        {
+            out << std::fixed << std::setprecision( 3 )
+                << "  " << c.baselineMedian << " -> " << c.currentMedian
+                << " ns/op (" << std::showpos << c.relativeChange * 100
+                << std::noshowpos << "%, p " << std::scientific
+                << std::setprecision( 2 ) << c.pValue
+                << ( c.ciOverlap ? ", CIs overlap" : "" ) << ")";
+        }
+        out << "\n";
+        out.flags( flags );
+    }
+    out << std::flush;
+}
+
+inline bool writeComparisonCsv (
+    std::string const & filename,
+    std::vector< BenchmarkComparison > const & list,
+    ComparisonOptions const & options
+)
+{
+    std::ofstream ofs( filename );
+    if ( !ofs )
+    {
+        std::cerr
+            << "Error: cannot open file " << filename << " for writing.\n"
+        ;
+        return false;
+    }
+
+    ofs << std::setprecision( 9 );
+    ofs << "# threshold: " << options.threshold << "\n"
+        << "# alpha: " << options.alpha << "\n";
+    ofs << "Name,Verdict,BaselineMedian,CurrentMedian,RelativeChange"
+        << ",PValue,CiOverlap\n";
+    for ( BenchmarkComparison const & c : list )
+    {
+        ofs << c.name << "," << comparisonVerdictName( c.verdict )
+            << "," << c.baselineMedian << "," << c.currentMedian
+            << "," << c.relativeChange << "," << c.pValue
+            << "," << ( c.ciOverlap ? 1 : 0 ) << "\n";
+    }
+    std::cout << "Comparison written to " << filename << std::endl;
+    return true;
+}
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__BASELINE_H__
@@ -3,7 +3,11 @@
 
 /*----------------------------------------------------------------------------*/
 
+#include "cache.h"
+#include "math.h"
+#include "perf_counters.h"
 #include "timer.h"
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
@@ -22,30 +26,17 @@ inline void doNotOptimize ( T const & value )
 
 /*----------------------------------------------------------------------------*/
 
-// Helper: Calculate average from a vector of times.
-double calculateAverage ( std::vector<double> const & times )
-{
-    double sum = 0.0;
-    for ( double t : times )
-        sum += t;
-    return sum / times.size();
-}
-
-// Helper: Calculate standard deviation (if needed).
-double calculateStdDev ( std::vector<double> const & times, double avg )
-{
-    double sumSq = 0.0;
-    for (double t : times) {
-        double diff = t - avg;
-        sumSq += diff * diff;
-    }
-    return std::sqrt(sumSq / times.size());
-}
-
-/*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 
+/*
+All runBenchmark* loops open a PerfScope around every timed call: with a
+PerfRecorder alive on the calling thread, they also record the hardware
+counters of every iteration (see utils/perf_counters.h).
+Likewise, with a CacheScope alive they bring the cache into its state, warm
+or cold, before every timed call (see utils/cache.h).
+*/
+
 /*
 Generalized benchmark function template (single parameter).
 
@@ -68,11 +59,14 @@ std::vector<double> runBenchmarkSingle (
     iterationTimes.reserve( iterations );
     for (int iter = 0; iter < iterations; ++iter)
     {
-        Timer< _RatioT > timer( "Benchmark" );
+        applyCacheState();
+        PerfScope perf;
+        BenchmarkTimer< _RatioT > timer( "Benchmark" );
         auto result = func( std::forward< _ArgsT >( args )... );
         doNotOptimize( result );
         // var = result;
         iterationTimes.push_back(timer.stop());
+        perf.stop();
     }
     return iterationTimes;
 }
@@ -92,7 +86,8 @@ Parameters:
 - args...: Additional arguments passed to the callback function.
 
 The Timer type uses Ratio (for example, std::milli or std::micro) as its time
-unit.
+unit. Every runBenchmark* loop also accepts a timer type in place of the
+ratio, such as TscTimer< std::nano > (see BenchmarkTimer in utils/timer.h).
 */
 template <
         typename _RatioT
@@ -111,12 +106,15 @@ std::vector< std::vector<double> > runBenchmark (
         iterationTimes.reserve( iterations );
         for (int iter = 0; iter < iterations; ++iter)
         {
-            Timer< _RatioT > timer( "Benchmark" );
+            applyCacheState();
+            PerfScope perf;
+            BenchmarkTimer< _RatioT > timer( "Benchmark" );
             // The benchmark function is called with the current parameter value
             // and any additional parameters.
             auto result = func( param, std::forward< _ArgsT >( args )... );
             doNotOptimize(result);
             iterationTimes.push_back(timer.stop());
+            perf.stop();
         }
         allIterationTimes.push_back(iterationTimes);
     }
@@ -155,7 +153,9 @@ std::vector< std::vector<double> > runBenchmarkWithPreCalc(
         iterationTimes.reserve( iterations );
         for (int iter = 0; iter < iterations; ++iter)
         {
-            Timer< _RatioT > timer( "BenchmarkWithPreCalc" );
+            applyCacheState();
+            PerfScope perf;
+            BenchmarkTimer< _RatioT > timer( "BenchmarkWithPreCalc" );
             // Pass both the pre-calculated data and the current parameter value
             // to the benchmark function.
             auto result = func(
@@ -163,6 +163,7 @@ std::vector< std::vector<double> > runBenchmarkWithPreCalc(
             );
             doNotOptimize(result);
             iterationTimes.push_back(timer.stop());
+            perf.stop();
         }
         allIterationTimes.push_back(iterationTimes);
     }
@@ -171,6 +172,182 @@ std::vector< std::vector<double> > runBenchmarkWithPreCalc(
 
 /*----------------------------------------------------------------------------*/
 
+/*
+Variant of runBenchmarkWithPreCalc for benchmarks that modify their input.
+The pre-calculated data stays untouched and func works on a copy of it,
+taken by reference. Before every iteration reset( working, pristine )
+restores the copy outside the timed region, so the measurement holds only
+func and not the copy a by-value parameter would make.
+The reset calls are timed on their own and returned next to the run times.
+CopyReset, the usual reset, copy-assigns. That reuses the working storage, so
+for vectors of trivially copyable elements it is a plain memcpy.
+*/
+struct ResetBenchmarkTimes
+{
+    std::vector< std::vector<double> > run;
+    std::vector< std::vector<double> > reset;
+};
+
+struct CopyReset
+{
+    template < typename _T >
+    void operator () ( _T & working, _T const & pristine ) const
+    {
+        working = pristine;
+    }
+};
+
+template <
+        typename _RatioT
+    ,   typename _PreCalcFuncT
+    ,   typename _ResetFuncT
+    ,   typename _BenchmarkFuncT
+    ,   typename... _ArgsT
+>
+ResetBenchmarkTimes runBenchmarkWithReset (
+    int paramStart, int paramEnd, int paramStep, int iterations,
+    _PreCalcFuncT preCalc, _ResetFuncT reset, _BenchmarkFuncT func,
+    _ArgsT &&... args
+)
+{
+    ResetBenchmarkTimes allTimes;
+    for ( int param = paramStart; param <= paramEnd; param += paramStep )
+    {
+        const auto pristine =
+            preCalc( param, std::forward< _ArgsT >( args )... );
+        auto working = pristine;
+        std::vector< double > runTimes;
+        std::vector< double > resetTimes;
+        runTimes.reserve( iterations );
+        resetTimes.reserve( iterations );
+        for ( int iter = 0; iter < iterations; ++iter )
+        {
+            BenchmarkTimer< _RatioT > resetTimer( "BenchmarkReset" );
+            reset( working, pristine );
+            doNotOptimize( working );
+            resetTimes.push_back( resetTimer.stop() );
+
+            applyCacheState();
+            PerfScope perf;
+            BenchmarkTimer< _RatioT > timer( "BenchmarkWithReset" );
+            auto result = func(
+                working, param, std::forward< _ArgsT >( args )...
+            );
+            doNotOptimize( result );
+            runTimes.push_back( timer.stop() );
+            perf.stop();
+        }
+        allTimes.run.push_back( runTimes );
+        allTimes.reset.push_back( resetTimes );
+    }
+    return allTimes;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Adaptive runner: instead of a fixed iteration count it runs
+- warmupIterations untimed calls, so caches, branch predictors and the page
+  tables are warm and lazy initialization is out of the way,
+- at least minIterations timed calls,
+- then more until the 95% confidence interval of the outlier-filtered mean is
+  within targetRelativeCi of the mean, maxIterations is reached, or the
+  measurement has taken maxSeconds.
+Feed the samples to computeBenchmarkStats (utils/math.h) or
+printBenchmarkStats.
+*/
+struct RunnerOptions
+{
+    int warmupIterations = 3;
+    int minIterations = 10;
+    int maxIterations = 1000;
+    double targetRelativeCi = 0.01;
+    // Time budget of one measurement in seconds, <= 0 for none.
+    double maxSeconds = 2.0;
+    OutlierFilter filter = OutlierFilter::Mad;
+};
+
+// True once the samples satisfy the confidence target of `options`.
+inline bool hasConverged (
+    std::vector< double > const & times, RunnerOptions const & options
+)
+{
+    BenchmarkStats stats = computeBenchmarkStats( times, options.filter );
+    return stats.ciHalfWidth <= options.targetRelativeCi * stats.mean;
+}
+
+template <
+        typename _RatioT
+    ,   typename _BenchmarkFuncT
+    ,   typename... _ArgsT
+>
+std::vector<double> runBenchmarkAdaptiveSingle (
+    RunnerOptions const & options, _BenchmarkFuncT func, _ArgsT&&... args
+)
+{
+    using Clock = std::chrono::steady_clock;
+
+    for ( int iter = 0; iter < options.warmupIterations; ++iter )
+    {
+        auto result = func( std::forward< _ArgsT >( args )... );
+        doNotOptimize( result );
+    }
+
+    std::vector<double> iterationTimes;
+    std::size_t nextCheck = options.minIterations;
+    const auto start = Clock::now();
+    for ( int iter = 0; iter < options.maxIterations; ++iter )
+    {
+        applyCacheState();
+        PerfScope perf;
+        BenchmarkTimer< _RatioT > timer( "BenchmarkAdaptive" );
+        auto result = func( std::forward< _ArgsT >( args )... );
+        doNotOptimize( result );
+        iterationTimes.push_back( timer.stop() );
+        perf.stop();
+
+        if ( iterationTimes.size() < nextCheck )
+            continue;
+        // Checking sorts the samples, so do it at geometrically growing
+        // intervals rather than after every iteration.
+        nextCheck = iterationTimes.size() + iterationTimes.size() / 8 + 1;
+        if ( hasConverged( iterationTimes, options ) )
+            break;
+        std::chrono::duration< double > elapsed = Clock::now() - start;
+        if ( options.maxSeconds > 0 && elapsed.count() >= options.maxSeconds )
+            break;
+    }
+    return iterationTimes;
+}
+
+// Adaptive counterpart of runBenchmark: one adaptive measurement per
+// parameter value. The inner vectors may differ in length.
+template <
+        typename _RatioT
+    ,   typename _BenchmarkFuncT
+    ,   typename... _ArgsT
+>
+std::vector< std::vector<double> > runBenchmarkAdaptive (
+    int paramStart, int paramEnd, int paramStep, RunnerOptions const & options,
+    _BenchmarkFuncT func, _ArgsT &&... args
+)
+{
+    std::vector< std::vector<double> > allIterationTimes;
+    for ( int param = paramStart; param <= paramEnd; param += paramStep )
+    {
+        allIterationTimes.push_back( runBenchmarkAdaptiveSingle< _RatioT >(
+            options,
+            [ & ] ()
+            {
+                return func( param, std::forward< _ArgsT >( args )... );
+            }
+        ) );
+    }
+    return allIterationTimes;
+}
+
+/*----------------------------------------------------------------------------*/
+
 /*
 Example usage:
 
@@ -198,6 +375,11 @@ might prepare a matrix that will then be used in the benchmark function.
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 
+/*
+Print the statistics of computeBenchmarkStats: the average and deviation are
+taken after MAD outlier rejection, the median, percentiles and minimum over
+all samples.
+*/
 template < typename _TimerT >
 void printBenchmarkStats (
     std::ostream & out,
@@ -205,11 +387,17 @@ void printBenchmarkStats (
     std::vector<double> const & iterationTimes
 )
 {
-    double average = calculateAverage( iterationTimes );
-    double stddev = calculateStdDev( iterationTimes, average );
+    BenchmarkStats stats = computeBenchmarkStats( iterationTimes );
+    const char * unit = _TimerT::unit();
     out << label << " Benchmark: "
-        << "Average time: " << average << " " << _TimerT::unit()
-        << ", StdDev: " << stddev << " " << _TimerT::unit()
+        << "Average time: " << stats.mean << " " << unit
+        << ", StdDev: " << stats.stdDev << " " << unit
+        << ", Median: " << stats.median << " " << unit
+        << ", P90: " << stats.p90 << " " << unit
+        << ", P99: " << stats.p99 << " " << unit
+        << ", Min: " << stats.min << " " << unit
+        << " (" << stats.samples << " samples, "
+        << stats.outliers << " outliers)"
         << std::endl
     ;
 }
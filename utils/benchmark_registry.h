@@ -0,0 +1,338 @@
+#ifndef __UTILS__BENCHMARK_REGISTRY_H__
+#define __UTILS__BENCHMARK_REGISTRY_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "benchmark.hpp"
+#include "math.h"
+#include "page_allocator.h"
+#include "system_info.h"
+#include "timer.h"
+
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <ostream>
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Registry of named benchmarks for the suite driver (cpu_caches/
+benchmark_suite.cpp). A definition has a name and a list of parameter
+values; for every value, setup( value ) builds the data and returns the
+timed body, together with the number of operations one call performs. The
+driver times the body with runBenchmarkAdaptiveSingle and reports
+nanoseconds per operation, so a batch of lookups and a single scan are
+compared on the same scale.
+
+Definitions register themselves from a static object:
+
+    static BenchmarkRegistrar registerScan( {
+        "count/Scalar", "Rows", { 256, 4096 },
+        [] ( long long rows ) { ...; return BenchmarkCase{ body, ops }; }
+    } );
+
+A run is identified by its full name, "<name>/<parameter value>", which is
+what --filter matches and what a stored baseline is keyed by.
+*/
+
+struct BenchmarkCase
+{
+    // One timed call; the result is kept alive with doNotOptimize.
+    std::function< double () > run;
+    std::size_t operations = 1;
+};
+
+struct BenchmarkDefinition
+{
+    std::string name;
+    std::string parameterName;
+    std::vector< long long > parameters;
+    std::function< BenchmarkCase ( long long ) > setup;
+};
+
+inline std::string benchmarkRunName (
+    BenchmarkDefinition const & definition, long long parameter
+)
+{
+    return definition.name + "/" + std::to_string( parameter );
+}
+
+class BenchmarkRegistry
+{
+
+public:
+
+    void add ( BenchmarkDefinition definition )
+    {
+        m_definitions.push_back( std::move( definition ) );
+    }
+
+    std::vector< BenchmarkDefinition > const & definitions () const
+    {
+        return m_definitions;
+    }
+
+private:
+
+    std::vector< BenchmarkDefinition > m_definitions;
+};
+
+// Filled by the BenchmarkRegistrar objects before main.
+inline BenchmarkRegistry & benchmarkRegistry ()
+{
+    static BenchmarkRegistry registry;
+    return registry;
+}
+
+struct BenchmarkRegistrar
+{
+    explicit BenchmarkRegistrar ( BenchmarkDefinition definition )
+    {
+        benchmarkRegistry().add( std::move( definition ) );
+    }
+};
+
+/*----------------------------------------------------------------------------*/
+
+// Options of one suite run. Every selected benchmark is measured
+// `repetitions` times with `runner`; the samples of all repetitions are
+// pooled.
+struct SuiteOptions
+{
+    std::string filter = ".*";
+    int repetitions = 1;
+    RunnerOptions runner;
+    CacheState cache = CacheState::Warm;
+};
+
+struct SuiteResult
+{
+    std::string name;
+    std::string parameterName;
+    long long parameter = 0;
+    std::size_t operations = 1;
+    // Nanoseconds per operation, one per timed call.
+    std::vector< double > samples;
+    // Mean of every repetition.
+    std::vector< double > repetitionMeans;
+    BenchmarkStats stats;
+};
+
+using SuiteTimer = TscTimer< std::nano >;
+
+inline SuiteResult runBenchmarkCase (
+    BenchmarkDefinition const & definition,
+    long long parameter,
+    SuiteOptions const & options
+)
+{
+    SuiteResult result;
+    result.name = benchmarkRunName( definition, parameter );
+    result.parameterName = definition.parameterName;
+    result.parameter = parameter;
+
+    BenchmarkCase benchmarkCase = definition.setup( parameter );
+    result.operations = std::max< std::size_t >( benchmarkCase.operations, 1 );
+    const double perOperation =
+        1.0 / static_cast< double >( result.operations );
+    CacheScope cacheScope( options.cache );
+    for ( int r = 0; r < options.repetitions; ++r )
+    {
+        std::vector< double > times =
+            runBenchmarkAdaptiveSingle< SuiteTimer >(
+                options.runner, benchmarkCase.run
+            );
+        for ( double & time : times )
+            time *= perOperation;
+        result.repetitionMeans.push_back( calculateAverage( times ) );
+        result.samples.insert(
+            result.samples.end(), times.begin(), times.end()
+        );
+    }
+    result.stats =
+        computeBenchmarkStats( result.samples, options.runner.filter );
+    return result;
+}
+
+// Runs every registered run whose full name matches options.filter, in
+// registration order.
+inline std::vector< SuiteResult > runBenchmarkSuite (
+    SuiteOptions const & options, std::ostream & log
+)
+{
+    const std::regex filter( options.filter );
+    std::vector< SuiteResult > results;
+    for ( BenchmarkDefinition const & definition :
+          benchmarkRegistry().definitions() )
+    {
+        for ( long long parameter : definition.parameters )
+        {
+            if ( !std::regex_search(
+                     benchmarkRunName( definition, parameter ), filter ) )
+                continue;
+            results.push_back(
+                runBenchmarkCase( definition, parameter, options )
+            );
+            BenchmarkStats const & st = results.back().stats;
+            log << std::left << std::setw( 40 ) << results.back().name
+                << std::right << " " << std::fixed << std::setprecision( 3 )
+                << st.mean << " ns/op +- " << st.ciHalfWidth
+                << " (" << st.samples << " samples)" << std::endl;
+            log.unsetf( std::ios::floatfield );
+        }
+    }
+    return results;
+}
+
+/*----------------------------------------------------------------------------*/
+
+namespace registry_detail
+{
+
+inline void writeJsonString ( std::ostream & out, std::string const & text )
+{
+    out << '"';
+    for ( char c : text )
+    {
+        if ( c == '"' || c == '\\' )
+            out << '\\';
+        out << c;
+    }
+    out << '"';
+}
+
+} // namespace registry_detail
+
+// The fields of systemInfo() as ( key, value ) pairs, in output order.
+inline std::vector< std::pair< std::string, std::string > > systemInfoFields (
+    SuiteOptions const & options
+)
+{
+    SystemInfo const & info = systemInfo();
+    return {
+            { "machine", machineName() }
+        ,   { "cpu_model", info.cpuModel }
+        ,   { "logical_cores", std::to_string( info.logicalCores ) }
+        ,   { "physical_cores", std::to_string( info.physicalCores ) }
+        ,   { "l1d_bytes", std::to_string( info.caches.l1d ) }
+        ,   { "l2_bytes", std::to_string( info.caches.l2 ) }
+        ,   { "l3_bytes", std::to_string( info.caches.l3 ) }
+        ,   { "os", info.os }
+        ,   { "arch", info.arch }
+        ,   { "compiler", info.compiler }
+        ,   { "flags", info.flags }
+        ,   { "cache_state", cacheStateName( options.cache ) }
+        ,   { "pages", pageDescription() }
+        ,   { "repetitions", std::to_string( options.repetitions ) }
+    };
+}
+
+/*
+JSON: a "system" object with systemInfoFields, and a "benchmarks" array with
+the statistics and the raw samples of every run, all in ns per operation.
+*/
+inline bool writeSuiteJson (
+    std::string const & filename,
+    std::vector< SuiteResult > const & results,
+    SuiteOptions const & options
+)
+{
+    std::ofstream ofs( filename );
+    if ( !ofs )
+    {
+        std::cerr
+            << "Error: cannot open file " << filename << " for writing.\n"
+        ;
+        return false;
+    }
+
+    ofs << std::setprecision( 9 );
+    ofs << "{\n  \"system\": {";
+    const char * separator = "\n";
+    for ( auto const & [ key, value ] : systemInfoFields( options ) )
+    {
+        ofs << separator << "    ";
+        registry_detail::writeJsonString( ofs, key );
+        ofs << ": ";
+        registry_detail::writeJsonString( ofs, value );
+        separator = ",\n";
+    }
+    ofs << "\n  },\n  \"benchmarks\": [";
+    separator = "\n";
+    for ( SuiteResult const & r : results )
+    {
+        BenchmarkStats const & st = r.stats;
+        ofs << separator << "    {\"name\": ";
+        registry_detail::writeJsonString( ofs, r.name );
+        ofs << ", \"parameter_name\": ";
+        registry_detail::writeJsonString( ofs, r.parameterName );
+        ofs << ", \"parameter\": " << r.parameter
+            << ", \"operations\": " << r.operations
+            << ", \"unit\": \"ns\""
+            << ", \"mean\": " << st.mean << ", \"std_dev\": " << st.stdDev
+            << ", \"ci_half_width\": " << st.ciHalfWidth
+            << ", \"median\": " << st.median << ", \"p90\": " << st.p90
+            << ", \"p99\": " << st.p99 << ", \"min\": " << st.min
+            << ", \"max\": " << st.max << ", \"outliers\": " << st.outliers
+            << ", \"samples\": [";
+        for ( std::size_t i = 0; i < r.samples.size(); ++i )
+            ofs << ( i ? ", " : "" ) << r.samples[ i ];
+        ofs << "]}";
+        separator = ",\n";
+    }
+    ofs << "\n  ]\n}\n";
+    std::cout << "Benchmark results written to " << filename << std::endl;
+    return true;
+}
+
+/*
+CSV: the system fields as "# key: value" comment lines, then one row per run.
+The Samples column holds the raw samples separated by spaces, so the file can
+be loaded back as a baseline.
+*/
+inline bool writeSuiteCsv (
+    std::string const & filename,
+    std::vector< SuiteResult > const & results,
+    SuiteOptions const & options
+)
+{
+    std::ofstream ofs( filename );
+    if ( !ofs )
+    {
+        std::cerr
+            << "Error: cannot open file " << filename << " for writing.\n"
+        ;
+        return false;
+    }
+
+    ofs << std::setprecision( 9 );
+    for ( auto const & [ key, value ] : systemInfoFields( options ) )
+        ofs << "# " << key << ": " << value << "\n";
+    ofs << "Name,ParameterName,Parameter,Operations,Unit,Mean,StdDev"
+        << ",CiHalfWidth,Median,P90,P99,Min,Max,Samples\n";
+    for ( SuiteResult const & r : results )
+    {
+        BenchmarkStats const & st = r.stats;
+        ofs << r.name << "," << r.parameterName << "," << r.parameter
+            << "," << r.operations << ",ns"
+            << "," << st.mean << "," << st.stdDev << "," << st.ciHalfWidth
+            << "," << st.median << "," << st.p90 << "," << st.p99
+            << "," << st.min << "," << st.max << ",";
+        for ( std::size_t i = 0; i < r.samples.size(); ++i )
+            ofs << ( i ? " " : "" ) << r.samples[ i ];
+        ofs << "\n";
+    }
+    std::cout << "Benchmark results written to " << filename << std::endl;
+    return true;
+}
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__BENCHMARK_REGISTRY_H__
@@ -0,0 +1,135 @@
+#ifndef __UTILS__BOUNDED_QUEUE_H__
+#define __UTILS__BOUNDED_QUEUE_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "cache.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Bounded lock-free multi-producer, multi-consumer queue (Dmitry Vyukov's
+array queue). The capacity is rounded up to a power of two. Every cell holds
+a sequence number that tells whose turn it is: a producer may fill cell i of
+lap k when its sequence is i + k * capacity, a consumer may empty it when the
+sequence is one more. Producers and consumers each claim a position with one
+compare-and-swap on their own cache line, and then only touch their cell;
+there is no lock, and a full or empty queue is reported instead of waited on.
+
+tryPush and tryPop return false when the queue is full or empty; the caller
+decides how to wait, which is where the back-pressure of a pipeline shows.
+With a single producer and a single consumer it serves as an SPSC queue too,
+the compare-and-swaps then always succeed on the first try.
+*/
+template < typename _T >
+class BoundedQueue
+{
+
+public:
+
+    explicit BoundedQueue ( std::size_t capacity )
+        :   m_mask( roundUpToPowerOfTwo( capacity ) - 1 )
+        ,   m_cells( new Cell[ m_mask + 1 ] )
+    {
+        for ( std::size_t i = 0; i <= m_mask; ++i )
+            m_cells[ i ].sequence.store( i, std::memory_order_relaxed );
+    }
+
+    BoundedQueue ( BoundedQueue const & ) = delete;
+    BoundedQueue & operator = ( BoundedQueue const & ) = delete;
+
+    std::size_t capacity () const { return m_mask + 1; }
+
+    bool tryPush ( _T value )
+    {
+        std::size_t position = m_tail.value.load( std::memory_order_relaxed );
+        for ( ;; )
+        {
+            Cell & cell = m_cells[ position & m_mask ];
+            const std::size_t sequence =
+                cell.sequence.load( std::memory_order_acquire );
+            const auto lag =
+                static_cast< std::ptrdiff_t >( sequence - position );
+            if ( lag == 0 )
+            {
+                if ( m_tail.value.compare_exchange_weak(
+                         position, position + 1, std::memory_order_relaxed ) )
+                {
+                    cell.value = std::move( value );
+                    cell.sequence.store(
+                        position + 1, std::memory_order_release
+                    );
+                    return true;
+                }
+            }
+            else if ( lag < 0 )
+                return false;
+            else
+                position = m_tail.value.load( std::memory_order_relaxed );
+        }
+    }
+
+    bool tryPop ( _T & value )
+    {
+        std::size_t position = m_head.value.load( std::memory_order_relaxed );
+        for ( ;; )
+        {
+            Cell & cell = m_cells[ position & m_mask ];
+            const std::size_t sequence =
+                cell.sequence.load( std::memory_order_acquire );
+            const auto lag =
+                static_cast< std::ptrdiff_t >( sequence - ( position + 1 ) );
+            if ( lag == 0 )
+            {
+                if ( m_head.value.compare_exchange_weak(
+                         position, position + 1, std::memory_order_relaxed ) )
+                {
+                    value = std::move( cell.value );
+                    cell.sequence.store(
+                        position + m_mask + 1, std::memory_order_release
+                    );
+                    return true;
+                }
+            }
+            else if ( lag < 0 )
+                return false;
+            else
+                position = m_head.value.load( std::memory_order_relaxed );
+        }
+    }
+
+private:
+
+    static std::size_t roundUpToPowerOfTwo ( std::size_t n )
+    {
+        std::size_t power = 1;
+        while ( power < n )
+            power <<= 1;
+        return power;
+    }
+
+    struct Cell
+    {
+        std::atomic< std::size_t > sequence;
+        _T value;
+    };
+
+    struct alignas( DESTRUCTIVE_INTERFERENCE_SIZE ) Position
+    {
+        std::atomic< std::size_t > value{ 0 };
+    };
+
+    const std::size_t m_mask;
+    std::unique_ptr< Cell[] > m_cells;
+    Position m_tail;
+    Position m_head;
+};
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__BOUNDED_QUEUE_H__
@@ -0,0 +1,130 @@
+#ifndef __UTILS__BUMP_ALLOCATOR_H__
+#define __UTILS__BUMP_ALLOCATOR_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Bump-pointer pool: allocations are carved one after another out of large
+blocks, so objects allocated in sequence are adjacent in memory. Freeing a
+single allocation does nothing; all memory is released with the pool.
+
+Blocks start at `initialBlockSize` bytes and double, up to MAX_BLOCK_SIZE.
+Sizing the first block for the whole container keeps it in one block.
+*/
+class BumpPool
+{
+
+public:
+
+    static constexpr std::size_t MAX_BLOCK_SIZE = std::size_t{ 64 } << 20;
+
+    explicit BumpPool ( std::size_t initialBlockSize = 64 * 1024 )
+        :   m_nextBlockSize( std::max< std::size_t >( initialBlockSize, 64 ) )
+    {
+    }
+
+    BumpPool ( BumpPool const & ) = delete;
+    BumpPool & operator = ( BumpPool const & ) = delete;
+
+    void * allocate ( std::size_t bytes, std::size_t alignment )
+    {
+        std::uintptr_t aligned = alignUp( m_next, alignment );
+        if ( !m_next || aligned + bytes > m_end )
+        {
+            grow( bytes + alignment );
+            aligned = alignUp( m_next, alignment );
+        }
+        m_next = reinterpret_cast< char * >( aligned + bytes );
+        m_used += bytes;
+        return reinterpret_cast< void * >( aligned );
+    }
+
+    // Bytes handed out, and bytes reserved from the system.
+    std::size_t used () const { return m_used; }
+    std::size_t reserved () const { return m_reserved; }
+
+private:
+
+    static std::uintptr_t alignUp ( char * p, std::size_t alignment )
+    {
+        std::uintptr_t address = reinterpret_cast< std::uintptr_t >( p );
+        return ( address + alignment - 1 ) & ~( alignment - 1 );
+    }
+
+    void grow ( std::size_t minimum )
+    {
+        std::size_t size = std::max( m_nextBlockSize, minimum );
+        m_blocks.emplace_back( new char[ size ] );
+        m_next = m_blocks.back().get();
+        m_end = reinterpret_cast< std::uintptr_t >( m_next ) + size;
+        m_reserved += size;
+        m_nextBlockSize = std::min( m_nextBlockSize * 2, MAX_BLOCK_SIZE );
+    }
+
+    std::vector< std::unique_ptr< char[] > > m_blocks;
+    char * m_next = nullptr;
+    std::uintptr_t m_end = 0;
+    std::size_t m_nextBlockSize;
+    std::size_t m_used = 0;
+    std::size_t m_reserved = 0;
+};
+
+/*----------------------------------------------------------------------------*/
+
+// Standard allocator drawing from a BumpPool; deallocate is a no-op.
+template < typename _T >
+class BumpAllocator
+{
+
+public:
+
+    using value_type = _T;
+
+    explicit BumpAllocator ( BumpPool & pool ) : m_pool( &pool ) {}
+
+    template < typename _U >
+    BumpAllocator ( BumpAllocator< _U > const & other )
+        :   m_pool( other.pool() )
+    {
+    }
+
+    _T * allocate ( std::size_t count )
+    {
+        return static_cast< _T * >(
+            m_pool->allocate( count * sizeof( _T ), alignof( _T ) )
+        );
+    }
+
+    void deallocate ( _T *, std::size_t ) {}
+
+    BumpPool * pool () const { return m_pool; }
+
+    template < typename _U >
+    bool operator == ( BumpAllocator< _U > const & other ) const
+    {
+        return m_pool == other.pool();
+    }
+
+    template < typename _U >
+    bool operator != ( BumpAllocator< _U > const & other ) const
+    {
+        return m_pool != other.pool();
+    }
+
+private:
+
+    BumpPool * m_pool;
+};
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__BUMP_ALLOCATOR_H__
@@ -1,28 +1,391 @@
 #ifndef __UTILS__CACHE_H__
 #define __UTILS__CACHE_H__
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined( __APPLE__ )
+#include <sys/sysctl.h>
+#include <sys/types.h>
+#endif
+
+#if defined( __APPLE__ ) && defined( __aarch64__ )
+#include <libkern/OSCacheControl.h>
+#elif defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+// Cache line size assumed by the aligned data structures.
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+// Minimum distance between two objects written by different threads to avoid
+// false sharing. Fixed rather than std::hardware_destructive_interference_size,
+// which g++ warns about in headers because it follows -mtune and so can
+// change the layout of the structures below between translation units.
+constexpr std::size_t DESTRUCTIVE_INTERFERENCE_SIZE = CACHE_LINE_SIZE;
 
 /*----------------------------------------------------------------------------*/
 
-// Flush the cache by reading/writing a large memory block.
-void flushCache ()
+/*
+Data cache capacities of one core, in bytes, as reported by the OS: sysfs on
+Linux, sysctl on macOS (the performance cores on Apple silicon). Levels the
+OS does not report are 0. cpu_caches/memory_probe measures them instead.
+*/
+struct CacheSizes
 {
-    // Allocate a buffer that's much larger than the L1/L2/L3 caches.
-    // Adjust the size as needed (here we use 50 MB).
-    const std::size_t size = 50 * 1024 * 1024;
-    volatile char* buffer = new volatile char[ size ];
+    std::size_t l1d = 0;
+    std::size_t l2 = 0;
+    std::size_t l3 = 0;
 
-    // Touch the buffer in steps (cache line size is usually 64 bytes).
-    for (size_t i = 0; i < size; i += 64) {
-        buffer[i] = static_cast<char>(i % 256);
+    // Capacity of the last level reported, 0 if none is.
+    std::size_t last () const { return l3 ? l3 : l2 ? l2 : l1d; }
+};
+
+namespace cache_detail
+{
+
+#if defined( __linux__ )
+
+// Parses a sysfs cache size such as "48K", "2048K" or "32M".
+inline std::size_t parseCacheSize ( std::string const & text )
+{
+    std::size_t pos = 0;
+    std::size_t value = 0;
+    try
+    {
+        value = std::stoul( text, &pos );
+    }
+    catch ( ... )
+    {
+        return 0;
     }
+    switch ( pos < text.size() ? text[ pos ] : ' ' )
+    {
+        case 'K':   return value << 10;
+        case 'M':   return value << 20;
+        case 'G':   return value << 30;
+        default:    return value;
+    }
+}
+
+#elif defined( __APPLE__ )
+
+inline std::size_t sysctlSize ( const char * name )
+{
+    std::uint64_t value = 0;
+    std::size_t length = sizeof( value );
+    if ( sysctlbyname( name, &value, &length, nullptr, 0 ) != 0 )
+        return 0;
+    return static_cast< std::size_t >( value );
+}
 
-    // Prevent the compiler from optimizing the loop away.
-    asm volatile("" : : "r"(buffer) : "memory");
+#endif
 
-    // Clean up.
-    delete[] buffer;
+} // namespace cache_detail
+
+inline CacheSizes detectCacheSizes ()
+{
+    CacheSizes sizes;
+#if defined( __linux__ )
+    const std::string root = "/sys/devices/system/cpu/cpu0/cache/index";
+    for ( int index = 0; ; ++index )
+    {
+        const std::string dir = root + std::to_string( index ) + "/";
+        std::ifstream levelFile( dir + "level" );
+        if ( !levelFile )
+            break;
+        int level = 0;
+        std::string type;
+        std::string size;
+        levelFile >> level;
+        std::ifstream( dir + "type" ) >> type;
+        std::ifstream( dir + "size" ) >> size;
+        if ( type == "Instruction" )
+            continue;
+        const std::size_t bytes = cache_detail::parseCacheSize( size );
+        if ( level == 1 )
+            sizes.l1d = bytes;
+        else if ( level == 2 )
+            sizes.l2 = bytes;
+        else if ( level == 3 )
+            sizes.l3 = bytes;
+    }
+#elif defined( __APPLE__ )
+    sizes.l1d = cache_detail::sysctlSize( "hw.perflevel0.l1dcachesize" );
+    sizes.l2 = cache_detail::sysctlSize( "hw.perflevel0.l2cachesize" );
+    if ( !sizes.l1d )
+        sizes.l1d = cache_detail::sysctlSize( "hw.l1dcachesize" );
+    if ( !sizes.l2 )
+        sizes.l2 = cache_detail::sysctlSize( "hw.l2cachesize" );
+    sizes.l3 = cache_detail::sysctlSize( "hw.l3cachesize" );
+#endif
+    return sizes;
+}
+
+// Detected once, on first use.
+inline CacheSizes const & cacheSizes ()
+{
+    static const CacheSizes sizes = detectCacheSizes();
+    return sizes;
+}
+
+/*
+Cache sizes calibrated by cpu_caches/memory_probe, which writes one row per
+level to memory_calibration.csv: Level (L1, L2, L3) and the capacity in the
+Bytes column, among others. The file is looked up at cacheCalibrationPath(),
+the working directory by default; a program may point it elsewhere before
+the first use of calibratedCacheSizes(), or set it empty to ignore it.
+Levels missing from the file, or a missing file, are 0.
+*/
+inline std::string & cacheCalibrationPath ()
+{
+    static std::string path = "memory_calibration.csv";
+    return path;
+}
+
+inline CacheSizes readCacheCalibration ( std::string const & path )
+{
+    CacheSizes sizes;
+    std::ifstream ifs( path );
+    std::string line;
+    if ( !std::getline( ifs, line ) )
+        return sizes;
+
+    constexpr std::size_t BYTES_COLUMN = 3;
+    while ( std::getline( ifs, line ) )
+    {
+        std::vector< std::string > fields;
+        std::size_t begin = 0;
+        for ( ;; )
+        {
+            const std::size_t end = line.find( ',', begin );
+            fields.push_back( line.substr( begin, end - begin ) );
+            if ( end == std::string::npos )
+                break;
+            begin = end + 1;
+        }
+        if ( fields.size() <= BYTES_COLUMN )
+            continue;
+
+        std::size_t bytes = 0;
+        try
+        {
+            bytes = std::stoull( fields[ BYTES_COLUMN ] );
+        }
+        catch ( ... )
+        {
+            continue;
+        }
+        if ( fields[ 0 ] == "L1" )
+            sizes.l1d = bytes;
+        else if ( fields[ 0 ] == "L2" )
+            sizes.l2 = bytes;
+        else if ( fields[ 0 ] == "L3" )
+            sizes.l3 = bytes;
+    }
+    return sizes;
+}
+
+// Read once, on first use.
+inline CacheSizes const & calibratedCacheSizes ()
+{
+    static const CacheSizes sizes = cacheCalibrationPath().empty()
+        ? CacheSizes() : readCacheCalibration( cacheCalibrationPath() );
+    return sizes;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Cache control for the benchmarks.
+
+flushCache() evicts the whole cache hierarchy by writing every line of an
+eviction buffer EVICTION_LLC_FACTOR times the size of the last-level cache:
+the calibrated size when memory_calibration.csv has one, otherwise the size
+the OS reports, and then at least EVICTION_MIN_BYTES since it may be missing
+or understated. The buffer is allocated and touched once, on first use, so
+later flushes pay no allocation or page faults.
+
+flushCacheRange( data, bytes ) writes back and invalidates only the lines of
+one address range: clflush on x86, dc civac on AArch64 (sys_dcache_flush on
+macOS). It is much cheaper than a full flush when the benchmark works on a
+known buffer. Without either instruction it falls back to flushCache().
+*/
+constexpr std::size_t EVICTION_LLC_FACTOR = 2;
+constexpr std::size_t EVICTION_MIN_BYTES = std::size_t{ 50 } << 20;
+
+class EvictionBuffer
+{
+
+public:
+
+    explicit EvictionBuffer ( std::size_t bytes )
+        :   m_bytes( std::max( bytes, CACHE_LINE_SIZE ) )
+        ,   m_data( new char[ m_bytes ]() )
+    {
+    }
+
+    EvictionBuffer ( EvictionBuffer const & ) = delete;
+    EvictionBuffer & operator = ( EvictionBuffer const & ) = delete;
+
+    std::size_t size () const { return m_bytes; }
+
+    void evict ()
+    {
+        volatile char * buffer = m_data.get();
+        for ( std::size_t i = 0; i < m_bytes; i += CACHE_LINE_SIZE )
+            buffer[ i ] = static_cast< char >( buffer[ i ] + 1 );
+
+        // Prevent the compiler from optimizing the loop away.
+        asm volatile( "" : : "r"( buffer ) : "memory" );
+    }
+
+private:
+
+    std::size_t m_bytes;
+    std::unique_ptr< char[] > m_data;
+};
+
+inline std::size_t evictionBytes ()
+{
+    const std::size_t calibrated = calibratedCacheSizes().last();
+    if ( calibrated )
+        return EVICTION_LLC_FACTOR * calibrated;
+    return std::max(
+        EVICTION_LLC_FACTOR * cacheSizes().last(), EVICTION_MIN_BYTES
+    );
+}
+
+// Allocated once, on first use.
+inline EvictionBuffer & evictionBuffer ()
+{
+    static EvictionBuffer buffer( evictionBytes() );
+    return buffer;
+}
+
+// Flush the cache by writing the preallocated eviction buffer.
+inline void flushCache ()
+{
+    evictionBuffer().evict();
+}
+
+inline void flushCacheRange ( const void * data, std::size_t bytes )
+{
+    if ( bytes == 0 )
+        return;
+#if defined( __APPLE__ ) && defined( __aarch64__ )
+    sys_dcache_flush( const_cast< void * >( data ), bytes );
+#elif defined( __SSE2__ ) || defined( __aarch64__ )
+    const std::uintptr_t address = reinterpret_cast< std::uintptr_t >( data );
+    const std::uintptr_t end = address + bytes;
+    for ( std::uintptr_t line = address & ~( CACHE_LINE_SIZE - 1 );
+          line < end; line += CACHE_LINE_SIZE )
+    {
+#if defined( __SSE2__ )
+        _mm_clflush( reinterpret_cast< const void * >( line ) );
+#else
+        asm volatile( "dc civac, %0" : : "r"( line ) : "memory" );
+#endif
+    }
+#if defined( __SSE2__ )
+    _mm_mfence();
+#else
+    asm volatile( "dsb ish" : : : "memory" );
+#endif
+#else
+    (void)data;
+    flushCache();
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Cache state of every timed iteration of the runBenchmark* loops
+(utils/benchmark.hpp) on the calling thread while a CacheScope is alive.
+- Warm, the default: nothing is done between iterations, so each one finds
+  the data the previous ones left in the cache.
+- Cold: before every timed call, outside the timing, the ranges added with
+  addRange are flushed with flushCacheRange, or the whole cache with
+  flushCache if there are none.
+Scopes nest; the innermost one applies.
+*/
+enum class CacheState
+{
+        Warm
+    ,   Cold
+};
+
+inline const char * cacheStateName ( CacheState state )
+{
+    return state == CacheState::Cold ? "Cold" : "Warm";
+}
+
+class CacheScope
+{
+
+public:
+
+    explicit CacheScope ( CacheState state )
+        :   m_state( state )
+        ,   m_previous( active() )
+    {
+        active() = this;
+    }
+
+    CacheScope ( CacheScope const & ) = delete;
+    CacheScope & operator = ( CacheScope const & ) = delete;
+
+    ~CacheScope ()
+    {
+        active() = m_previous;
+    }
+
+    // Scope of the calling thread, nullptr if none.
+    static CacheScope *& active ()
+    {
+        thread_local CacheScope * scope = nullptr;
+        return scope;
+    }
+
+    CacheState state () const { return m_state; }
+
+    void addRange ( const void * data, std::size_t bytes )
+    {
+        m_ranges.emplace_back( data, bytes );
+    }
+
+    // Brings the cache into the state of the scope.
+    void apply () const
+    {
+        if ( m_state == CacheState::Warm )
+            return;
+        if ( m_ranges.empty() )
+            flushCache();
+        for ( auto const & [ data, bytes ] : m_ranges )
+            flushCacheRange( data, bytes );
+    }
+
+private:
+
+    CacheState m_state;
+    CacheScope * m_previous;
+    std::vector< std::pair< const void *, std::size_t > > m_ranges;
+};
+
+// Called by the benchmark loops before every timed call.
+inline void applyCacheState ()
+{
+    if ( const CacheScope * scope = CacheScope::active() )
+        scope->apply();
 }
 
 /*----------------------------------------------------------------------------*/
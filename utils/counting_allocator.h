@@ -0,0 +1,66 @@
+#ifndef __UTILS__COUNTING_ALLOCATOR_H__
+#define __UTILS__COUNTING_ALLOCATOR_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include <cstddef>
+#include <memory>
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Standard allocator that forwards to std::allocator and keeps a running total
+of the bytes it currently has allocated in a counter owned by the caller.
+Containers rebind it for their nodes and bucket arrays, so the counter ends
+up with their whole heap footprint.
+*/
+template < typename _T >
+class CountingAllocator
+{
+
+public:
+
+    using value_type = _T;
+
+    explicit CountingAllocator ( std::size_t & bytes ) : m_bytes( &bytes ) {}
+
+    template < typename _U >
+    CountingAllocator ( CountingAllocator< _U > const & other )
+        :   m_bytes( other.counter() )
+    {
+    }
+
+    _T * allocate ( std::size_t count )
+    {
+        *m_bytes += count * sizeof( _T );
+        return std::allocator< _T >().allocate( count );
+    }
+
+    void deallocate ( _T * p, std::size_t count )
+    {
+        *m_bytes -= count * sizeof( _T );
+        std::allocator< _T >().deallocate( p, count );
+    }
+
+    std::size_t * counter () const { return m_bytes; }
+
+    template < typename _U >
+    bool operator == ( CountingAllocator< _U > const & other ) const
+    {
+        return m_bytes == other.counter();
+    }
+
+    template < typename _U >
+    bool operator != ( CountingAllocator< _U > const & other ) const
+    {
+        return m_bytes != other.counter();
+    }
+
+private:
+
+    std::size_t * m_bytes;
+};
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__COUNTING_ALLOCATOR_H__
@@ -0,0 +1,49 @@
+#ifndef __UTILS__CPU_FEATURES_H__
+#define __UTILS__CPU_FEATURES_H__
+
+/*----------------------------------------------------------------------------*/
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define PERF_ARCH_X86 1
+#elif defined( __aarch64__ )
+#define PERF_ARCH_ARM64 1
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+// Instruction set extensions available on the running CPU.
+struct CpuFeatures
+{
+    bool sse2 = false;
+    bool avx2 = false;
+    bool avx512f = false;
+    bool popcnt = false;
+    bool neon = false;
+};
+
+inline CpuFeatures detectCpuFeatures ()
+{
+    CpuFeatures features;
+#if defined( PERF_ARCH_X86 )
+    __builtin_cpu_init();
+    features.sse2 = __builtin_cpu_supports( "sse2" );
+    features.avx2 = __builtin_cpu_supports( "avx2" );
+    features.avx512f = __builtin_cpu_supports( "avx512f" );
+    features.popcnt = __builtin_cpu_supports( "popcnt" );
+#elif defined( PERF_ARCH_ARM64 )
+    // Advanced SIMD is mandatory on AArch64.
+    features.neon = true;
+#endif
+    return features;
+}
+
+// Detected once, on first use.
+inline CpuFeatures const & cpuFeatures ()
+{
+    static const CpuFeatures features = detectCpuFeatures();
+    return features;
+}
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__CPU_FEATURES_H__
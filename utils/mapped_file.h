@@ -0,0 +1,139 @@
+#ifndef __UTILS__MAPPED_FILE_H__
+#define __UTILS__MAPPED_FILE_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Read-only memory mapping of a whole file.
+
+The mapping is advised as sequential and, where the kernel supports it, as a
+huge-page candidate. Failures are reported on std::cerr and leave the object
+invalid (see isValid()); the advice calls are hints and may be ignored.
+*/
+class MappedFile
+{
+
+public:
+
+    explicit MappedFile ( std::string const & path )
+    {
+        m_fd = ::open( path.c_str(), O_RDONLY );
+        if ( m_fd < 0 )
+        {
+            reportError( "cannot open", path );
+            return;
+        }
+
+        struct stat info;
+        if ( ::fstat( m_fd, &info ) != 0 )
+        {
+            reportError( "cannot stat", path );
+            return;
+        }
+        m_size = static_cast< std::size_t >( info.st_size );
+        if ( m_size == 0 )
+        {
+            std::cerr << "Error: " << path << " is empty.\n";
+            return;
+        }
+
+        void * address =
+            ::mmap( nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0 );
+        if ( address == MAP_FAILED )
+        {
+            reportError( "cannot map", path );
+            return;
+        }
+        m_data = static_cast< const char * >( address );
+
+        advise( 0, m_size, MADV_SEQUENTIAL );
+#if defined( MADV_HUGEPAGE )
+        advise( 0, m_size, MADV_HUGEPAGE );
+#endif
+    }
+
+    MappedFile ( MappedFile const & ) = delete;
+    MappedFile & operator = ( MappedFile const & ) = delete;
+
+    ~MappedFile ()
+    {
+        if ( m_data )
+            ::munmap( const_cast< char * >( m_data ), m_size );
+        if ( m_fd >= 0 )
+            ::close( m_fd );
+    }
+
+    bool isValid () const { return m_data != nullptr; }
+
+    const char * data () const { return m_data; }
+    std::size_t size () const { return m_size; }
+
+    // Start reading [offset, offset + length) ahead of use.
+    void willNeed ( std::size_t offset, std::size_t length ) const
+    {
+        advise( offset, length, MADV_WILLNEED );
+    }
+
+    // Pages of [offset, offset + length) will not be read again; drop them
+    // from our mapping so the resident set stays bounded.
+    void dontNeed ( std::size_t offset, std::size_t length ) const
+    {
+        advise( offset, length, MADV_DONTNEED );
+    }
+
+    // Ask the kernel to evict the file from the page cache, so the next pass
+    // reads from the device. Only clean, unmapped pages can be dropped.
+    void dropPageCache () const
+    {
+#if defined( POSIX_FADV_DONTNEED )
+        ::posix_fadvise( m_fd, 0, 0, POSIX_FADV_DONTNEED );
+#endif
+    }
+
+private:
+
+    void advise ( std::size_t offset, std::size_t length, int advice ) const
+    {
+        if ( !m_data || offset >= m_size )
+            return;
+
+        // madvise wants a page-aligned start address.
+        static const std::size_t pageSize =
+            static_cast< std::size_t >( ::sysconf( _SC_PAGESIZE ) );
+        std::size_t begin = offset / pageSize * pageSize;
+        std::size_t end = std::min( offset + length, m_size );
+        ::madvise(
+            const_cast< char * >( m_data ) + begin, end - begin, advice
+        );
+    }
+
+    void reportError ( const char * what, std::string const & path ) const
+    {
+        std::cerr
+            << "Error: " << what << " " << path << ": "
+            << std::strerror( errno ) << "\n"
+        ;
+    }
+
+    int m_fd = -1;
+    const char * m_data = nullptr;
+    std::size_t m_size = 0;
+};
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__MAPPED_FILE_H__
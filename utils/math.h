@@ -3,13 +3,16 @@
 
 /*----------------------------------------------------------------------------*/
 
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <utility>
 #include <vector>
 
 /*----------------------------------------------------------------------------*/
 
 // Helper: Calculate average from a vector of times.
-double calculateAverage ( std::vector< double > const & times )
+inline double calculateAverage ( std::vector< double > const & times )
 {
     double sum = 0.0;
     for ( double t : times )
@@ -18,7 +21,8 @@ double calculateAverage ( std::vector< double > const & times )
 }
 
 // Helper: Calculate standard deviation.
-double calculateStdDev ( std::vector< double>  const & times, double avg )
+inline double
+calculateStdDev ( std::vector< double > const & times, double avg )
 {
     double sumSq = 0.0;
     for (double t : times) {
@@ -30,4 +34,197 @@ double calculateStdDev ( std::vector< double>  const & times, double avg )
 
 /*----------------------------------------------------------------------------*/
 
+// p-th percentile (0..100) with linear interpolation between the closest
+// ranks; 0 for an empty vector.
+inline double calculatePercentile ( std::vector< double > times, double p )
+{
+    if ( times.empty() )
+        return 0.0;
+    std::sort( times.begin(), times.end() );
+    double rank = p / 100.0 * ( times.size() - 1 );
+    std::size_t lower = static_cast< std::size_t >( std::floor( rank ) );
+    std::size_t upper = std::min( lower + 1, times.size() - 1 );
+    double fraction = rank - lower;
+    return times[ lower ] + ( times[ upper ] - times[ lower ] ) * fraction;
+}
+
+inline double calculateMedian ( std::vector< double > const & times )
+{
+    return calculatePercentile( times, 50.0 );
+}
+
+// Median absolute deviation from the median.
+inline double calculateMad ( std::vector< double > const & times )
+{
+    double median = calculateMedian( times );
+    std::vector< double > deviations;
+    deviations.reserve( times.size() );
+    for ( double t : times )
+        deviations.push_back( std::abs( t - median ) );
+    return calculateMedian( deviations );
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Outlier rejection for timing samples.
+- Mad: drop samples more than 3 scaled MADs (1.4826 * MAD, the standard
+  deviation estimate for normal data) away from the median.
+- Iqr: drop samples outside [Q1 - 1.5 IQR, Q3 + 1.5 IQR] (Tukey's fences).
+If the spread is zero nothing is dropped.
+*/
+enum class OutlierFilter
+{
+        None
+    ,   Mad
+    ,   Iqr
+};
+
+inline std::vector< double > removeOutliers (
+    std::vector< double > const & times, OutlierFilter filter
+)
+{
+    double low = 0.0;
+    double high = 0.0;
+    switch ( filter )
+    {
+        case OutlierFilter::None:
+            return times;
+        case OutlierFilter::Mad:
+        {
+            double median = calculateMedian( times );
+            double spread = 3.0 * 1.4826 * calculateMad( times );
+            low = median - spread;
+            high = median + spread;
+            break;
+        }
+        case OutlierFilter::Iqr:
+        {
+            double q1 = calculatePercentile( times, 25.0 );
+            double q3 = calculatePercentile( times, 75.0 );
+            low = q1 - 1.5 * ( q3 - q1 );
+            high = q3 + 1.5 * ( q3 - q1 );
+            break;
+        }
+    }
+    if ( high <= low )
+        return times;
+
+    std::vector< double > kept;
+    kept.reserve( times.size() );
+    for ( double t : times )
+    {
+        if ( t >= low && t <= high )
+            kept.push_back( t );
+    }
+    return kept;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Summary of a set of timing samples. Mean, standard deviation and the
+confidence interval are computed after outlier rejection; the order
+statistics (median, percentiles, min, max) are robust already and use all
+samples, so the tail stays visible in p99.
+*/
+struct BenchmarkStats
+{
+    std::size_t samples = 0;
+    std::size_t outliers = 0;
+    double mean = 0.0;
+    double stdDev = 0.0;
+    // Half width of the 95% confidence interval of the mean.
+    double ciHalfWidth = 0.0;
+    double median = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+};
+
+inline BenchmarkStats computeBenchmarkStats (
+    std::vector< double > const & times,
+    OutlierFilter filter = OutlierFilter::Mad
+)
+{
+    BenchmarkStats stats;
+    stats.samples = times.size();
+    if ( times.empty() )
+        return stats;
+
+    std::vector< double > kept = removeOutliers( times, filter );
+    stats.outliers = times.size() - kept.size();
+    stats.mean = calculateAverage( kept );
+    stats.stdDev = calculateStdDev( kept, stats.mean );
+    stats.ciHalfWidth = 1.96 * stats.stdDev / std::sqrt( kept.size() );
+
+    stats.median = calculateMedian( times );
+    stats.p90 = calculatePercentile( times, 90.0 );
+    stats.p99 = calculatePercentile( times, 99.0 );
+    auto [ min, max ] = std::minmax_element( times.begin(), times.end() );
+    stats.min = *min;
+    stats.max = *max;
+    return stats;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Two-sided Mann-Whitney U test: the probability of two independent samples
+at least this far apart if both came from the same distribution. It compares
+ranks, not values, so a few outliers in either sample do not decide it.
+Uses the normal approximation with tie and continuity corrections, which is
+accurate from about 10 samples per side. Returns 1 when either sample is
+empty or all values are equal.
+*/
+inline double mannWhitneyPValue (
+    std::vector< double > const & a, std::vector< double > const & b
+)
+{
+    const std::size_t n1 = a.size();
+    const std::size_t n2 = b.size();
+    const std::size_t n = n1 + n2;
+    if ( !n1 || !n2 )
+        return 1.0;
+
+    // ( value, from a ) pairs; ties get the average of their ranks.
+    std::vector< std::pair< double, bool > > all;
+    all.reserve( n );
+    for ( double x : a )
+        all.emplace_back( x, true );
+    for ( double x : b )
+        all.emplace_back( x, false );
+    std::sort( all.begin(), all.end() );
+
+    double rankSumA = 0.0;
+    double tieTerm = 0.0;
+    for ( std::size_t i = 0; i < n; )
+    {
+        std::size_t j = i;
+        while ( j < n && all[ j ].first == all[ i ].first )
+            ++j;
+        const double rank = 0.5 * static_cast< double >( i + 1 + j );
+        const double ties = static_cast< double >( j - i );
+        tieTerm += ties * ties * ties - ties;
+        for ( std::size_t k = i; k < j; ++k )
+            rankSumA += all[ k ].second ? rank : 0.0;
+        i = j;
+    }
+
+    const double m1 = static_cast< double >( n1 );
+    const double m2 = static_cast< double >( n2 );
+    const double total = static_cast< double >( n );
+    const double u = rankSumA - m1 * ( m1 + 1 ) / 2;
+    const double variance = m1 * m2 / 12
+        * ( ( total + 1 ) - tieTerm / ( total * ( total - 1 ) ) );
+    if ( variance <= 0.0 )
+        return 1.0;
+    const double deviation =
+        std::max( std::abs( u - m1 * m2 / 2 ) - 0.5, 0.0 );
+    return std::erfc( deviation / std::sqrt( variance ) / std::sqrt( 2.0 ) );
+}
+
+/*----------------------------------------------------------------------------*/
+
 #endif // __UTILS__MATH_H__
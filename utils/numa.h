@@ -0,0 +1,314 @@
+#ifndef __UTILS__NUMA_H__
+#define __UTILS__NUMA_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined( __linux__ )
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Build with -DUSE_LIBNUMA -lnuma to place memory through libnuma instead of
+// the raw mbind system call.
+#if defined( USE_LIBNUMA )
+#include <numa.h>
+#include <numaif.h>
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+/*
+NUMA topology and page placement.
+
+The topology is read from /sys/devices/system/node on Linux. Everywhere
+else, and on Linux machines without NUMA support, the whole machine is one
+node holding every CPU, so code written against this header runs unchanged
+on a laptop. The memory functions then report failure and leave placement to
+the operating system.
+*/
+
+// Parse a kernel CPU/node list such as "0-3,8,10-11".
+inline std::vector< int > parseCpuList ( const std::string & list )
+{
+    std::vector< int > result;
+    std::stringstream stream( list );
+    std::string item;
+    while ( std::getline( stream, item, ',' ) )
+    {
+        if ( item.empty() || item == "\n" )
+            continue;
+        std::size_t dash = item.find( '-' );
+        int first = std::stoi( item.substr( 0, dash ) );
+        int last = dash == std::string::npos
+            ? first
+            : std::stoi( item.substr( dash + 1 ) );
+        for ( int cpu = first; cpu <= last; ++cpu )
+            result.push_back( cpu );
+    }
+    return result;
+}
+
+struct NumaTopology
+{
+    // CPUs of every node, restricted to the CPUs this process may run on.
+    // Nodes without usable CPUs are dropped.
+    std::vector< std::vector< int > > nodeCpus;
+    // Kernel node id of every entry of nodeCpus.
+    std::vector< int > nodeIds;
+
+    int numNodes () const { return static_cast< int >( nodeCpus.size() ); }
+
+    // Kernel node id the CPU belongs to, -1 if unknown.
+    int nodeOfCpu ( int cpu ) const
+    {
+        for ( int n = 0; n < numNodes(); ++n )
+        {
+            const auto & cpus = nodeCpus[ n ];
+            if ( std::find( cpus.begin(), cpus.end(), cpu ) != cpus.end() )
+                return nodeIds[ n ];
+        }
+        return -1;
+    }
+
+    // CPUs for workers 0, 1, 2, ...: dealt round-robin over the nodes, so
+    // every thread count uses all nodes as evenly as possible.
+    std::vector< int > workerCpus () const
+    {
+        std::vector< int > order;
+        for ( std::size_t i = 0;; ++i )
+        {
+            bool any = false;
+            for ( const auto & cpus : nodeCpus )
+            {
+                if ( i < cpus.size() )
+                {
+                    order.push_back( cpus[ i ] );
+                    any = true;
+                }
+            }
+            if ( !any )
+                return order;
+        }
+    }
+};
+
+inline std::vector< int > allowedCpus ()
+{
+    std::vector< int > cpus;
+#if defined( __linux__ )
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    if ( sched_getaffinity( 0, sizeof( set ), &set ) == 0 )
+    {
+        for ( int cpu = 0; cpu < CPU_SETSIZE; ++cpu )
+        {
+            if ( CPU_ISSET( cpu, &set ) )
+                cpus.push_back( cpu );
+        }
+    }
+#endif
+    if ( cpus.empty() )
+    {
+        unsigned count = std::max( 1u, std::thread::hardware_concurrency() );
+        for ( unsigned cpu = 0; cpu < count; ++cpu )
+            cpus.push_back( static_cast< int >( cpu ) );
+    }
+    return cpus;
+}
+
+inline NumaTopology detectNumaTopology ()
+{
+    const std::vector< int > allowed = allowedCpus();
+    NumaTopology topology;
+
+    const std::string root = "/sys/devices/system/node/";
+    std::ifstream online( root + "online" );
+    std::string nodes;
+    if ( online && std::getline( online, nodes ) )
+    {
+        for ( int node : parseCpuList( nodes ) )
+        {
+            std::ifstream file(
+                root + "node" + std::to_string( node ) + "/cpulist"
+            );
+            std::string list;
+            if ( !file || !std::getline( file, list ) )
+                continue;
+
+            std::vector< int > cpus;
+            for ( int cpu : parseCpuList( list ) )
+            {
+                if ( std::find( allowed.begin(), allowed.end(), cpu )
+                     != allowed.end() )
+                {
+                    cpus.push_back( cpu );
+                }
+            }
+            if ( cpus.empty() )
+                continue;
+            topology.nodeCpus.push_back( cpus );
+            topology.nodeIds.push_back( node );
+        }
+    }
+
+    if ( topology.nodeCpus.empty() )
+    {
+        topology.nodeCpus.push_back( allowed );
+        topology.nodeIds.push_back( 0 );
+    }
+    return topology;
+}
+
+// Detected once, on first use.
+inline NumaTopology const & numaTopology ()
+{
+    static const NumaTopology topology = detectNumaTopology();
+    return topology;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Memory policies for [data, data + bytes). The range is widened to whole
+pages, so a page shared with a neighbouring range gets whichever policy is set
+last. The policy is set with MPOL_MF_MOVE | MPOL_MF_STRICT: pages the heap
+already touched or reused are migrated to conform, and the call fails if one
+of them cannot be, so a successful call means the whole range is placed.
+Pages faulted in later follow the policy. Return false if the policy could
+not be applied.
+*/
+
+namespace numa_detail
+{
+
+#if defined( __linux__ )
+// Values of the kernel's MPOL_* constants (linux/mempolicy.h).
+constexpr int MPOL_BIND_MODE = 2;
+constexpr int MPOL_INTERLEAVE_MODE = 3;
+constexpr unsigned long MPOL_F_NODE_FLAG = 1ul << 0;
+constexpr unsigned long MPOL_F_ADDR_FLAG = 1ul << 1;
+constexpr unsigned MPOL_MF_STRICT_FLAG = 1u << 0;
+constexpr unsigned MPOL_MF_MOVE_FLAG = 1u << 1;
+#endif
+
+// Widen [data, data + bytes) to whole pages; both mbind and libnuma want a
+// page-aligned start address.
+struct PageRange
+{
+    void * begin;
+    std::size_t length;
+};
+
+inline PageRange pageRange ( void * data, std::size_t bytes )
+{
+#if defined( __linux__ )
+    const std::uintptr_t pageSize =
+        static_cast< std::uintptr_t >( ::sysconf( _SC_PAGESIZE ) );
+#else
+    const std::uintptr_t pageSize = 4096;
+#endif
+    std::uintptr_t end = reinterpret_cast< std::uintptr_t >( data ) + bytes;
+    std::uintptr_t begin =
+        reinterpret_cast< std::uintptr_t >( data ) / pageSize * pageSize;
+    return { reinterpret_cast< void * >( begin ), end - begin };
+}
+
+#if defined( __linux__ )
+
+inline bool setPolicy (
+    PageRange range, int mode, std::vector< int > const & nodes
+)
+{
+    constexpr std::size_t bitsPerWord = 8 * sizeof( unsigned long );
+    int maxNode = 0;
+    for ( int node : nodes )
+        maxNode = std::max( maxNode, node );
+    std::vector< unsigned long > mask( maxNode / bitsPerWord + 1, 0 );
+    for ( int node : nodes )
+        mask[ node / bitsPerWord ] |= 1ul << ( node % bitsPerWord );
+
+    const unsigned flags = MPOL_MF_MOVE_FLAG | MPOL_MF_STRICT_FLAG;
+#if defined( USE_LIBNUMA )
+    return ::mbind(
+        range.begin, range.length, mode, mask.data(),
+        mask.size() * bitsPerWord + 1, flags
+    ) == 0;
+#else
+    return ::syscall(
+        SYS_mbind, range.begin, range.length, mode, mask.data(),
+        mask.size() * bitsPerWord + 1, flags
+    ) == 0;
+#endif
+}
+#endif
+
+} // namespace numa_detail
+
+inline bool bindMemoryToNode ( void * data, std::size_t bytes, int node )
+{
+#if defined( __linux__ )
+#if defined( USE_LIBNUMA )
+    if ( numa_available() < 0 )
+        return false;
+#endif
+    return numa_detail::setPolicy(
+        numa_detail::pageRange( data, bytes ),
+        numa_detail::MPOL_BIND_MODE, { node }
+    );
+#else
+    (void)data; (void)bytes; (void)node;
+    return false;
+#endif
+}
+
+// Spread the pages round-robin over all NUMA nodes.
+inline bool interleaveMemory ( void * data, std::size_t bytes )
+{
+#if defined( __linux__ )
+#if defined( USE_LIBNUMA )
+    if ( numa_available() < 0 )
+        return false;
+#endif
+    return numa_detail::setPolicy(
+        numa_detail::pageRange( data, bytes ),
+        numa_detail::MPOL_INTERLEAVE_MODE, numaTopology().nodeIds
+    );
+#else
+    (void)data; (void)bytes;
+    return false;
+#endif
+}
+
+// Node holding the (already touched) page at address, -1 if unknown.
+inline int memoryNode ( const void * address )
+{
+#if defined( __linux__ )
+    int node = -1;
+    const unsigned long flags =
+        numa_detail::MPOL_F_NODE_FLAG | numa_detail::MPOL_F_ADDR_FLAG;
+    if ( ::syscall(
+            SYS_get_mempolicy, &node, nullptr, 0, address, flags
+         ) != 0 )
+    {
+        return -1;
+    }
+    return node;
+#else
+    (void)address;
+    return -1;
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__NUMA_H__
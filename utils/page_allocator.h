@@ -0,0 +1,534 @@
+#ifndef __UTILS__PAGE_ALLOCATOR_H__
+#define __UTILS__PAGE_ALLOCATOR_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <new>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined( __linux__ ) || defined( __APPLE__ )
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Allocation of benchmark data with control over the page size, so that TLB
+misses can be kept out of (or put into) a measurement.
+
+- PageMode::Default:     aligned operator new, base pages.
+- PageMode::Transparent: an anonymous mapping aligned to 2 MB and advised
+                         with MADV_HUGEPAGE, for transparent huge pages.
+- PageMode::Huge2M/1G:   MAP_HUGETLB with 2 MB or 1 GB pages, from the pool
+                         the administrator reserved (vm.nr_hugepages or
+                         hugepages= on the kernel command line).
+
+A MAP_HUGETLB request that fails, usually for lack of reserved pages, falls
+back to Transparent; elsewhere than Linux, every mode falls back to
+Default. Requests below HUGE_PAGE_MIN_BYTES always take the Default path,
+a huge page for them would mostly be waste. With prefault every page is
+written once at allocation, so no page fault lands in a timed region.
+
+pageOptions() is the selection of the run, read by the default-constructed
+PageAllocator and by the structures built on allocatePages; set it from the
+command line before allocating. pageStats() counts what was actually
+obtained, and pageDescription() sums it up for the outputs.
+*/
+
+enum class PageMode
+{
+        Default
+    ,   Transparent
+    ,   Huge2M
+    ,   Huge1G
+};
+
+constexpr int PAGE_MODE_COUNT = 4;
+
+constexpr std::size_t BASE_PAGE_SIZE = 4096;
+constexpr std::size_t HUGE_PAGE_2M = std::size_t{ 2 } << 20;
+constexpr std::size_t HUGE_PAGE_1G = std::size_t{ 1 } << 30;
+constexpr std::size_t HUGE_PAGE_MIN_BYTES = std::size_t{ 1 } << 20;
+
+inline const char * pageModeName ( PageMode mode )
+{
+    switch ( mode )
+    {
+        case PageMode::Default:         return "Default";
+        case PageMode::Transparent:     return "Transparent";
+        case PageMode::Huge2M:          return "Huge2M";
+        case PageMode::Huge1G:          return "Huge1G";
+    }
+    return "Unknown";
+}
+
+// Accepts default, thp, 2m and 1g.
+inline bool parsePageMode ( std::string const & name, PageMode & mode )
+{
+    if ( name == "default" )
+        mode = PageMode::Default;
+    else if ( name == "thp" )
+        mode = PageMode::Transparent;
+    else if ( name == "2m" )
+        mode = PageMode::Huge2M;
+    else if ( name == "1g" )
+        mode = PageMode::Huge1G;
+    else
+        return false;
+    return true;
+}
+
+// Accepts a power of two from sizeof( void * ) to BASE_PAGE_SIZE, in bytes.
+// Larger alignments would not hold on the mapped paths, which only promise
+// page alignment.
+inline bool parseAlignment (
+    std::string const & text, std::size_t & alignment
+)
+{
+    std::size_t value = 0;
+    try
+    {
+        std::size_t used = 0;
+        value = std::stoul( text, &used );
+        if ( used != text.size() )
+            return false;
+    }
+    catch ( std::exception const & )
+    {
+        return false;
+    }
+    if ( value < sizeof( void * ) || value > BASE_PAGE_SIZE
+        || ( value & ( value - 1 ) ) != 0 )
+        return false;
+    alignment = value;
+    return true;
+}
+
+struct PageOptions
+{
+    PageMode mode = PageMode::Default;
+    // Alignment of the Default path; mappings are always page aligned.
+    std::size_t alignment = CACHE_LINE_SIZE;
+    bool prefault = false;
+};
+
+inline bool operator == ( PageOptions const & a, PageOptions const & b )
+{
+    return a.mode == b.mode && a.alignment == b.alignment
+        && a.prefault == b.prefault;
+}
+
+// Selected for the whole run.
+inline PageOptions & pageOptions ()
+{
+    static PageOptions options;
+    return options;
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Bytes allocated so far by the backing each one got, the number of
+// MAP_HUGETLB requests that fell back, and the most bytes seen backed by
+// transparent huge pages (sampled when a mapping is prefaulted or released).
+struct PageStats
+{
+    std::atomic< std::size_t > bytes[ PAGE_MODE_COUNT ] = {};
+    std::atomic< std::size_t > fallbacks{ 0 };
+    std::atomic< std::size_t > peakTransparentBytes{ 0 };
+};
+
+inline PageStats & pageStats ()
+{
+    static PageStats stats;
+    return stats;
+}
+
+// Bytes of the process currently backed by transparent huge pages
+// (AnonHugePages of /proc/self/smaps_rollup), 0 where unknown.
+inline std::size_t transparentHugeBytes ()
+{
+#if defined( __linux__ )
+    std::ifstream in( "/proc/self/smaps_rollup" );
+    std::string key;
+    std::size_t kilobytes = 0;
+    std::string unit;
+    while ( in >> key )
+    {
+        if ( key == "AnonHugePages:" && in >> kilobytes )
+            return kilobytes * 1024;
+        std::getline( in, unit );
+    }
+#endif
+    return 0;
+}
+
+namespace page_detail
+{
+
+inline std::size_t pageSizeOf ( PageMode mode )
+{
+    switch ( mode )
+    {
+        case PageMode::Huge1G:      return HUGE_PAGE_1G;
+        case PageMode::Transparent:
+        case PageMode::Huge2M:      return HUGE_PAGE_2M;
+        default:                    return BASE_PAGE_SIZE;
+    }
+}
+
+inline std::size_t roundUp ( std::size_t bytes, std::size_t multiple )
+{
+    return ( bytes + multiple - 1 ) / multiple * multiple;
+}
+
+// Mapped length of a request: a whole number of pages of the mode.
+inline std::size_t mappedBytes ( std::size_t bytes, PageMode mode )
+{
+    return roundUp( std::max< std::size_t >( bytes, 1 ), pageSizeOf( mode ) );
+}
+
+inline bool usesMapping ( std::size_t bytes, PageOptions const & options )
+{
+#if defined( __linux__ )
+    return options.mode != PageMode::Default
+        && bytes >= HUGE_PAGE_MIN_BYTES;
+#else
+    (void)bytes;
+    (void)options;
+    return false;
+#endif
+}
+
+inline void record ( PageMode backing, std::size_t bytes )
+{
+    pageStats().bytes[ static_cast< int >( backing ) ].fetch_add(
+        bytes, std::memory_order_relaxed
+    );
+}
+
+#if defined( __linux__ )
+
+#if !defined( MAP_HUGE_SHIFT )
+#define MAP_HUGE_SHIFT 26
+#endif
+
+// MAP_HUGETLB mapping of `length` bytes, nullptr if the pool is too small.
+inline void * mapHugeTlb ( std::size_t length, PageMode mode )
+{
+#if defined( MAP_HUGETLB )
+    const int sizeFlag =
+        ( mode == PageMode::Huge1G ? 30 : 21 ) << MAP_HUGE_SHIFT;
+    void * p = ::mmap(
+        nullptr, length, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | sizeFlag, -1, 0
+    );
+    return p == MAP_FAILED ? nullptr : p;
+#else
+    (void)length;
+    (void)mode;
+    return nullptr;
+#endif
+}
+
+// Anonymous mapping of `length` bytes starting on a 2 MB boundary, advised
+// for transparent huge pages.
+inline void * mapTransparent ( std::size_t length )
+{
+    const std::size_t padded = length + HUGE_PAGE_2M;
+    void * raw = ::mmap(
+        nullptr, padded, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+    );
+    if ( raw == MAP_FAILED )
+        return nullptr;
+    char * begin = static_cast< char * >( raw );
+    char * aligned = reinterpret_cast< char * >( roundUp(
+        reinterpret_cast< std::uintptr_t >( begin ), HUGE_PAGE_2M
+    ) );
+    // Keep exactly [ aligned, aligned + length ).
+    if ( aligned > begin )
+        ::munmap( begin, aligned - begin );
+    char * end = aligned + length;
+    if ( begin + padded > end )
+        ::munmap( end, begin + padded - end );
+#if defined( MADV_HUGEPAGE )
+    ::madvise( aligned, length, MADV_HUGEPAGE );
+#endif
+    return aligned;
+}
+
+#endif // __linux__
+
+inline void samplePeakTransparent ()
+{
+    const std::size_t bytes = transparentHugeBytes();
+    std::atomic< std::size_t > & peak = pageStats().peakTransparentBytes;
+    std::size_t seen = peak.load( std::memory_order_relaxed );
+    while ( bytes > seen
+        && !peak.compare_exchange_weak( seen, bytes, std::memory_order_relaxed )
+    )
+    {
+    }
+}
+
+inline void touchPages ( void * data, std::size_t bytes )
+{
+    volatile char * p = static_cast< volatile char * >( data );
+    for ( std::size_t offset = 0; offset < bytes; offset += BASE_PAGE_SIZE )
+        p[ offset ] = 0;
+}
+
+} // namespace page_detail
+
+/*----------------------------------------------------------------------------*/
+
+// `bytes` bytes aligned to at least max( options.alignment, alignment ).
+// Throws std::bad_alloc like operator new. Release with deallocatePages and
+// the same size and options.
+inline void * allocatePages (
+    std::size_t bytes,
+    PageOptions const & options = pageOptions(),
+    std::size_t alignment = alignof( std::max_align_t )
+)
+{
+    void * p = nullptr;
+    PageMode backing = PageMode::Default;
+#if defined( __linux__ )
+    if ( page_detail::usesMapping( bytes, options ) )
+    {
+        const std::size_t length =
+            page_detail::mappedBytes( bytes, options.mode );
+        backing = options.mode;
+        if ( options.mode == PageMode::Huge2M
+            || options.mode == PageMode::Huge1G )
+        {
+            p = page_detail::mapHugeTlb( length, options.mode );
+            if ( !p )
+            {
+                pageStats().fallbacks.fetch_add(
+                    1, std::memory_order_relaxed
+                );
+                backing = PageMode::Transparent;
+            }
+        }
+        if ( !p )
+            p = page_detail::mapTransparent( length );
+        if ( !p )
+            throw std::bad_alloc();
+    }
+#endif
+    if ( !p )
+    {
+        if ( options.mode != PageMode::Default
+            && bytes >= HUGE_PAGE_MIN_BYTES )
+            pageStats().fallbacks.fetch_add( 1, std::memory_order_relaxed );
+        p = ::operator new(
+            std::max< std::size_t >( bytes, 1 ),
+            std::align_val_t( std::max( options.alignment, alignment ) )
+        );
+    }
+    page_detail::record( backing, bytes );
+    if ( options.prefault )
+        page_detail::touchPages( p, bytes );
+    if ( options.prefault && backing != PageMode::Default )
+        page_detail::samplePeakTransparent();
+    return p;
+}
+
+inline void deallocatePages (
+    void * p,
+    std::size_t bytes,
+    PageOptions const & options = pageOptions(),
+    std::size_t alignment = alignof( std::max_align_t )
+)
+{
+    if ( !p )
+        return;
+#if defined( __linux__ )
+    if ( page_detail::usesMapping( bytes, options ) )
+    {
+        page_detail::samplePeakTransparent();
+        ::munmap( p, page_detail::mappedBytes( bytes, options.mode ) );
+        return;
+    }
+#endif
+    ::operator delete(
+        p, std::align_val_t( std::max( options.alignment, alignment ) )
+    );
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Standard allocator over allocatePages. A default-constructed one takes the
+options of the run at construction and keeps them, so a container always
+frees with the options it allocated with.
+*/
+template < typename _T >
+class PageAllocator
+{
+
+public:
+
+    using value_type = _T;
+
+    PageAllocator () : m_options( pageOptions() ) {}
+
+    explicit PageAllocator ( PageOptions const & options )
+        :   m_options( options )
+    {
+    }
+
+    template < typename _U >
+    PageAllocator ( PageAllocator< _U > const & other )
+        :   m_options( other.options() )
+    {
+    }
+
+    _T * allocate ( std::size_t count )
+    {
+        return static_cast< _T * >(
+            allocatePages( count * sizeof( _T ), m_options, alignof( _T ) )
+        );
+    }
+
+    void deallocate ( _T * p, std::size_t count )
+    {
+        deallocatePages( p, count * sizeof( _T ), m_options, alignof( _T ) );
+    }
+
+    PageOptions const & options () const { return m_options; }
+
+    template < typename _U >
+    bool operator == ( PageAllocator< _U > const & other ) const
+    {
+        return m_options == other.options();
+    }
+
+    template < typename _U >
+    bool operator != ( PageAllocator< _U > const & other ) const
+    {
+        return !( m_options == other.options() );
+    }
+
+private:
+
+    PageOptions m_options;
+};
+
+template < typename _T >
+using PageVector = std::vector< _T, PageAllocator< _T > >;
+
+// Fixed-size, uninitialized array over allocatePages; cache-line aligned
+// with the default options. Movable, not copyable.
+template < typename _T >
+class PageArray
+{
+
+public:
+
+    explicit PageArray (
+        std::size_t count, PageOptions const & options = pageOptions()
+    )
+        :   m_bytes( std::max< std::size_t >( count, 1 ) * sizeof( _T ) )
+        ,   m_options( options )
+        ,   m_data( static_cast< _T * >(
+                allocatePages( m_bytes, m_options, alignof( _T ) )
+            ) )
+    {
+    }
+
+    PageArray ( PageArray && other ) noexcept
+        :   m_bytes( other.m_bytes )
+        ,   m_options( other.m_options )
+        ,   m_data( std::exchange( other.m_data, nullptr ) )
+    {
+    }
+
+    PageArray & operator = ( PageArray && other ) noexcept
+    {
+        std::swap( m_bytes, other.m_bytes );
+        std::swap( m_options, other.m_options );
+        std::swap( m_data, other.m_data );
+        return *this;
+    }
+
+    ~PageArray ()
+    {
+        deallocatePages( m_data, m_bytes, m_options, alignof( _T ) );
+    }
+
+    _T * data () { return m_data; }
+    const _T * data () const { return m_data; }
+
+    _T & operator [] ( std::size_t i ) { return m_data[ i ]; }
+    const _T & operator [] ( std::size_t i ) const { return m_data[ i ]; }
+
+private:
+
+    std::size_t m_bytes;
+    PageOptions m_options;
+    _T * m_data;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Pages of the run for the outputs: the selected mode, "+Prefault" when set,
+"+Align<bytes>" for an alignment other than the cache line, and the backing
+actually obtained in parentheses when a request fell back, e.g.
+"Huge2M+Align4096(Transparent)". Contains no commas.
+*/
+inline std::string pageDescription ()
+{
+    PageOptions const & options = pageOptions();
+    std::string description = pageModeName( options.mode );
+    if ( options.prefault )
+        description += "+Prefault";
+    if ( options.alignment != CACHE_LINE_SIZE )
+        description += "+Align" + std::to_string( options.alignment );
+    if ( pageStats().fallbacks.load( std::memory_order_relaxed ) )
+    {
+#if defined( __linux__ )
+        description += "(Transparent)";
+#else
+        description += "(Default)";
+#endif
+    }
+    return description;
+}
+
+inline void printPageStats ( std::ostream & out )
+{
+    out << "Pages: " << pageDescription();
+    for ( int m = 0; m < PAGE_MODE_COUNT; ++m )
+    {
+        const std::size_t bytes =
+            pageStats().bytes[ m ].load( std::memory_order_relaxed );
+        if ( bytes )
+        {
+            out << ", " << pageModeName( static_cast< PageMode >( m ) )
+                << " " << ( bytes >> 20 ) << " MB";
+        }
+    }
+    page_detail::samplePeakTransparent();
+    out << ", transparent huge pages peak "
+        << ( pageStats().peakTransparentBytes.load() >> 20 ) << " MB"
+        << std::endl;
+}
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__PAGE_ALLOCATOR_H__
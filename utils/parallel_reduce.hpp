@@ -0,0 +1,238 @@
+#ifndef __UTILS__PARALLEL_REDUCE_HPP__
+#define __UTILS__PARALLEL_REDUCE_HPP__
+
+/*----------------------------------------------------------------------------*/
+
+#include "cache.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Generalized parallel reduction over a contiguous array.
+
+[0, count) is split into one rounded-up chunk per thread, the same static
+split the parallel_chunks kernels use, and the chunks are run through an
+executor from utils/thread_pool.h. Every thread folds its chunk into a private
+accumulator (kept on its own cache line), then the partials are combined on
+the calling thread in thread order, so the result is deterministic for a
+given thread count.
+
+The operation is described either by three callables:
+- identity:                 initial accumulator of every chunk
+- accumulate( acc, value ): fold one element into acc
+- combine( into, from ):    merge a partial accumulator into another
+or by a reducer object bundling them (see CountIf, MinMax, ... below). All of
+them are template parameters, so every element type / operation pair gets its
+own fully inlined loop.
+*/
+template <
+        typename _ElementT
+    ,   typename _AccT
+    ,   typename _AccumulateT
+    ,   typename _CombineT
+    ,   typename _ExecutorT
+>
+_AccT parallelReduce (
+        _ExecutorT & executor
+    ,   int numThreads
+    ,   const _ElementT * data
+    ,   std::size_t count
+    ,   _AccT const & identity
+    ,   _AccumulateT accumulate
+    ,   _CombineT combine
+)
+{
+    struct alignas( CACHE_LINE_SIZE ) Partial
+    {
+        _AccT value;
+    };
+
+    std::vector< Partial > partials( numThreads, Partial{ identity } );
+
+    // Determine chunk size (round up)
+    std::size_t chunkSize = ( count + numThreads - 1 ) / numThreads;
+
+    executor.run( numThreads, [&] ( int t )
+    {
+        std::size_t begin = std::min( t * chunkSize, count );
+        std::size_t end = std::min( begin + chunkSize, count );
+        _AccT acc = identity;
+        for ( std::size_t i = begin; i < end; ++i )
+            accumulate( acc, data[ i ] );
+        partials[ t ].value = acc;
+    } );
+
+    _AccT result = identity;
+    for ( const auto & partial : partials )
+        combine( result, partial.value );
+    return result;
+}
+
+// Reducer form: the reducer provides Accumulator, identity(), accumulate()
+// and combine().
+template < typename _ElementT, typename _ReducerT, typename _ExecutorT >
+typename _ReducerT::Accumulator parallelReduce (
+        _ExecutorT & executor
+    ,   int numThreads
+    ,   const _ElementT * data
+    ,   std::size_t count
+    ,   _ReducerT const & reducer
+)
+{
+    using Accumulator = typename _ReducerT::Accumulator;
+    return parallelReduce(
+        executor, numThreads, data, count, reducer.identity(),
+        [ &reducer ] ( Accumulator & acc, _ElementT value )
+        {
+            reducer.accumulate( acc, value );
+        },
+        [ &reducer ] ( Accumulator & into, Accumulator const & from )
+        {
+            reducer.combine( into, from );
+        }
+    );
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Predicates.
+
+template < typename _ElementT >
+struct Above
+{
+    _ElementT threshold;
+
+    bool operator () ( _ElementT value ) const { return value > threshold; }
+};
+
+/*----------------------------------------------------------------------------*/
+
+// Reducers.
+
+// Wide accumulator for sums: double for floating point, 64-bit otherwise.
+template < typename _ElementT >
+using SumType = std::conditional_t<
+    std::is_floating_point_v< _ElementT >, double, long long
+>;
+
+// Number of elements matching a predicate.
+template < typename _PredT >
+struct CountIf
+{
+    using Accumulator = long long;
+
+    _PredT pred;
+
+    Accumulator identity () const { return 0; }
+
+    template < typename _ElementT >
+    void accumulate ( Accumulator & acc, _ElementT value ) const
+    {
+        acc += pred( value ) ? 1 : 0;
+    }
+
+    void combine ( Accumulator & into, Accumulator const & from ) const
+    {
+        into += from;
+    }
+};
+
+// Sum of the elements matching a predicate.
+template < typename _ElementT, typename _PredT >
+struct MaskedSum
+{
+    using Accumulator = SumType< _ElementT >;
+
+    _PredT pred;
+
+    Accumulator identity () const { return 0; }
+
+    void accumulate ( Accumulator & acc, _ElementT value ) const
+    {
+        acc += pred( value ) ? static_cast< Accumulator >( value ) : 0;
+    }
+
+    void combine ( Accumulator & into, Accumulator const & from ) const
+    {
+        into += from;
+    }
+};
+
+// Smallest and largest element.
+template < typename _ElementT >
+struct MinMax
+{
+    struct Accumulator
+    {
+        _ElementT min;
+        _ElementT max;
+
+        bool operator == ( Accumulator const & ) const = default;
+    };
+
+    Accumulator identity () const
+    {
+        return {
+            std::numeric_limits< _ElementT >::max(),
+            std::numeric_limits< _ElementT >::lowest()
+        };
+    }
+
+    void accumulate ( Accumulator & acc, _ElementT value ) const
+    {
+        acc.min = std::min( acc.min, value );
+        acc.max = std::max( acc.max, value );
+    }
+
+    void combine ( Accumulator & into, Accumulator const & from ) const
+    {
+        accumulate( into, from.min );
+        accumulate( into, from.max );
+    }
+};
+
+// Histogram of _Bins equal-width bins over [lo, hi); values outside the range
+// are clamped into the first or last bin. Build it with over( lo, hi ).
+template < typename _ElementT, std::size_t _Bins >
+struct Histogram
+{
+    using Accumulator = std::array< long long, _Bins >;
+
+    double lo;
+    double binsPerUnit;
+
+    static Histogram over ( _ElementT lo, _ElementT hi )
+    {
+        double range =
+            static_cast< double >( hi ) - static_cast< double >( lo );
+        return { static_cast< double >( lo ), _Bins / range };
+    }
+
+    Accumulator identity () const { return Accumulator{}; }
+
+    void accumulate ( Accumulator & acc, _ElementT value ) const
+    {
+        double position = ( static_cast< double >( value ) - lo ) * binsPerUnit;
+        std::size_t bin = position <= 0
+            ? 0
+            : std::min( static_cast< std::size_t >( position ), _Bins - 1 );
+        ++acc[ bin ];
+    }
+
+    void combine ( Accumulator & into, Accumulator const & from ) const
+    {
+        for ( std::size_t i = 0; i < _Bins; ++i )
+            into[ i ] += from[ i ];
+    }
+};
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__PARALLEL_REDUCE_HPP__
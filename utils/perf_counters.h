@@ -0,0 +1,527 @@
+#ifndef __UTILS__PERF_COUNTERS_H__
+#define __UTILS__PERF_COUNTERS_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined( __linux__ )
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Build with -DUSE_KPC on macOS to read the fixed counters through the
+// private kperf framework (needs root).
+#if defined( __APPLE__ ) && defined( USE_KPC )
+#include <dlfcn.h>
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Hardware performance counters of the calling thread.
+
+On Linux every event is a separate perf_event_open counter for user-space
+work of the calling thread. The counters are inherited: every thread created
+after the PerfCounters object is counted too, whether it is spawned inside
+the measured region or is a pool worker that lives across many of them, and
+enabling or disabling the counters applies to those threads as well. Threads
+that already existed when the counters were opened are not counted.
+Multiplexed counters are scaled by their enabled / running time.
+
+On macOS with USE_KPC only cycles and instructions (the fixed counters) are
+read, for the calling thread only. Everywhere else no event is available.
+Unavailable events are reported as -1.
+*/
+enum class PerfEvent
+{
+        Cycles
+    ,   Instructions
+    ,   L1DMisses
+    ,   LLCMisses
+    ,   BranchMisses
+    ,   Count
+};
+
+constexpr int PERF_EVENT_COUNT = static_cast< int >( PerfEvent::Count );
+
+inline const char * perfEventName ( PerfEvent event )
+{
+    switch ( event )
+    {
+        case PerfEvent::Cycles:         return "Cycles";
+        case PerfEvent::Instructions:   return "Instructions";
+        case PerfEvent::L1DMisses:      return "L1DMisses";
+        case PerfEvent::LLCMisses:      return "LLCMisses";
+        case PerfEvent::BranchMisses:   return "BranchMisses";
+        case PerfEvent::Count:          break;
+    }
+    return "Unknown";
+}
+
+inline PerfEvent perfEventAt ( int index )
+{
+    return static_cast< PerfEvent >( index );
+}
+
+// Counter values of one measurement (or the average of several).
+struct PerfCounts
+{
+    std::array< double, PERF_EVENT_COUNT > values;
+
+    PerfCounts () { values.fill( -1.0 ); }
+
+    double operator [] ( PerfEvent event ) const
+    {
+        return values[ static_cast< int >( event ) ];
+    }
+
+    double & operator [] ( PerfEvent event )
+    {
+        return values[ static_cast< int >( event ) ];
+    }
+};
+
+/*----------------------------------------------------------------------------*/
+
+#if defined( __APPLE__ ) && defined( USE_KPC )
+
+namespace kpc_detail
+{
+
+constexpr std::uint32_t KPC_CLASS_FIXED_MASK = 1u << 0;
+
+struct Api
+{
+    int ( *forceAllCtrsSet )( int ) = nullptr;
+    int ( *setCounting )( std::uint32_t ) = nullptr;
+    int ( *setThreadCounting )( std::uint32_t ) = nullptr;
+    int ( *getThreadCounters )( std::uint32_t, std::uint32_t, std::uint64_t * )
+        = nullptr;
+    bool loaded = false;
+};
+
+// The framework is loaded once; a failure (not root, no framework) leaves
+// every event unavailable.
+inline Api const & api ()
+{
+    static const Api instance = [] ()
+    {
+        Api result;
+        void * handle = dlopen(
+            "/System/Library/PrivateFrameworks/kperf.framework/kperf",
+            RTLD_LAZY
+        );
+        if ( !handle )
+            return result;
+
+        result.forceAllCtrsSet = reinterpret_cast< int (*)( int ) >(
+            dlsym( handle, "kpc_force_all_ctrs_set" )
+        );
+        result.setCounting = reinterpret_cast< int (*)( std::uint32_t ) >(
+            dlsym( handle, "kpc_set_counting" )
+        );
+        result.setThreadCounting =
+            reinterpret_cast< int (*)( std::uint32_t ) >(
+                dlsym( handle, "kpc_set_thread_counting" )
+            );
+        result.getThreadCounters = reinterpret_cast<
+            int (*)( std::uint32_t, std::uint32_t, std::uint64_t * )
+        >( dlsym( handle, "kpc_get_thread_counters" ) );
+
+        result.loaded = result.forceAllCtrsSet && result.setCounting
+            && result.setThreadCounting && result.getThreadCounters
+            && result.forceAllCtrsSet( 1 ) == 0
+            && result.setCounting( KPC_CLASS_FIXED_MASK ) == 0
+            && result.setThreadCounting( KPC_CLASS_FIXED_MASK ) == 0;
+        return result;
+    }();
+    return instance;
+}
+
+// Fixed counter layout: Apple cores count cycles then instructions, Intel
+// cores instructions, cycles and reference cycles.
+#if defined( __aarch64__ )
+constexpr int CYCLES_COUNTER = 0;
+constexpr int INSTRUCTIONS_COUNTER = 1;
+#else
+constexpr int CYCLES_COUNTER = 1;
+constexpr int INSTRUCTIONS_COUNTER = 0;
+#endif
+constexpr std::uint32_t FIXED_COUNTERS = 3;
+
+} // namespace kpc_detail
+
+#endif // __APPLE__ && USE_KPC
+
+/*----------------------------------------------------------------------------*/
+
+class PerfCounters
+{
+
+public:
+
+    PerfCounters ()
+    {
+#if defined( __linux__ )
+        m_fds.fill( -1 );
+        for ( int e = 0; e < PERF_EVENT_COUNT; ++e )
+            m_fds[ e ] = open( perfEventAt( e ) );
+#endif
+    }
+
+    PerfCounters ( PerfCounters const & ) = delete;
+    PerfCounters & operator = ( PerfCounters const & ) = delete;
+
+    ~PerfCounters ()
+    {
+#if defined( __linux__ )
+        for ( int fd : m_fds )
+        {
+            if ( fd >= 0 )
+                ::close( fd );
+        }
+#endif
+    }
+
+    bool isAvailable ( PerfEvent event ) const
+    {
+#if defined( __linux__ )
+        return m_fds[ static_cast< int >( event ) ] >= 0;
+#elif defined( __APPLE__ ) && defined( USE_KPC )
+        return kpc_detail::api().loaded
+            && ( event == PerfEvent::Cycles
+                 || event == PerfEvent::Instructions );
+#else
+        (void)event;
+        return false;
+#endif
+    }
+
+    // True if at least one event can be counted.
+    bool isAvailable () const
+    {
+        for ( int e = 0; e < PERF_EVENT_COUNT; ++e )
+        {
+            if ( isAvailable( perfEventAt( e ) ) )
+                return true;
+        }
+        return false;
+    }
+
+    void start ()
+    {
+#if defined( __linux__ )
+        // Counts of exited child threads are kept apart from the counter and
+        // survive a reset, so measurements are deltas of the running totals.
+        for ( int e = 0; e < PERF_EVENT_COUNT; ++e )
+            readCounter( m_fds[ e ], m_start[ e ] );
+        for ( int fd : m_fds )
+        {
+            if ( fd >= 0 )
+                ::ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 );
+        }
+#elif defined( __APPLE__ ) && defined( USE_KPC )
+        readFixed( m_startFixed );
+#endif
+    }
+
+    // Counts since start().
+    PerfCounts stop ()
+    {
+        PerfCounts counts;
+#if defined( __linux__ )
+        for ( int fd : m_fds )
+        {
+            if ( fd >= 0 )
+                ::ioctl( fd, PERF_EVENT_IOC_DISABLE, 0 );
+        }
+        for ( int e = 0; e < PERF_EVENT_COUNT; ++e )
+        {
+            Reading end;
+            if ( !readCounter( m_fds[ e ], end ) )
+                continue;
+            const Reading & begin = m_start[ e ];
+            double running =
+                static_cast< double >( end.running - begin.running );
+            if ( running <= 0.0 )
+                continue;
+            counts.values[ e ] =
+                static_cast< double >( end.value - begin.value )
+                * static_cast< double >( end.enabled - begin.enabled )
+                / running;
+        }
+#elif defined( __APPLE__ ) && defined( USE_KPC )
+        std::uint64_t end[ kpc_detail::FIXED_COUNTERS ];
+        if ( readFixed( end ) )
+        {
+            using namespace kpc_detail;
+            counts[ PerfEvent::Cycles ] = static_cast< double >(
+                end[ CYCLES_COUNTER ] - m_startFixed[ CYCLES_COUNTER ]
+            );
+            counts[ PerfEvent::Instructions ] = static_cast< double >(
+                end[ INSTRUCTIONS_COUNTER ]
+                - m_startFixed[ INSTRUCTIONS_COUNTER ]
+            );
+        }
+#endif
+        return counts;
+    }
+
+private:
+
+#if defined( __linux__ )
+    // Layout of a read() with the TOTAL_TIME_ENABLED / RUNNING read format.
+    struct Reading
+    {
+        std::uint64_t value = 0;
+        std::uint64_t enabled = 0;
+        std::uint64_t running = 0;
+    };
+
+    static bool readCounter ( int fd, Reading & reading )
+    {
+        return fd >= 0
+            && ::read( fd, &reading, sizeof( reading ) )
+                == static_cast< ssize_t >( sizeof( reading ) );
+    }
+
+    static int open ( PerfEvent event )
+    {
+        perf_event_attr attr;
+        std::memset( &attr, 0, sizeof( attr ) );
+        attr.size = sizeof( attr );
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format =
+            PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        constexpr std::uint64_t readMiss =
+            ( PERF_COUNT_HW_CACHE_OP_READ << 8 )
+            | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 );
+        switch ( event )
+        {
+            case PerfEvent::Cycles:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case PerfEvent::Instructions:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case PerfEvent::L1DMisses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D | readMiss;
+                break;
+            case PerfEvent::LLCMisses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_LL | readMiss;
+                break;
+            case PerfEvent::BranchMisses:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+            case PerfEvent::Count:
+                return -1;
+        }
+        return static_cast< int >(
+            ::syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 )
+        );
+    }
+
+    std::array< int, PERF_EVENT_COUNT > m_fds;
+    std::array< Reading, PERF_EVENT_COUNT > m_start;
+#elif defined( __APPLE__ ) && defined( USE_KPC )
+    static bool readFixed ( std::uint64_t * counters )
+    {
+        kpc_detail::Api const & kpc = kpc_detail::api();
+        return kpc.loaded && kpc.getThreadCounters(
+            0, kpc_detail::FIXED_COUNTERS, counters
+        ) == 0;
+    }
+
+    std::uint64_t m_startFixed[ kpc_detail::FIXED_COUNTERS ] = {};
+#endif
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Collects the counters of every PerfScope opened on this thread while the
+recorder is alive. The benchmark loops (utils/benchmark.hpp and the suites
+built on them) open a PerfScope around every timed call, so a caller gets
+per-iteration counters without changing any loop's signature:
+
+    PerfRecorder recorder;
+    auto times = runBenchmark< std::micro >( 1, 8, 1, iterations, func );
+    auto counts = recorder.groupAverages( iterations ); // one per parameter
+
+Recorders nest: the innermost one receives the samples.
+*/
+class PerfRecorder
+{
+
+public:
+
+    PerfRecorder ()
+        :   m_previous( active() )
+    {
+        active() = this;
+    }
+
+    PerfRecorder ( PerfRecorder const & ) = delete;
+    PerfRecorder & operator = ( PerfRecorder const & ) = delete;
+
+    ~PerfRecorder ()
+    {
+        active() = m_previous;
+    }
+
+    // Recorder of the calling thread, nullptr if none.
+    static PerfRecorder *& active ()
+    {
+        thread_local PerfRecorder * recorder = nullptr;
+        return recorder;
+    }
+
+    PerfCounters & counters () { return m_counters; }
+    PerfCounters const & counters () const { return m_counters; }
+
+    void add ( PerfCounts const & counts ) { m_samples.push_back( counts ); }
+
+    std::vector< PerfCounts > const & samples () const { return m_samples; }
+
+    void clear () { m_samples.clear(); }
+
+    // Average every consecutive group of groupSize samples, e.g. the
+    // iterations of one parameter value.
+    std::vector< PerfCounts > groupAverages ( std::size_t groupSize ) const
+    {
+        std::vector< PerfCounts > averages;
+        if ( groupSize == 0 )
+            return averages;
+        for ( std::size_t first = 0; first < m_samples.size();
+              first += groupSize )
+        {
+            std::size_t last = std::min( first + groupSize, m_samples.size() );
+            PerfCounts average;
+            for ( int e = 0; e < PERF_EVENT_COUNT; ++e )
+            {
+                double sum = 0.0;
+                bool valid = true;
+                for ( std::size_t i = first; i < last; ++i )
+                {
+                    valid &= m_samples[ i ].values[ e ] >= 0.0;
+                    sum += m_samples[ i ].values[ e ];
+                }
+                if ( valid )
+                    average.values[ e ] = sum / ( last - first );
+            }
+            averages.push_back( average );
+        }
+        return averages;
+    }
+
+private:
+
+    PerfRecorder * m_previous;
+    PerfCounters m_counters;
+    std::vector< PerfCounts > m_samples;
+};
+
+/*
+Counts from construction to stop() (or destruction) into the active recorder
+of the calling thread; does nothing without one. Open it before the Timer and
+stop it after timer.stop(), so the counter syscalls stay out of the timing.
+*/
+class PerfScope
+{
+
+public:
+
+    PerfScope ()
+        :   m_recorder( PerfRecorder::active() )
+    {
+        if ( m_recorder )
+            m_recorder->counters().start();
+    }
+
+    PerfScope ( PerfScope const & ) = delete;
+    PerfScope & operator = ( PerfScope const & ) = delete;
+
+    ~PerfScope () { stop(); }
+
+    void stop ()
+    {
+        if ( !m_recorder )
+            return;
+        m_recorder->add( m_recorder->counters().stop() );
+        m_recorder = nullptr;
+    }
+
+private:
+
+    PerfRecorder * m_recorder;
+};
+
+/*----------------------------------------------------------------------------*/
+
+// Print the available counters of `counts` on one line, plus the IPC when
+// both cycles and instructions were counted.
+inline void printPerfCounts (
+    std::ostream & out,
+    std::string const & label,
+    PerfCounts const & counts
+)
+{
+    out << label << " Counters:";
+    bool any = false;
+    for ( int e = 0; e < PERF_EVENT_COUNT; ++e )
+    {
+        if ( counts.values[ e ] < 0.0 )
+            continue;
+        out << ( any ? ", " : " " )
+            << perfEventName( perfEventAt( e ) ) << ": " << counts.values[ e ];
+        any = true;
+    }
+    double cycles = counts[ PerfEvent::Cycles ];
+    double instructions = counts[ PerfEvent::Instructions ];
+    if ( cycles > 0.0 && instructions >= 0.0 )
+        out << ", IPC: " << instructions / cycles;
+    if ( !any )
+        out << " unavailable";
+    out << std::endl;
+}
+
+/*
+Print the counters of every parameter value, in the layout of
+printBenchmarkStatsList (utils/benchmark.hpp).
+*/
+inline void printPerfCountsList (
+    std::ostream & out,
+    std::string const & label,
+    std::vector< PerfCounts > const & counts
+)
+{
+    out << label << " Counter Results:" << std::endl;
+    for ( std::size_t i = 0; i < counts.size(); ++i )
+    {
+        out << "Parameter value index " << i << ":";
+        printPerfCounts( out, "", counts[ i ] );
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__PERF_COUNTERS_H__
@@ -0,0 +1,200 @@
+#ifndef __UTILS__SYSTEM_INFO_H__
+#define __UTILS__SYSTEM_INFO_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "cache.h"
+
+#include <cctype>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+
+#if defined( __APPLE__ )
+#include <sys/sysctl.h>
+#include <sys/types.h>
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Description of the machine and the build a result was measured with, written
+next to the results so that two runs can be told apart. Read from
+/proc/cpuinfo on Linux and sysctl on macOS; what cannot be read stays empty
+or zero. The build flags are those passed as -DBENCHMARK_FLAGS="..." when
+given, otherwise the ones the predefined macros reveal.
+*/
+
+struct SystemInfo
+{
+    std::string cpuModel;
+    unsigned logicalCores = 0;
+    unsigned physicalCores = 0;
+    CacheSizes caches;
+    std::string os;
+    std::string arch;
+    std::string compiler;
+    std::string flags;
+};
+
+namespace system_info_detail
+{
+
+#if defined( __APPLE__ )
+inline std::string sysctlString ( const char * name )
+{
+    std::size_t length = 0;
+    if ( sysctlbyname( name, nullptr, &length, nullptr, 0 ) != 0 || !length )
+        return "";
+    std::string value( length, '\0' );
+    if ( sysctlbyname( name, value.data(), &length, nullptr, 0 ) != 0 )
+        return "";
+    value.resize( value.find( '\0' ) );
+    return value;
+}
+#endif
+
+// "model name" of the first processor, and the number of distinct
+// ( physical id, core id ) pairs.
+inline void readCpuInfo ( SystemInfo & info )
+{
+#if defined( __linux__ )
+    std::ifstream in( "/proc/cpuinfo" );
+    std::set< std::pair< std::string, std::string > > cores;
+    std::string line;
+    std::string physicalId;
+    auto value = [ & ] () { return line.substr( line.find( ':' ) + 2 ); };
+    while ( std::getline( in, line ) )
+    {
+        if ( line.find( ':' ) == std::string::npos
+            || line.find( ':' ) + 2 > line.size() )
+            continue;
+        if ( line.rfind( "model name", 0 ) == 0 && info.cpuModel.empty() )
+            info.cpuModel = value();
+        // AArch64 kernels have no model name.
+        else if ( line.rfind( "CPU part", 0 ) == 0 && info.cpuModel.empty() )
+            info.cpuModel = "ARM part " + value();
+        else if ( line.rfind( "physical id", 0 ) == 0 )
+            physicalId = value();
+        else if ( line.rfind( "core id", 0 ) == 0 )
+            cores.insert( { physicalId, value() } );
+    }
+    info.physicalCores = static_cast< unsigned >( cores.size() );
+#elif defined( __APPLE__ )
+    info.cpuModel = sysctlString( "machdep.cpu.brand_string" );
+    info.physicalCores =
+        static_cast< unsigned >( cache_detail::sysctlSize( "hw.physicalcpu" ) );
+#else
+    (void)info;
+#endif
+}
+
+inline std::string compilerName ()
+{
+#if defined( __clang__ )
+    return "clang " __clang_version__;
+#elif defined( __GNUC__ )
+    return "gcc " __VERSION__;
+#elif defined( _MSC_VER )
+    return "msvc " + std::to_string( _MSC_VER );
+#else
+    return "unknown";
+#endif
+}
+
+inline std::string buildFlags ()
+{
+#if defined( BENCHMARK_FLAGS )
+    return BENCHMARK_FLAGS;
+#else
+    std::string flags = "-std=c++" + std::to_string( __cplusplus / 100 % 100 );
+#if defined( __OPTIMIZE__ )
+    flags += " optimized";
+#else
+    flags += " unoptimized";
+#endif
+#if defined( NDEBUG )
+    flags += " -DNDEBUG";
+#endif
+#if defined( __AVX512F__ )
+    flags += " avx512f";
+#endif
+#if defined( __AVX2__ )
+    flags += " avx2";
+#endif
+#if defined( __ARM_NEON )
+    flags += " neon";
+#endif
+    return flags;
+#endif
+}
+
+} // namespace system_info_detail
+
+/*----------------------------------------------------------------------------*/
+
+inline SystemInfo detectSystemInfo ()
+{
+    SystemInfo info;
+    system_info_detail::readCpuInfo( info );
+    info.logicalCores = std::thread::hardware_concurrency();
+    if ( !info.physicalCores )
+        info.physicalCores = info.logicalCores;
+    info.caches = cacheSizes();
+#if defined( __APPLE__ )
+    info.os = "MacOs";
+#elif defined( __linux__ )
+    info.os = "Linux";
+#elif defined( _WIN32 )
+    info.os = "Windows";
+#else
+    info.os = "Unknown";
+#endif
+#if defined( __x86_64__ ) || defined( _M_X64 )
+    info.arch = "x86_64";
+#elif defined( __aarch64__ ) || defined( _M_ARM64 )
+    info.arch = "arm64";
+#else
+    info.arch = "unknown";
+#endif
+    info.compiler = system_info_detail::compilerName();
+    info.flags = system_info_detail::buildFlags();
+    return info;
+}
+
+// Detected once, on first use.
+inline SystemInfo const & systemInfo ()
+{
+    static const SystemInfo info = detectSystemInfo();
+    return info;
+}
+
+// Short tag for file names: the OS and the CPU model without vendor words,
+// trademarks and clock speed, e.g. "MacOsM1" or "LinuxXeonPlatinum8375C".
+inline std::string machineName ()
+{
+    SystemInfo const & info = systemInfo();
+    std::string model = info.cpuModel.substr( 0, info.cpuModel.find( '@' ) );
+    for ( const char * noise : {
+        "(R)", "(r)", "(TM)", "(tm)", "Apple", "Intel", "AMD", "CPU",
+        "Processor"
+    } )
+    {
+        std::size_t at;
+        while ( ( at = model.find( noise ) ) != std::string::npos )
+            model.erase( at, std::string( noise ).size() );
+    }
+    std::string name = info.os;
+    for ( char c : model )
+    {
+        if ( std::isalnum( static_cast< unsigned char >( c ) ) )
+            name += c;
+    }
+    return name == info.os ? name + info.arch : name;
+}
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__SYSTEM_INFO_H__
@@ -0,0 +1,298 @@
+#ifndef __UTILS__THREAD_POOL_H__
+#define __UTILS__THREAD_POOL_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined( __linux__ )
+#include <pthread.h>
+#include <sched.h>
+#elif defined( __APPLE__ )
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#include <pthread.h>
+#endif
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+// Hint to the CPU that we are in a spin-wait loop.
+inline void cpuRelax ()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    _mm_pause();
+#elif defined( __aarch64__ )
+    asm volatile( "yield" );
+#endif
+}
+
+/*
+Pin the calling thread to one logical CPU.
+On Linux this is a hard affinity mask. macOS has no hard pinning, so the CPU
+index is passed as an affinity tag: threads with different tags are spread
+over different cores where possible.
+Returns false if the request was rejected.
+*/
+inline bool pinCurrentThread ( int cpu )
+{
+#if defined( __linux__ )
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    CPU_SET( cpu, &set );
+    return pthread_setaffinity_np( pthread_self(), sizeof( set ), &set ) == 0;
+#elif defined( __APPLE__ )
+    thread_affinity_policy_data_t policy = { cpu + 1 };
+    return thread_policy_set(
+        pthread_mach_thread_np( pthread_self() ), THREAD_AFFINITY_POLICY,
+        reinterpret_cast< thread_policy_t >( &policy ),
+        THREAD_AFFINITY_POLICY_COUNT
+    ) == KERN_SUCCESS;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Executors run `numTasks` tasks, calling func( t ) for t in [0, numTasks) on
+`numTasks` threads, and return once all of them are done. The counting
+kernels are written against this interface so the cost of getting threads
+running can be measured separately from the work itself.
+*/
+
+// Spawns and joins a fresh std::thread per task on every call.
+// Given a CPU list, the thread of task t first pins itself to
+// cpus[ t % cpus.size() ].
+class SpawnExecutor
+{
+
+public:
+
+    static const char * name () { return "Spawn"; }
+
+    SpawnExecutor () = default;
+
+    explicit SpawnExecutor ( std::vector< int > cpus )
+        :   m_cpus( std::move( cpus ) )
+    {
+    }
+
+    template < typename _FuncT >
+    void run ( int numTasks, _FuncT && func )
+    {
+        std::vector< std::thread > threads;
+        threads.reserve( numTasks );
+        for ( int t = 0; t < numTasks; ++t )
+        {
+            threads.emplace_back( [ this, &func, t ] ()
+            {
+                if ( !m_cpus.empty() )
+                    pinCurrentThread( m_cpus[ t % m_cpus.size() ] );
+                func( t );
+            } );
+        }
+        for ( auto & th : threads )
+        {
+            th.join();
+        }
+    }
+
+private:
+
+    std::vector< int > m_cpus;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Persistent worker pool. Task t of a run always executes on worker t, so with
+pinning enabled a task index maps to a fixed CPU across calls.
+
+Idle workers spin briefly on the epoch word before blocking on a condition
+variable, so back-to-back runs do not pay a full wakeup each time. Spinning
+is disabled when the pool plus the calling thread oversubscribe the CPUs,
+where it would only steal time from the workers doing real work. The epoch
+packs a run counter with the task count of that run, so a worker that wakes up
+late never mixes one run's task count with another run's job.
+*/
+class ThreadPool
+{
+
+public:
+
+    static const char * name () { return "Pool"; }
+
+    // With pinning, worker id runs on CPU id % hardware_concurrency().
+    explicit ThreadPool ( int numThreads, bool pinThreads = true )
+        :   ThreadPool(
+                numThreads, pinThreads ? allCpus() : std::vector< int >{}
+            )
+    {
+    }
+
+    // Worker id is pinned to cpus[ id % cpus.size() ]; an empty list leaves
+    // the workers unpinned.
+    ThreadPool ( int numThreads, std::vector< int > const & cpus )
+    {
+        unsigned numCpus = std::max( 1u, std::thread::hardware_concurrency() );
+        m_spinLimit =
+            static_cast< unsigned >( numThreads ) < numCpus ? SPIN_LIMIT : 0;
+        m_workers.reserve( numThreads );
+        for ( int id = 0; id < numThreads; ++id )
+        {
+            int cpu = cpus.empty() ? -1 : cpus[ id % cpus.size() ];
+            m_workers.emplace_back(
+                [ this, id, cpu ] () { workerLoop( id, cpu ); }
+            );
+        }
+    }
+
+    ThreadPool ( ThreadPool const & ) = delete;
+    ThreadPool & operator = ( ThreadPool const & ) = delete;
+
+    ~ThreadPool ()
+    {
+        publish( STOP_TASKS );
+        for ( auto & worker : m_workers )
+        {
+            worker.join();
+        }
+    }
+
+    int size () const { return static_cast< int >( m_workers.size() ); }
+
+    // numTasks must not exceed size(). Not reentrant: one run at a time.
+    template < typename _FuncT >
+    void run ( int numTasks, _FuncT && func )
+    {
+        if ( numTasks <= 0 )
+            return;
+
+        using FuncType = std::remove_reference_t< _FuncT >;
+        m_context = const_cast< void * >(
+            static_cast< const void * >( std::addressof( func ) )
+        );
+        m_invoke = [] ( void * context, int t )
+        {
+            ( *static_cast< FuncType * >( context ) )( t );
+        };
+        m_remaining.store( numTasks, std::memory_order_relaxed );
+        publish( static_cast< std::uint64_t >( numTasks ) );
+
+        for ( int spin = 0; spin < m_spinLimit; ++spin )
+        {
+            if ( m_remaining.load( std::memory_order_acquire ) == 0 )
+                return;
+            cpuRelax();
+        }
+        std::unique_lock< std::mutex > lock( m_mutex );
+        m_done.wait( lock, [ this ] () {
+            return m_remaining.load( std::memory_order_acquire ) == 0;
+        } );
+    }
+
+private:
+
+    static constexpr int SPIN_LIMIT = 1 << 12;
+
+    static std::vector< int > allCpus ()
+    {
+        unsigned numCpus = std::max( 1u, std::thread::hardware_concurrency() );
+        std::vector< int > cpus( numCpus );
+        for ( unsigned cpu = 0; cpu < numCpus; ++cpu )
+            cpus[ cpu ] = static_cast< int >( cpu );
+        return cpus;
+    }
+
+    // Low bits of the epoch hold the task count of the current run.
+    static constexpr int TASK_BITS = 16;
+    static constexpr std::uint64_t TASK_MASK = ( 1u << TASK_BITS ) - 1;
+    static constexpr std::uint64_t STOP_TASKS = TASK_MASK;
+
+    // Start a new epoch with the given task count and wake the workers.
+    void publish ( std::uint64_t numTasks )
+    {
+        {
+            std::lock_guard< std::mutex > lock( m_mutex );
+            std::uint64_t counter =
+                ( m_epoch.load( std::memory_order_relaxed ) >> TASK_BITS ) + 1;
+            m_epoch.store(
+                ( counter << TASK_BITS ) | numTasks, std::memory_order_release
+            );
+        }
+        m_wakeup.notify_all();
+    }
+
+    void workerLoop ( int id, int cpu )
+    {
+        if ( cpu >= 0 )
+            pinCurrentThread( cpu );
+
+        std::uint64_t seen = 0;
+        for ( ;; )
+        {
+            seen = waitForEpoch( seen );
+            std::uint64_t numTasks = seen & TASK_MASK;
+            if ( numTasks == STOP_TASKS )
+                return;
+            if ( static_cast< std::uint64_t >( id ) >= numTasks )
+                continue;
+
+            m_invoke( m_context, id );
+
+            if ( m_remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+            {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                m_done.notify_one();
+            }
+        }
+    }
+
+    std::uint64_t waitForEpoch ( std::uint64_t seen )
+    {
+        for ( int spin = 0; spin < m_spinLimit; ++spin )
+        {
+            std::uint64_t current = m_epoch.load( std::memory_order_acquire );
+            if ( current != seen )
+                return current;
+            cpuRelax();
+        }
+        std::unique_lock< std::mutex > lock( m_mutex );
+        m_wakeup.wait( lock, [ this, seen ] () {
+            return m_epoch.load( std::memory_order_acquire ) != seen;
+        } );
+        return m_epoch.load( std::memory_order_acquire );
+    }
+
+    std::vector< std::thread > m_workers;
+    int m_spinLimit = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_done;
+
+    // Written by run() before the epoch is published.
+    void * m_context = nullptr;
+    void ( *m_invoke )( void *, int ) = nullptr;
+
+    std::atomic< std::uint64_t > m_epoch{ 0 };
+    std::atomic< int > m_remaining{ 0 };
+};
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__THREAD_POOL_H__
@@ -0,0 +1,313 @@
+#ifndef __UTILS__TRACE_H__
+#define __UTILS__TRACE_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "timer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Scoped trace zones. A TraceZone records its begin and end on the cycle
+counter of TscTimer, into a ring buffer owned by the calling thread. Only the
+owner writes its buffer: an event costs two counter reads and a release
+store, no lock. The buffers are written out as Chrome trace JSON, which
+chrome://tracing and the Perfetto UI (ui.perfetto.dev) both open, one row
+per buffer.
+
+Nothing is recorded until enableTracing( path ) is called; it also writes
+the trace to `path` at exit. A disabled zone costs one relaxed load.
+
+A buffer holds the last TRACE_BUFFER_EVENTS events of its thread; older ones
+are overwritten. When a thread exits its buffer goes back to a free list and
+the next new thread reuses it, so the threads spawned afresh on every call
+share a few rows instead of adding one each. Write the trace while the traced
+threads are idle. Zone names must be string literals or otherwise outlive the
+trace.
+*/
+
+constexpr std::size_t TRACE_BUFFER_EVENTS = std::size_t{ 1 } << 14;
+
+// Value of a zone that has none.
+constexpr std::int64_t TRACE_NO_VALUE =
+    std::numeric_limits< std::int64_t >::min();
+
+namespace trace_detail
+{
+
+struct TraceEvent
+{
+    const char * name;
+    std::int64_t value;
+    std::uint64_t begin;
+    std::uint64_t end;
+};
+
+class TraceBuffer
+{
+
+public:
+
+    explicit TraceBuffer ( int id )
+        :   m_id( id )
+        ,   m_name( "Thread " + std::to_string( id ) )
+        ,   m_events( new TraceEvent[ TRACE_BUFFER_EVENTS ] )
+    {
+    }
+
+    void record ( TraceEvent const & event )
+    {
+        const std::uint64_t head = m_head.load( std::memory_order_relaxed );
+        m_events[ head % TRACE_BUFFER_EVENTS ] = event;
+        m_head.store( head + 1, std::memory_order_release );
+    }
+
+    // Retained events, oldest first.
+    template < typename _FuncT >
+    void forEach ( _FuncT func ) const
+    {
+        const std::uint64_t head = m_head.load( std::memory_order_acquire );
+        const std::uint64_t first =
+            head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+        for ( std::uint64_t i = first; i < head; ++i )
+            func( m_events[ i % TRACE_BUFFER_EVENTS ] );
+    }
+
+    int id () const { return m_id; }
+
+    std::string const & name () const { return m_name; }
+    void setName ( std::string name ) { m_name = std::move( name ); }
+
+private:
+
+    int m_id;
+    std::string m_name;
+    std::unique_ptr< TraceEvent[] > m_events;
+    std::atomic< std::uint64_t > m_head{ 0 };
+};
+
+// All buffers ever handed out, and the ones of exited threads.
+struct TraceRegistry
+{
+    std::mutex mutex;
+    std::vector< std::unique_ptr< TraceBuffer > > buffers;
+    std::vector< TraceBuffer * > free;
+    std::atomic< bool > enabled{ false };
+    std::uint64_t epoch = 0;
+    std::string path;
+
+    TraceBuffer * acquire ()
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        if ( !free.empty() )
+        {
+            TraceBuffer * buffer = free.back();
+            free.pop_back();
+            return buffer;
+        }
+        buffers.push_back( std::make_unique< TraceBuffer >(
+            static_cast< int >( buffers.size() )
+        ) );
+        return buffers.back().get();
+    }
+
+    void release ( TraceBuffer * buffer )
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        free.push_back( buffer );
+    }
+};
+
+inline TraceRegistry & registry ()
+{
+    static TraceRegistry instance;
+    return instance;
+}
+
+// Buffer of the calling thread, taken on its first event.
+class ThreadTraceBuffer
+{
+
+public:
+
+    ~ThreadTraceBuffer ()
+    {
+        if ( m_buffer )
+            registry().release( m_buffer );
+    }
+
+    TraceBuffer & get ()
+    {
+        if ( !m_buffer )
+            m_buffer = registry().acquire();
+        return *m_buffer;
+    }
+
+private:
+
+    TraceBuffer * m_buffer = nullptr;
+};
+
+inline TraceBuffer & threadBuffer ()
+{
+    thread_local ThreadTraceBuffer buffer;
+    return buffer.get();
+}
+
+inline void writeJsonString ( std::ostream & out, const char * text )
+{
+    out << '"';
+    for ( ; *text; ++text )
+    {
+        if ( *text == '"' || *text == '\\' )
+            out << '\\';
+        out << *text;
+    }
+    out << '"';
+}
+
+} // namespace trace_detail
+
+/*----------------------------------------------------------------------------*/
+
+inline bool tracingEnabled ()
+{
+    return trace_detail::registry().enabled.load( std::memory_order_relaxed );
+}
+
+// Writes every retained event as a Chrome trace "complete" event, in
+// microseconds since enableTracing. Returns false if `path` cannot be
+// written.
+inline bool writeTrace ( std::string const & path )
+{
+    std::ofstream out( path );
+    if ( !out )
+    {
+        std::cerr << "Error: cannot open file " << path << " for writing.\n";
+        return false;
+    }
+
+    trace_detail::TraceRegistry & registry = trace_detail::registry();
+    std::lock_guard< std::mutex > lock( registry.mutex );
+    const double ticksPerUs = cycleCounterCalibration().ticksPerNs * 1e3;
+    const std::uint64_t overhead = cycleCounterCalibration().overheadTicks;
+
+    // Fixed nanosecond digits, however long the trace.
+    out << std::fixed << std::setprecision( 3 );
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    auto separator = [ & ] ()
+    {
+        out << ( first ? "" : ",\n" );
+        first = false;
+    };
+    for ( auto const & buffer : registry.buffers )
+    {
+        separator();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << buffer->id() << ",\"args\":{\"name\":";
+        trace_detail::writeJsonString( out, buffer->name().c_str() );
+        out << "}}";
+        buffer->forEach( [ & ] ( trace_detail::TraceEvent const & event )
+        {
+            const std::uint64_t ticks = event.end - event.begin;
+            separator();
+            out << "{\"name\":";
+            trace_detail::writeJsonString( out, event.name );
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id()
+                << ",\"ts\":"
+                << ( event.begin - registry.epoch ) / ticksPerUs
+                << ",\"dur\":"
+                << ( ticks > overhead ? ticks - overhead : 0 ) / ticksPerUs;
+            if ( event.value != TRACE_NO_VALUE )
+                out << ",\"args\":{\"value\":" << event.value << "}";
+            out << "}";
+        } );
+    }
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    std::cout << "Trace written to " << path << std::endl;
+    return true;
+}
+
+// Starts recording, and writes the trace to `path` at exit. The calling
+// thread gets the first row, named "Main".
+inline void enableTracing ( std::string const & path )
+{
+    trace_detail::TraceRegistry & registry = trace_detail::registry();
+    cycleCounterCalibration();
+    trace_detail::threadBuffer().setName( "Main" );
+    {
+        std::lock_guard< std::mutex > lock( registry.mutex );
+        const bool registered = !registry.path.empty();
+        registry.path = path;
+        if ( !registered )
+        {
+            registry.epoch = timer_detail::cycleCounterStart();
+            std::atexit( [] ()
+            {
+                writeTrace( trace_detail::registry().path );
+            } );
+        }
+    }
+    registry.enabled.store( true, std::memory_order_relaxed );
+}
+
+// Row label of the calling thread in the trace.
+inline void setTraceThreadName ( std::string name )
+{
+    if ( tracingEnabled() )
+        trace_detail::threadBuffer().setName( std::move( name ) );
+}
+
+/*----------------------------------------------------------------------------*/
+
+// Records the time from construction to destruction as one event named
+// `name`, with an optional integer value (a thread index, a size, ...).
+class TraceZone
+{
+
+public:
+
+    explicit TraceZone (
+        const char * name, std::int64_t value = TRACE_NO_VALUE
+    )
+        :   m_name( tracingEnabled() ? name : nullptr )
+        ,   m_value( value )
+        ,   m_begin( m_name ? timer_detail::cycleCounterStart() : 0 )
+    {
+    }
+
+    TraceZone ( TraceZone const & ) = delete;
+    TraceZone & operator = ( TraceZone const & ) = delete;
+
+    ~TraceZone ()
+    {
+        if ( !m_name )
+            return;
+        const std::uint64_t end = timer_detail::cycleCounterEnd();
+        trace_detail::threadBuffer().record(
+            trace_detail::TraceEvent{ m_name, m_value, m_begin, end }
+        );
+    }
+
+private:
+
+    const char * m_name;
+    std::int64_t m_value;
+    std::uint64_t m_begin;
+};
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__TRACE_H__
@@ -0,0 +1,145 @@
+#ifndef __UTILS__WORK_STEALING_H__
+#define __UTILS__WORK_STEALING_H__
+
+/*----------------------------------------------------------------------------*/
+
+#include "cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+/*----------------------------------------------------------------------------*/
+
+// Half-open range of indices [begin, end).
+struct IndexRange
+{
+    int begin;
+    int end;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+Work-stealing scheduler over an index range.
+
+distribute() cuts [0, count) into ranges of `grain` indices and deals them to
+one deque per thread, in contiguous blocks so that without stealing every
+thread walks the same rows as the static split. Inside an executor task,
+work( t, func ) then calls func( begin, end ) for the ranges thread t gets:
+first its own, popped from the front of its deque so rows are scanned in
+order, then ranges stolen from the back of the other threads' deques, as far
+as possible from where their owners are working. No new work is created while
+running, so a thread is done once a full sweep over all deques comes back
+empty.
+
+The deques are small mutex-protected std::deque's; with a sensible grain the
+lock is taken once per range, which is cheap next to scanning the rows.
+*/
+class WorkStealingScheduler
+{
+
+public:
+
+    explicit WorkStealingScheduler ( int maxThreads )
+        :   m_queues( new Queue[ maxThreads ] )
+        ,   m_maxThreads( maxThreads )
+    {
+    }
+
+    // Grain used when none is given: about eight ranges per thread.
+    static int defaultGrain ( int count, int numThreads )
+    {
+        return std::max( 1, count / ( numThreads * 8 ) );
+    }
+
+    // Must not be called while a previous distribution is being worked on.
+    void distribute ( int count, int numThreads, int grain )
+    {
+        m_numThreads = std::min( numThreads, m_maxThreads );
+        if ( grain <= 0 )
+            grain = defaultGrain( count, m_numThreads );
+
+        int numRanges = ( count + grain - 1 ) / grain;
+        int perThread = ( numRanges + m_numThreads - 1 ) / m_numThreads;
+        for ( int t = 0; t < m_numThreads; ++t )
+        {
+            Queue & queue = m_queues[ t ];
+            queue.ranges.clear();
+            int first = std::min( t * perThread, numRanges );
+            int last = std::min( first + perThread, numRanges );
+            for ( int r = first; r < last; ++r )
+            {
+                queue.ranges.push_back(
+                    { r * grain, std::min( ( r + 1 ) * grain, count ) }
+                );
+            }
+        }
+        m_steals.store( 0, std::memory_order_relaxed );
+    }
+
+    template < typename _RangeFuncT >
+    void work ( int thread, _RangeFuncT && func )
+    {
+        IndexRange range;
+        while ( popOwn( thread, range ) )
+            func( range.begin, range.end );
+
+        for ( int attempt = 1; attempt < m_numThreads; )
+        {
+            int victim = ( thread + attempt ) % m_numThreads;
+            if ( steal( victim, range ) )
+            {
+                m_steals.fetch_add( 1, std::memory_order_relaxed );
+                func( range.begin, range.end );
+                // Stay on a victim that still had work.
+                continue;
+            }
+            ++attempt;
+        }
+    }
+
+    // Ranges taken from another thread's deque in the last distribution.
+    int steals () const { return m_steals.load( std::memory_order_relaxed ); }
+
+private:
+
+    struct alignas( CACHE_LINE_SIZE ) Queue
+    {
+        std::mutex mutex;
+        std::deque< IndexRange > ranges;
+    };
+
+    bool popOwn ( int thread, IndexRange & range )
+    {
+        Queue & queue = m_queues[ thread ];
+        std::lock_guard< std::mutex > lock( queue.mutex );
+        if ( queue.ranges.empty() )
+            return false;
+        range = queue.ranges.front();
+        queue.ranges.pop_front();
+        return true;
+    }
+
+    bool steal ( int victim, IndexRange & range )
+    {
+        Queue & queue = m_queues[ victim ];
+        std::lock_guard< std::mutex > lock( queue.mutex );
+        if ( queue.ranges.empty() )
+            return false;
+        range = queue.ranges.back();
+        queue.ranges.pop_back();
+        return true;
+    }
+
+    std::unique_ptr< Queue[] > m_queues;
+    int m_maxThreads;
+    int m_numThreads = 0;
+    std::atomic< int > m_steals{ 0 };
+};
+
+/*----------------------------------------------------------------------------*/
+
+#endif // __UTILS__WORK_STEALING_H__